@@ -89,12 +89,14 @@ function set_compiler( settings, config )
     elseif compiler == "gcc" then
         SetDriversGCC( settings )
         settings.cc.flags:Add( "-Wconversion", "-Wextra", "-Wall", "-Werror", "-Wstrict-aliasing=2", "-std=c++11" )
+        settings.link.libs:Add( "pthread" )
         if config == "release" then
             settings.cc.flags:Add( "-O2" )
         end
     elseif compiler == "clang" then
         SetDriversClang( settings )
         settings.cc.flags:Add( "-Wconversion", "-Wextra", "-Wall", "-Werror", "-Wstrict-aliasing=2", "-std=c++11" )
+        settings.link.libs:Add( "pthread" )
         if config == "release" then
             settings.cc.flags:Add( "-O2" )
         end
@@ -119,6 +121,7 @@ local lib   = StaticLibrary( settings, 'dirutil', objs )
 
 local tests   = Link( settings, 'dirutil_tests', Compile( settings, 'tests/test_dirutil.cpp' ), lib )
 local listdir = Link( settings, 'listdir', Compile( settings, 'tests/listdir.cpp' ), lib )
+local bench   = Link( settings, 'dirutil_bench', Compile( settings, 'tests/bench_dirutil.cpp' ), lib )
 
 test_args = " -v"
 if ScriptArgs["test"]     then test_args = test_args .. " -t " .. ScriptArgs["test"] end
@@ -134,6 +137,15 @@ else
     SkipOutputVerification("valgrind")
 end
 
-PseudoTarget( "all", tests, listdir )
+bench_args = ""
+if ScriptArgs["bench"] then bench_args = " " .. ScriptArgs["bench"] end
+if family == "windows" then
+    AddJob( "bench", "benchmark", string.gsub( bench, "/", "\\" ) .. bench_args, bench, bench )
+else
+    AddJob( "bench", "benchmark", bench .. bench_args, bench, bench )
+end
+SkipOutputVerification("bench")
+
+PseudoTarget( "all", tests, listdir, bench )
 DefaultTarget( "all" )
 
@@ -27,6 +27,8 @@
 #ifndef FILE_DIR_H_INCLUDED
 #define FILE_DIR_H_INCLUDED
 
+#include <stddef.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -39,7 +41,9 @@ enum dir_error
 	DIR_ERROR_FAILED,
 	DIR_ERROR_PATH_TO_DEEP,
 	DIR_ERROR_PATH_IS_FILE,
-	DIR_ERROR_PATH_DO_NOT_EXIST
+	DIR_ERROR_PATH_DO_NOT_EXIST,
+	DIR_ERROR_INVALID_PATTERN,
+	DIR_ERROR_ABORTED
 };
 
 enum dir_walk_flags
@@ -61,7 +65,43 @@ enum dir_walk_flags
     * While walking a directory, ignore files/dirs starting with a '.' such as '.secret'
     */
    DIR_WALK_IGNORE_DOT_ITEMS = DIR_WALK_IGNORE_DOT_FILES | 
-                               DIR_WALK_IGNORE_DOT_DIRS
+                               DIR_WALK_IGNORE_DOT_DIRS,
+
+   /**
+    * While walking a directory, fetch metadata of each item and pass it in dir_walk_item::stat.
+    * This is done with one call to statx() per item on linux, fstatat() on other unix-likes and is
+    * free on windows where the data is already fetched while reading the directory.
+    */
+   DIR_WALK_WITH_STAT        = 1 << 4,
+
+   /**
+    * Report the items in each directory sorted by name ( strcmp-order ) instead of in the order the filesystem
+    * returns them, making the walk order the same on all machines and filesystems. All entries of a directory are
+    * read before any is reported, into buffers reused for all directories at the same depth.
+    * Supported by dir_walk(), dir_iter_open() and dir_walk_glob(), ignored by dir_walk_parallel() and
+    * dir_walk_async().
+    */
+   DIR_WALK_SORTED           = 1 << 5
+};
+
+/**
+ * Values returned from dir_walk_callback and dir_change_callback to control the walk, any other value, such as
+ * 1, is treated as DIR_WALK_CONTINUE.
+ */
+enum dir_walk_result
+{
+	DIR_WALK_CONTINUE     = 0,
+
+   /**
+    * Stop the walk, no more items are reported and the walk returns DIR_ERROR_ABORTED.
+    */
+   DIR_WALK_ABORT        = 2,
+
+   /**
+    * If the item is a dir, do not walk the items in it. Ignored for files and for dirs reported after
+    * the items in them with DIR_WALK_DEPTH_FIRST.
+    */
+   DIR_WALK_SKIP_SUBTREE = 3
 };
 
 enum dir_item_type
@@ -71,6 +111,13 @@ enum dir_item_type
 	DIR_ITEM_UNHANDLED
 };
 
+enum dir_change_type
+{
+	DIR_CHANGE_ADDED,
+	DIR_CHANGE_REMOVED,
+	DIR_CHANGE_MODIFIED
+};
+
 enum dir_glob_result
 {
 	DIR_GLOB_MATCH,
@@ -78,6 +125,37 @@ enum dir_glob_result
 	DIR_GLOB_INVALID_PATTERN
 };
 
+/**
+ * Metadata of an item, fetched while walking with DIR_WALK_WITH_STAT.
+ */
+struct dir_item_stat
+{
+   /**
+    * size of item in bytes.
+    */
+   uint64_t size;
+
+   /**
+    * time of last modification, in nanoseconds since 1970-01-01 UTC.
+    */
+   uint64_t mtime_ns;
+
+   /**
+    * inode-number of item, always 0 on windows.
+    */
+   uint64_t inode;
+
+   /**
+    * id of device containing item, always 0 on windows.
+    */
+   uint64_t device;
+
+   /**
+    * type and permission bits of item as in st_mode from stat(), emulated on windows.
+    */
+   uint32_t mode;
+};
+
 /**
  * Item passed to callback used with dir_walk()
  */
@@ -103,20 +181,106 @@ struct dir_walk_item
     */
    dir_item_type type;
 
+   /**
+    * metadata of item if DIR_WALK_WITH_STAT was passed to dir_walk() and it could be fetched, otherwise 0x0.
+    */
+   const dir_item_stat* stat;
+
    /**
     * userdata passed to dir_walk().
     */
    void* userdata;
 };
 
+/**
+ * Statistics of a walk, filled in by dir_walk_with_stats().
+ *
+ * Counting and timing is compiled out, and all fields are left at 0, if the library is built with DIRUTIL_NO_STATS.
+ */
+struct dir_walk_stats
+{
+   /**
+    * number of directories opened, including root.
+    */
+   uint64_t dirs_opened;
+
+   /**
+    * number of entries read from the directories, excluding '.' and '..'.
+    */
+   uint64_t entries_read;
+
+   /**
+    * number of entries where the filesystem did not report the type so that an extra stat was needed to find it.
+    */
+   uint64_t stat_fallbacks;
+
+   /**
+    * number of entries where metadata was fetched for DIR_WALK_WITH_STAT.
+    */
+   uint64_t stats_fetched;
+
+   /**
+    * number of entries skipped due to DIR_WALK_IGNORE_DOT_*.
+    */
+   uint64_t dot_items_skipped;
+
+   /**
+    * deepest directory opened, root is at depth 0.
+    */
+   uint64_t max_depth;
+
+   /**
+    * nanoseconds spent opening directories, reading entries, fetching type or metadata and in the callback.
+    */
+   uint64_t open_ns;
+   uint64_t read_ns;
+   uint64_t stat_ns;
+   uint64_t callback_ns;
+};
+
 /**
  * Callback called for each item with dir_walk.
  * @param path full path to current item with input path to dir_walk() as a base.
  * @param type item type, file or dir.
  * @param userdata passed to dir_walk.
+ * @return a dir_walk_result.
  */
 typedef int ( *dir_walk_callback )( const dir_walk_item* item );
 
+/**
+ * Callback called for each changed item with dir_walk_changes().
+ * @param change how the item changed since the snapshot was written.
+ * @param item the changed item, item->stat is the current metadata of added and modified items and 0x0 for
+ *             removed items.
+ * @return a dir_walk_result, DIR_WALK_SKIP_SUBTREE skip the items below an added or removed dir.
+ */
+typedef int ( *dir_change_callback )( dir_change_type change, const dir_walk_item* item );
+
+/**
+ * Change reported by dir_watch_poll().
+ */
+struct dir_watch_event
+{
+   /**
+    * how the item changed, several changes of the same item during a batch are reported as one.
+    */
+   dir_change_type change;
+
+   /**
+    * the changed item, item.stat is set for added and modified items if the watch was opened with
+    * DIR_WALK_WITH_STAT and the item could be stat:ed.
+    */
+   dir_walk_item item;
+};
+
+/**
+ * Callback called with each batch of changes from dir_watch_poll() and dir_watch_rescan().
+ * @param events changes in the batch, only valid during the call.
+ * @param num_events number of events, always at least 1.
+ * @param userdata passed to dir_watch_poll() or dir_watch_rescan().
+ */
+typedef void ( *dir_watch_callback )( const dir_watch_event* events, size_t num_events, void* userdata );
+
 /**
  * Create directory.
  * @param path dir to create
@@ -131,14 +295,125 @@ dir_error dir_create( const char* path );
  */
 dir_error dir_rmtree( const char* path );
 
+/**
+ * Remove directory recursively using multiple threads.
+ *
+ * Directories are read by a pool of work-stealing threads, files are removed relative the directory they are in
+ * and, in large directories, handed out in batches to other threads. Each directory is removed as soon as all
+ * items below it are. Symlinks are removed, never followed.
+ *
+ * On the first error no more items are removed and the error is returned once all threads has stopped.
+ *
+ * @param path dir to remove.
+ * @param num_threads max number of threads to use, 0 to use the number of hardware threads.
+ *
+ * @note this is not an atomic operation and if it fails it might leave the directory partly removed.
+ */
+dir_error dir_rmtree_parallel( const char* path, unsigned int num_threads );
+
+/**
+ * Handle to a removal started with dir_rmtree_async().
+ */
+struct dir_rmtree_job;
+
+/**
+ * Remove directory recursively in the background.
+ *
+ * path is renamed to a trash-directory next to it, named ".dirutil-trash.<pid>.<n>", and then removed with
+ * dir_rmtree_parallel() on a background thread. As the rename is atomic path is gone, and can be created again,
+ * as soon as this function returns.
+ *
+ * @param path dir to remove.
+ * @param num_threads passed to dir_rmtree_parallel() by the background thread.
+ * @param job if not 0x0, set to a handle that need to be passed to dir_rmtree_wait(). If 0x0 the removal is
+ *            not waited for and if the process exits before it is done the trash-directory is left to be
+ *            removed by dir_rmtree_reap().
+ * @return DIR_ERROR_OK if path was renamed and the removal started, DIR_ERROR_PATH_IS_FILE if path is not a dir.
+ *         On error job is set to 0x0.
+ *
+ * @note if path can not be renamed, i.e. it is a mount-point, it is removed before this function returns and
+ *       the returned job is already done.
+ */
+dir_error dir_rmtree_async( const char* path, unsigned int num_threads, dir_rmtree_job** job );
+
+/**
+ * Wait for a removal started with dir_rmtree_async() to finish and free the job.
+ * @return the result of the removal.
+ */
+dir_error dir_rmtree_wait( dir_rmtree_job* job );
+
+/**
+ * Remove trash-directories left by dir_rmtree_async() in a process that exited before the removal was done,
+ * i.e. crashed. Trash owned by a process that is still running is left alone.
+ *
+ * @param dir directory to look for trash in, the parent of the paths passed to dir_rmtree_async(), "" for
+ *            the current directory.
+ * @return DIR_ERROR_OK if all found trash was removed.
+ */
+dir_error dir_rmtree_reap( const char* dir );
+
 /**
  * Create all non-existing directories in path.
+ *
+ * Directories are probed from the leaf upward so that only the missing directories at the end of path cost
+ * a syscall each, creating a dir below an existing deep root is a single mkdir().
+ *
  * @param path dirs to create
  */
 dir_error dir_mktree( const char* path );
 
+/**
+ * Create all non-existing directories in many paths, as dir_mktree() on each path.
+ *
+ * Directories created or found to exist while creating one path are remembered so that paths sharing a
+ * parent with an earlier path only need to create what is below the shared parent.
+ *
+ * @param paths paths to create.
+ * @param num_paths number of paths in paths.
+ * @return DIR_ERROR_OK if all paths were created, otherwise the first error. All paths are tried even if one fail.
+ */
+dir_error dir_mktree_many( const char** paths, size_t num_paths );
+
+/**
+ * Copy directory recursively, files already in dst are overwritten.
+ *
+ * Dirs are created while src is walked, then the files are copied with multiple files in flight at once.
+ * Each file is copied the fastest way the platform support, on linux as a reflink (FICLONE) sharing the data
+ * with src if the filesystem support it, otherwise in the kernel with copy_file_range() or sendfile(), and as
+ * a last resort with read()/write(). Files keep their permissions. Symlinks, to files or dirs and dangling ones,
+ * are copied as symlinks with the same target and are never followed, on windows the target of a link is copied.
+ *
+ * @param src dir to copy.
+ * @param dst dir to copy to, created if it do not exist. Should not be inside src.
+ * @param flags DIR_WALK_IGNORE_DOT_* to skip items, other flags are ignored.
+ *
+ * @return DIR_ERROR_PATH_TO_DEEP if a path in src or dst is longer than the OS can open in one go, PATH_MAX on
+ *         posix, as items are created and copied by full path.
+ *
+ * @note this is not an atomic operation and if it fails it might leave the directory partly copied.
+ */
+dir_error dir_copytree( const char* src, const char* dst, unsigned int flags );
+
+/**
+ * Copy the items in src matching a glob-pattern, as dir_copytree(). Parent dirs of matching items are created
+ * even if they do not match themselves.
+ *
+ * @param glob_pattern pattern, with the same rules as dir_glob_compile(), to match vs paths relative src.
+ */
+dir_error dir_copytree_glob( const char* src, const char* dst, const char* glob_pattern, unsigned int flags );
+
 /**
  * Call callback once for each item in the directory and, depending on flags, it's sub-directories.
+ *
+ * On filesystems that do not report the type of items while reading a directory, i.e. some network- and
+ * overlay-filesystems, each directory after the first such item is read in full and the types resolved in one
+ * batch, with io_uring on linux if available and otherwise on a few threads for large directories.
+ *
+ * Paths are built in a buffer that grows as needed. The walk fails with DIR_ERROR_PATH_TO_DEEP for paths longer
+ * than DIRUTIL_MAX_PATH_LENGTH, 64KB unless defined otherwise when building dirutil. This also applies to all
+ * other functions that walk a tree, such as dir_iter_open(), dir_walk_async(), dir_snapshot_write() and
+ * dir_copytree().
+ *
  * @param root path to walk.
  * @param flags controlling the walk.
  * @param callback called for each item in walk.
@@ -146,6 +421,244 @@ dir_error dir_mktree( const char* path );
  */
 dir_error dir_walk( const char* root, unsigned int flags, dir_walk_callback callback, void* userdata );
 
+/**
+ * Same as dir_walk() but also count and time what the walk spends its time on.
+ * @param stats filled in with statistics of the walk, if not 0x0.
+ */
+dir_error dir_walk_with_stats( const char* root, unsigned int flags, dir_walk_callback callback, void* userdata, dir_walk_stats* stats );
+
+/**
+ * Call callback once for each item in the directory and, depending on flags, it's sub-directories, spreading
+ * the sub-directories over a pool of work-stealing threads.
+ *
+ * Callback contract:
+ * - callback might be called concurrently from up to num_threads threads, including the calling thread.
+ * - all items in one directory are reported from the same thread, in the order they are read. With
+ *   DIR_WALK_DEPTH_FIRST this only holds for files, see below.
+ * - without DIR_WALK_DEPTH_FIRST a directory is reported before any item in it.
+ * - with DIR_WALK_DEPTH_FIRST a directory is reported after all items below it has been reported, from the
+ *   thread that finished the last work below it, reading it or one of its sub-directories. Directories in the
+ *   same parent might therefore be reported from different threads and in any order.
+ * - item and all strings in it are only valid during the call.
+ *
+ * @param root path to walk.
+ * @param flags controlling the walk.
+ * @param num_threads max number of threads to walk with, 0 to use the number of hardware threads.
+ * @param callback called for each item in walk.
+ * @param userdata passed to callback.
+ */
+dir_error dir_walk_parallel( const char* root, unsigned int flags, unsigned int num_threads, dir_walk_callback callback, void* userdata );
+
+/**
+ * Call callback once for each item in the directory and, depending on flags, it's sub-directories, keeping many
+ * directory opens and stats in flight at once to keep the device queue full while walking from a single thread.
+ *
+ * On linux io_uring is used, if available, to queue openat() and statx(), the directories themselves are read
+ * with getdents64() when opened. Where io_uring is not available, or with DIR_WALK_DEPTH_FIRST, the walk is done
+ * with dir_walk_parallel() instead.
+ *
+ * Callback contract:
+ * - callback might be called concurrently as described for dir_walk_parallel(), with io_uring all calls are
+ *   done from the calling thread.
+ * - without DIR_WALK_DEPTH_FIRST a directory is reported before any item in it, items in a directory are
+ *   reported as their data arrive and not necessarily in the order they are read.
+ * - item and all strings in it are only valid during the call.
+ *
+ * @param root path to walk.
+ * @param flags controlling the walk.
+ * @param queue_depth max number of operations in flight, 0 for a default of 64.
+ * @param callback called for each item in walk.
+ * @param userdata passed to callback.
+ */
+dir_error dir_walk_async( const char* root, unsigned int flags, unsigned int queue_depth, dir_walk_callback callback, void* userdata );
+
+/**
+ * Iterator over the items of a walk, opened with dir_iter_open().
+ */
+struct dir_iter;
+
+/**
+ * Open an iterator returning the same items, in the same order, as dir_walk() with the same root and flags
+ * would report to its callback, one per call to dir_iter_next().
+ *
+ * The iterator keeps one open directory per level below root and nothing is read before it is asked for, so
+ * stopping early is free.
+ *
+ * @param root path to walk.
+ * @param flags controlling the walk.
+ * @param iter set to the opened iterator, to close with dir_iter_close(), or 0x0 on error.
+ */
+dir_error dir_iter_open( const char* root, unsigned int flags, dir_iter** iter );
+
+/**
+ * Get the next item from the iterator.
+ * @return next item, valid until the next call to dir_iter_next() or dir_iter_close(), or 0x0 when the walk is done.
+ */
+const dir_walk_item* dir_iter_next( dir_iter* iter );
+
+/**
+ * Do not walk the items in the dir last returned by dir_iter_next(), the same as returning
+ * DIR_WALK_SKIP_SUBTREE from a dir_walk_callback.
+ */
+void dir_iter_skip_subtree( dir_iter* iter );
+
+/**
+ * Get the first error that happened while iterating, such as DIR_ERROR_PATH_TO_DEEP. The iterator continues
+ * with the next item on errors.
+ */
+dir_error dir_iter_error( const dir_iter* iter );
+
+/**
+ * Close iterator opened with dir_iter_open(), it does not need to be done.
+ */
+void dir_iter_close( dir_iter* iter );
+
+/**
+ * Walk root and write a snapshot of it to a file that can later be passed to dir_walk_changes() to find
+ * what has changed in the tree since the snapshot was written.
+ *
+ * The snapshot stores name, type, size and mtime of all items in a compact binary format that is memory-mapped
+ * when read. The file is written to a temporary file and moved into place when complete.
+ *
+ * @param root path to walk.
+ * @param flags controlling the walk, DIR_WALK_IGNORE_DOT_* are stored in the snapshot and used by
+ *              dir_walk_changes() as well.
+ * @param snapshot_path path of snapshot-file to write.
+ */
+dir_error dir_snapshot_write( const char* root, unsigned int flags, const char* snapshot_path );
+
+/**
+ * Call callback once for each item in root that has been added, removed or modified since snapshot_path
+ * was written with dir_snapshot_write().
+ *
+ * Directories that have the same mtime as in the snapshot are not read again, instead the items stored in the
+ * snapshot are checked directly. Note that a file being modified do not update the mtime of the directory
+ * containing it so files still need to be checked one by one.
+ *
+ * Files are reported as modified if size or mtime changed, directories are never reported as modified, items
+ * added to or removed from them are reported instead. If a directory is added or removed all items in it
+ * are reported as well.
+ *
+ * @param root path to check, should be the same as the path used when writing the snapshot.
+ * @param snapshot_path path to snapshot written by dir_snapshot_write().
+ * @param callback called for each changed item.
+ * @param userdata passed to callback in item->userdata.
+ * @return DIR_ERROR_FAILED if the snapshot could not be read or memory could not be allocated,
+ *         DIR_ERROR_PATH_TO_DEEP if a path in the tree was longer than DIRUTIL_MAX_PATH_LENGTH. The changes reported before an
+ *         error are not the complete set of changes.
+ */
+dir_error dir_walk_changes( const char* root, const char* snapshot_path, dir_change_callback callback, void* userdata );
+
+/**
+ * Listing of a tree, built with dir_tree_build().
+ *
+ * All items are stored as nodes in one allocation, as one array per field, with all names stored once in one
+ * string-blob. Nodes are identified by index, node 0 is the root and the children of each dir are stored
+ * consecutively and sorted by name.
+ */
+struct dir_tree;
+
+/**
+ * Index returned by dir_tree-functions when there is no such node.
+ */
+#define DIR_TREE_NO_NODE ((uint32_t)0xFFFFFFFF)
+
+/**
+ * Walk root and store all items in it in a dir_tree.
+ * @param root path to walk.
+ * @param flags controlling the walk, DIR_WALK_DEPTH_FIRST is ignored. With DIR_WALK_WITH_STAT size and mtime of
+ *              each item is stored.
+ * @param tree set to the built tree, to free with dir_tree_free(), or 0x0 on error.
+ */
+dir_error dir_tree_build( const char* root, unsigned int flags, dir_tree** tree );
+
+/**
+ * Free tree built with dir_tree_build().
+ */
+void dir_tree_free( dir_tree* tree );
+
+/**
+ * Get number of nodes in tree, including the root.
+ */
+uint32_t dir_tree_node_count( const dir_tree* tree );
+
+/**
+ * Get parent of node, DIR_TREE_NO_NODE for the root.
+ */
+uint32_t dir_tree_parent( const dir_tree* tree, uint32_t node );
+
+/**
+ * Get name of node, "" for the root.
+ */
+const char* dir_tree_name( const dir_tree* tree, uint32_t node );
+
+/**
+ * Get type of node.
+ */
+dir_item_type dir_tree_type( const dir_tree* tree, uint32_t node );
+
+/**
+ * Get size of node in bytes, 0 if tree was not built with DIR_WALK_WITH_STAT.
+ */
+uint64_t dir_tree_size( const dir_tree* tree, uint32_t node );
+
+/**
+ * Get time of last modification of node in nanoseconds, see dir_item_stat::mtime_ns, 0 if tree was not built
+ * with DIR_WALK_WITH_STAT.
+ */
+uint64_t dir_tree_mtime( const dir_tree* tree, uint32_t node );
+
+/**
+ * Get children of node, these are nodes first_child to first_child + count - 1 sorted by name.
+ * @param first_child set to the index of the first child.
+ * @return number of children.
+ */
+uint32_t dir_tree_children( const dir_tree* tree, uint32_t node, uint32_t* first_child );
+
+/**
+ * Find child of node by name with a binary search.
+ * @return index of child or DIR_TREE_NO_NODE, also if node is not a dir.
+ */
+uint32_t dir_tree_find_child( const dir_tree* tree, uint32_t node, const char* name );
+
+/**
+ * Find node by path relative root, such as "dir/file.txt".
+ * @return index of node or DIR_TREE_NO_NODE.
+ */
+uint32_t dir_tree_find( const dir_tree* tree, const char* relative );
+
+/**
+ * Write path of node relative root to buffer, the same as dir_walk_item::relative.
+ * @return length of path, if it is buffer_size or more nothing is written.
+ */
+size_t dir_tree_path( const dir_tree* tree, uint32_t node, char* buffer, size_t buffer_size );
+
+/**
+ * Write tree to a file that can be opened with dir_tree_open(). The file is written atomically and uses the same
+ * versioned format as dir_snapshot_write(), so a tree built with DIR_WALK_WITH_STAT can also be passed to
+ * dir_walk_changes().
+ * @param tree_path path of file to write.
+ */
+dir_error dir_tree_write( const dir_tree* tree, const char* tree_path );
+
+/**
+ * Open a tree written with dir_tree_write(). The file is memory-mapped and all queries are done directly on the
+ * mapped data, nothing is parsed or copied.
+ * @param tree_path path of file to open.
+ * @param tree set to the opened tree, to free with dir_tree_free(), or 0x0 on error.
+ * @return DIR_ERROR_FAILED if the file is not a valid tree-file of a supported version.
+ */
+dir_error dir_tree_open( const char* tree_path, dir_tree** tree );
+
+/**
+ * Call callback once for each item in root that has been added, removed or modified compared to tree, the same
+ * as dir_walk_changes(). Use this to validate that a stored tree is still up to date.
+ * @param tree to compare with, must be built with DIR_WALK_WITH_STAT.
+ * @param root path to check, should be the same as the path used when building the tree.
+ * @return DIR_ERROR_FAILED if tree was not built with DIR_WALK_WITH_STAT.
+ */
+dir_error dir_tree_changes( const dir_tree* tree, const char* root, dir_change_callback callback, void* userdata );
+
 /**
  * Matches an unix style glob-pattern, with added support for ** from ant, vs a path.
  *
@@ -164,6 +677,9 @@ dir_error dir_walk( const char* root, unsigned int flags, dir_walk_callback call
  * @note {} currently do not support sub-expressions of the other types. This could be added if there
  *       is any need for it.
  *
+ * The pattern is compiled as with dir_glob_compile(), the last compiled pattern is cached per thread, and
+ * matching is done in O( pattern length * path length ) for any pattern.
+ *
  * For more information see http://man7.org/linux/man-pages/man7/glob.7.html
  *
  * @param glob_pattern is an glob pattern.
@@ -172,12 +688,176 @@ dir_error dir_walk( const char* root, unsigned int flags, dir_walk_callback call
  */
 dir_glob_result dir_glob_match( const char* glob_pattern, const char* path );
 
+/**
+ * Glob-pattern compiled with dir_glob_compile().
+ */
+struct dir_glob;
+
+/**
+ * Validate and compile a glob-pattern, with the same rules as dir_glob_match(), to be matched vs many paths
+ * with dir_glob_match_compiled() without parsing the pattern again.
+ *
+ * @note '**' need to be a complete path-segment followed by a '/' and {} can not contain '/'.
+ *
+ * @param glob_pattern is an glob pattern.
+ * @return compiled pattern to free with dir_glob_free() or 0x0 if pattern is invalid.
+ */
+dir_glob* dir_glob_compile( const char* glob_pattern );
+
+/**
+ * Free pattern returned by dir_glob_compile().
+ */
+void dir_glob_free( dir_glob* glob );
+
+/**
+ * Match a pattern compiled with dir_glob_compile() vs a path.
+ * @param glob compiled pattern.
+ * @param path path to match.
+ * @return DIR_GLOB_MATCH on match, DIR_GLOB_NO_MATCH on mismatch.
+ */
+dir_glob_result dir_glob_match_compiled( const dir_glob* glob, const char* path );
+
+/**
+ * Set of glob-patterns compiled with dir_globset_compile().
+ */
+struct dir_globset;
+
+/**
+ * Compile a set of glob-patterns to match paths against all of them at once with dir_globset_match().
+ *
+ * Patterns without wildcards and patterns matching a name or an extension in any directory are looked up
+ * by the path, its last segment or its extension. Patterns starting with literal directories or ending
+ * with a literal extension are looked up the same way and then matched in full. Only the remaining
+ * patterns are matched one by one vs each path.
+ *
+ * @param glob_patterns patterns to compile, with the same rules as dir_glob_compile().
+ * @param num_patterns number of patterns in glob_patterns.
+ * @param invalid_pattern if not 0x0, set to the index of the first invalid pattern if one is found.
+ * @return compiled set to free with dir_globset_free() or 0x0 on error.
+ */
+dir_globset* dir_globset_compile( const char** glob_patterns, size_t num_patterns, size_t* invalid_pattern );
+
+/**
+ * Free set returned by dir_globset_compile().
+ */
+void dir_globset_free( dir_globset* set );
+
+/**
+ * Find all patterns in a set that match a path.
+ * @param set compiled set of patterns.
+ * @param path path to match.
+ * @param matches buffer to write indices of matching patterns to, sorted in ascending order. If more
+ *                than max_matches patterns match the lowest indices are written.
+ * @param max_matches size of matches.
+ * @return number of matching patterns, can be larger than max_matches.
+ */
+size_t dir_globset_match( const dir_globset* set, const char* path, uint32_t* matches, size_t max_matches );
+
+/**
+ * Call callback once for each item below root where the path relative root matches a glob-pattern, see
+ * dir_glob_compile() for the pattern rules.
+ *
+ * Directories where no path below them can match the pattern are never opened, names are matched before
+ * the type of an item is fetched and leading directory names without wildcards, such as 'src/engine/' at the
+ * start of a pattern, are opened directly without reading the directories above them.
+ *
+ * @param root path to walk.
+ * @param glob_pattern pattern to match vs dir_walk_item::relative.
+ * @param flags controlling the walk.
+ * @param callback called for each matching item.
+ * @param userdata passed to callback.
+ * @return DIR_ERROR_INVALID_PATTERN if glob_pattern is invalid.
+ */
+dir_error dir_walk_glob( const char* root, const char* glob_pattern, unsigned int flags, dir_walk_callback callback, void* userdata );
+
+/**
+ * Call callback once for each item in tree matching a glob-pattern, the same as dir_walk_glob() but without
+ * touching the filesystem. Items are reported in name-order.
+ *
+ * item->path and item->relative are both the path relative the root of the tree and, if the tree was built with
+ * DIR_WALK_WITH_STAT, item->stat only has size and mtime_ns set.
+ *
+ * @param tree to walk.
+ * @param glob_pattern pattern to match vs dir_walk_item::relative.
+ * @param flags controlling the walk, DIR_WALK_IGNORE_DOT_* and DIR_WALK_DEPTH_FIRST are supported.
+ * @param callback called for each matching item.
+ * @param userdata passed to callback in item->userdata.
+ * @return DIR_ERROR_INVALID_PATTERN if glob_pattern could not be compiled.
+ */
+dir_error dir_tree_walk_glob( const dir_tree* tree, const char* glob_pattern, unsigned int flags, dir_walk_callback callback, void* userdata );
+
+/**
+ * Watch of a tree, opened with dir_watch_open().
+ */
+struct dir_watch;
+
+/**
+ * Start watching all items below root for changes, currently only supported on linux where it is implemented
+ * with inotify.
+ *
+ * Every directory in the tree is watched and directories added later are watched as they appear, items
+ * created in a new directory before it was watched are found by reading it when it is added.
+ *
+ * If the kernel event-queue overflows and events are lost the tree is walked again and compared with the items
+ * known by the watch, so that nothing is missed even under heavy load.
+ *
+ * @param root path to watch.
+ * @param glob_pattern only report items where the path relative root matches this pattern, see dir_glob_compile(),
+ *                     0x0 to report all items.
+ * @param flags DIR_WALK_IGNORE_DOT_* and DIR_WALK_WITH_STAT are supported.
+ * @param watch set to the opened watch on success.
+ * @return DIR_ERROR_INVALID_PATTERN if glob_pattern is invalid, DIR_ERROR_PATH_DO_NOT_EXIST if root is not a
+ *         directory and DIR_ERROR_FAILED if watching is not supported.
+ */
+dir_error dir_watch_open( const char* root, const char* glob_pattern, unsigned int flags, dir_watch** watch );
+
+/**
+ * Stop watching and free all memory used by watch.
+ */
+void dir_watch_close( dir_watch* watch );
+
+/**
+ * File-descriptor that is readable when there are changes to poll, to be used with poll()/select()/epoll
+ * in an existing event-loop. -1 if not supported.
+ */
+int dir_watch_fd( const dir_watch* watch );
+
+/**
+ * Wait for changes and report them as one batch.
+ *
+ * When the first change arrive the batch is kept open until no more changes arrived for settle_ms, or for
+ * at most 10 * settle_ms (but at least a second), so that a burst of changes, such as a checkout, is reported
+ * in one call. Changes of the same item are coalesced, i.e. a file that is added and then modified is only
+ * reported as added and a file added and then removed is not reported at all.
+ *
+ * @param watch to poll.
+ * @param timeout_ms max time to wait for the first change, 0 to only check already queued changes and -1
+ *                   to wait forever.
+ * @param settle_ms time without changes before the batch is reported.
+ * @param callback called once with all changes in the batch, not called if nothing changed.
+ * @param userdata passed to callback and in item.userdata of each event.
+ * @return DIR_ERROR_OK if the wait ended, even without changes, and DIR_ERROR_PATH_DO_NOT_EXIST if root
+ *         was removed, in which case everything below it has been reported as removed.
+ */
+dir_error dir_watch_poll( dir_watch* watch, int timeout_ms, unsigned int settle_ms, dir_watch_callback callback, void* userdata );
+
+/**
+ * Walk the watched tree and report every item that differ from what the watch knows about, without waiting
+ * for events. Use this after events might have been missed, such as after a suspend.
+ * @param watch to rescan.
+ * @param callback called once with all changes found, not called if nothing changed.
+ * @param userdata passed to callback and in item.userdata of each event.
+ */
+dir_error dir_watch_rescan( dir_watch* watch, dir_watch_callback callback, void* userdata );
+
 #ifdef __cplusplus
 }
 #endif  // __cplusplus
 
 #if __cplusplus >= 201103L || ( defined(_MSC_VER) && (_MSC_VER >= 1600) )
 
+#include <type_traits>
+
 /**
  * Call functor once for each item in the directory and, depending on flags, it's sub-directories.
  * @param root path to walk.
@@ -188,11 +868,196 @@ template <typename FUNC>
 inline dir_error dir_walk( const char* root, unsigned int flags, FUNC&& functor)
 {
    return dir_walk(root, flags, 
-      [](const dir_walk_item* item) {
-         return (*(FUNC*)item->userdata)(item);
+      [](const dir_walk_item* item) -> int {
+         return (*(typename std::remove_reference<FUNC>::type*)item->userdata)(item);
       }, &functor);
 }
 
+/**
+ * Call functor once for each item in the directory and, depending on flags, it's sub-directories, and fill in
+ * statistics of the walk.
+ * @param root path to walk.
+ * @param flags controlling the walk.
+ * @param stats filled in with statistics of the walk.
+ * @param functor to call per item.
+ */
+template <typename FUNC>
+inline dir_error dir_walk_with_stats( const char* root, unsigned int flags, dir_walk_stats* stats, FUNC&& functor)
+{
+   return dir_walk_with_stats(root, flags,
+      [](const dir_walk_item* item) -> int {
+         return (*(typename std::remove_reference<FUNC>::type*)item->userdata)(item);
+      }, &functor, stats);
+}
+
+/**
+ * Call functor once for each item in the directory and, depending on flags, it's sub-directories, from
+ * multiple threads, see dir_walk_parallel() for what calls might run concurrently.
+ * @param root path to walk.
+ * @param flags controlling the walk.
+ * @param num_threads max number of threads to walk with, 0 to use the number of hardware threads.
+ * @param functor to call per item.
+ */
+template <typename FUNC>
+inline dir_error dir_walk_parallel( const char* root, unsigned int flags, unsigned int num_threads, FUNC&& functor)
+{
+   return dir_walk_parallel(root, flags, num_threads,
+      [](const dir_walk_item* item) -> int {
+         return (*(typename std::remove_reference<FUNC>::type*)item->userdata)(item);
+      }, &functor);
+}
+
+/**
+ * Call functor once for each item in the directory and, depending on flags, it's sub-directories, with many
+ * operations in flight, see dir_walk_async() for what calls might run concurrently.
+ * @param root path to walk.
+ * @param flags controlling the walk.
+ * @param queue_depth max number of operations in flight, 0 for the default.
+ * @param functor to call per item.
+ */
+template <typename FUNC>
+inline dir_error dir_walk_async( const char* root, unsigned int flags, unsigned int queue_depth, FUNC&& functor)
+{
+   return dir_walk_async(root, flags, queue_depth,
+      [](const dir_walk_item* item) -> int {
+         return (*(typename std::remove_reference<FUNC>::type*)item->userdata)(item);
+      }, &functor);
+}
+
+/**
+ * Call functor once for each item below root matching a glob-pattern, see dir_walk_glob().
+ * @param root path to walk.
+ * @param glob_pattern pattern to match vs dir_walk_item::relative.
+ * @param flags controlling the walk.
+ * @param functor to call per matching item.
+ */
+template <typename FUNC>
+inline dir_error dir_walk_glob( const char* root, const char* glob_pattern, unsigned int flags, FUNC&& functor)
+{
+   return dir_walk_glob(root, glob_pattern, flags,
+      [](const dir_walk_item* item) -> int {
+         return (*(typename std::remove_reference<FUNC>::type*)item->userdata)(item);
+      }, &functor);
+}
+
+/**
+ * Call functor once for each item in tree matching a glob-pattern, see dir_tree_walk_glob().
+ * @param tree to walk.
+ * @param glob_pattern pattern to match vs dir_walk_item::relative.
+ * @param flags controlling the walk.
+ * @param functor to call per matching item.
+ */
+template <typename FUNC>
+inline dir_error dir_tree_walk_glob( const dir_tree* tree, const char* glob_pattern, unsigned int flags, FUNC&& functor)
+{
+   return dir_tree_walk_glob(tree, glob_pattern, flags,
+      [](const dir_walk_item* item) -> int {
+         return (*(typename std::remove_reference<FUNC>::type*)item->userdata)(item);
+      }, &functor);
+}
+
+/**
+ * Call functor once for each item in root that has changed since snapshot_path was written.
+ * @param root path to check.
+ * @param snapshot_path path to snapshot written by dir_snapshot_write().
+ * @param functor to call per changed item as functor( dir_change_type, const dir_walk_item* ).
+ */
+template <typename FUNC>
+inline dir_error dir_walk_changes( const char* root, const char* snapshot_path, FUNC&& functor)
+{
+   return dir_walk_changes(root, snapshot_path,
+      [](dir_change_type change, const dir_walk_item* item) -> int {
+         return (*(typename std::remove_reference<FUNC>::type*)item->userdata)(change, item);
+      }, &functor);
+}
+
+/**
+ * Call functor once for each item in root that has changed compared to tree, see dir_tree_changes().
+ * @param tree to compare with.
+ * @param root path to check.
+ * @param functor to call per changed item as functor( dir_change_type, const dir_walk_item* ).
+ */
+template <typename FUNC>
+inline dir_error dir_tree_changes( const dir_tree* tree, const char* root, FUNC&& functor)
+{
+   return dir_tree_changes(tree, root,
+      [](dir_change_type change, const dir_walk_item* item) -> int {
+         return (*(typename std::remove_reference<FUNC>::type*)item->userdata)(change, item);
+      }, &functor);
+}
+
+/**
+ * Wait for changes and call functor with them, see dir_watch_poll().
+ * @param watch to poll.
+ * @param timeout_ms max time to wait for the first change.
+ * @param settle_ms time without changes before the batch is reported.
+ * @param functor to call per batch as functor( const dir_watch_event*, size_t ).
+ */
+template <typename FUNC>
+inline dir_error dir_watch_poll( dir_watch* watch, int timeout_ms, unsigned int settle_ms, FUNC&& functor)
+{
+   return dir_watch_poll(watch, timeout_ms, settle_ms,
+      [](const dir_watch_event* events, size_t num_events, void* userdata) {
+         (*(typename std::remove_reference<FUNC>::type*)userdata)(events, num_events);
+      }, &functor);
+}
+
+/**
+ * Range over the items of a walk with dir_iter_open(), for range-based for-loops.
+ *
+ *   for( const dir_walk_item& item : dir_walk_range( "some/dir", DIR_WALK_NO_FLAGS ) )
+ *      ...
+ *
+ * Breaking out of the loop stops the walk. If root could not be opened the range is empty and error()
+ * tells why, errors while iterating are also returned by error().
+ */
+class dir_walk_range
+{
+public:
+   struct iterator
+   {
+      dir_iter*            iter;
+      const dir_walk_item* item;
+
+      const dir_walk_item& operator*() const { return *item; }
+      const dir_walk_item* operator->() const { return item; }
+      iterator& operator++() { item = dir_iter_next( iter ); return *this; }
+      bool operator==( const iterator& other ) const { return item == other.item; }
+      bool operator!=( const iterator& other ) const { return item != other.item; }
+   };
+
+   dir_walk_range( const char* root, unsigned int flags )
+      : iter( 0x0 )
+   {
+      open_error = dir_iter_open( root, flags, &iter );
+   }
+
+   dir_walk_range( dir_walk_range&& other )
+      : iter( other.iter )
+      , open_error( other.open_error )
+   {
+      other.iter = 0x0;
+   }
+
+   ~dir_walk_range()
+   {
+      if( iter != 0x0 )
+         dir_iter_close( iter );
+   }
+
+   iterator begin() { iterator it = { iter, iter != 0x0 ? dir_iter_next( iter ) : 0x0 }; return it; }
+   iterator end()   { iterator it = { iter, 0x0 }; return it; }
+
+   dir_error error() const { return iter != 0x0 ? dir_iter_error( iter ) : open_error; }
+
+private:
+   dir_walk_range( const dir_walk_range& );
+   dir_walk_range& operator=( const dir_walk_range& );
+
+   dir_iter* iter;
+   dir_error open_error;
+};
+
 #endif
 
 #endif // FILE_DIR_H_INCLUDED
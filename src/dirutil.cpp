@@ -26,437 +26,6988 @@
 
 #include <dirutil/dirutil.h>
 
+#include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
 #include <sys/stat.h>
 
+#include <new>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
 #if defined( _WIN32 )
 	#include <direct.h>
 	#include <windows.h>
 #else
 	#include <errno.h>
+	#include <limits.h>
 	#include <unistd.h>
 	#include <dirent.h>
+	#include <fcntl.h>
+	#include <signal.h>
+	#include <sys/mman.h>
+	#if defined( __linux__ )
+		#include <sys/sysmacros.h>
+		#include <sys/ioctl.h>
+		#include <sys/sendfile.h>
+		#include <sys/syscall.h>
+		#include <linux/fs.h>
+		#include <sys/inotify.h>
+		#include <poll.h>
+		#include <time.h>
+		#if defined( SYS_copy_file_range ) && !defined( DIRUTIL_NO_COPY_FILE_RANGE )
+			// copy files with copy_file_range(), called via syscall() as it is missing in older libc.
+			#define DIRUTIL_COPY_FILE_RANGE 1
+		#endif
+	#endif
 #endif
 
-#if defined( _WIN32 )
-static const char* dir_walk_item_name( WIN32_FIND_DATA* ent )
+#if defined( __linux__ ) && !defined( DIRUTIL_NO_GETDENTS64 )
+	// read directories with getdents64 directly instead of via readdir(), define DIRUTIL_NO_GETDENTS64 to
+	// always use readdir().
+	#define DIRUTIL_GETDENTS64 1
+	#include <stddef.h>
+	#include <stdint.h>
+	#include <sys/syscall.h>
+#endif
+
+#if defined( __linux__ ) && !defined( DIRUTIL_NO_IO_URING ) && defined( STATX_BASIC_STATS ) && defined( __NR_io_uring_setup ) && defined( __has_include )
+	#if __has_include( <linux/io_uring.h> )
+		#include <linux/io_uring.h>
+		#if defined( IO_URING_OP_SUPPORTED )
+			// keep many openat()/statx() in flight with io_uring in dir_walk_async(), define DIRUTIL_NO_IO_URING to
+			// always use the threaded fallback.
+			#define DIRUTIL_IO_URING 1
+		#endif
+	#endif
+#endif
+
+#if !defined( DIRUTIL_NO_SIMD ) && ( defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 ) )
+	// scan paths 16 bytes at a time while matching globs, define DIRUTIL_NO_SIMD to always scan byte by byte.
+	#define DIRUTIL_SSE2 1
+	#include <emmintrin.h>
+	#if defined( _MSC_VER )
+		#include <intrin.h>
+	#endif
+	#if defined( __GNUC__ ) && defined( __x86_64__ )
+		// ... and 32 bytes at a time if the cpu support avx2, selected at runtime.
+		#define DIRUTIL_AVX2 1
+		#include <immintrin.h>
+	#endif
+#endif
+
+#if !defined( DIRUTIL_NO_STATS )
+	// count and time the phases of dir_walk_with_stats(), define DIRUTIL_NO_STATS to compile out all of it.
+	#define DIRUTIL_STATS 1
+	#include <chrono>
+#endif
+
+#if !defined( DIRUTIL_MAX_PATH_LENGTH )
+	// longest path, including the terminating '\0', that dir_walk(), dir_iter, dir_walk_glob() and dir_mktree() will
+	// build before failing with DIR_ERROR_PATH_TO_DEEP. Their path-buffers start on the stack and grow up to this.
+	#define DIRUTIL_MAX_PATH_LENGTH ( 64 * 1024 )
+#endif
+
+#if defined( DIRUTIL_GETDENTS64 )
+	#if !defined( DIRUTIL_GETDENTS64_BUFFER_SIZE )
+		// size of the buffer that getdents64 read entries into, one buffer is kept per open directory.
+		#define DIRUTIL_GETDENTS64_BUFFER_SIZE ( 64 * 1024 )
+	#endif
+
+struct dir_linux_dirent64
 {
-	return ent->cFileName;
-}
+	uint64_t       d_ino;
+	int64_t        d_off;
+	unsigned short d_reclen;
+	unsigned char  d_type;
+	char           d_name[1];
+};
+#endif
 
-static bool dir_walk_item_is_dir( const char* /*path*/, WIN32_FIND_DATA* ent )
+enum dir_entry_type
 {
-	return ent->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY;
-}
-#else
-static const char* dir_walk_item_name( struct dirent* ent )
+	DIR_ENTRY_FILE,
+	DIR_ENTRY_DIR,
+	DIR_ENTRY_UNKNOWN
+};
+
+/**
+ * One entry read from a directory, valid until the next call to dir_reader_next() or dir_reader_close()
+ */
+struct dir_reader_entry
 {
-	return ent->d_name;
-}
+	const char*    name;
+	dir_entry_type type;
+};
+
+/**
+ * Platform specific reading of the entries in one directory.
+ */
+struct dir_reader
+{
+#if defined( _WIN32 )
+	HANDLE          ffh;
+	WIN32_FIND_DATA ffd;
+	bool            has_entry;
+#else
+	DIR*   dir;
+	int    fd;
+	#if defined( DIRUTIL_GETDENTS64 )
+	char*  buffer;
+	size_t buffer_size;
+	size_t pos;
+	size_t end;
+	#endif
+#endif
+};
 
-static bool dir_walk_item_is_dir( const char* path, struct dirent* ent )
+#if !defined( _WIN32 )
+/**
+ * Open the dir at path by full path. Paths longer than the OS can resolve in one call are opened one part at a
+ * time, relative to the previous part.
+ * @return fd of the dir or -1 on error.
+ */
+static int dir_open_dir_path( const char* path, size_t path_len )
 {
-	switch(ent->d_type)
+	int fd = open( path, O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+	if( fd >= 0 || errno != ENAMETOOLONG )
+		return fd;
+
+	char   part[PATH_MAX];
+	int    dir_fd = AT_FDCWD;
+	size_t start  = 0;
+	while( start < path_len )
 	{
-		case DT_DIR:
-			return true;
-		case DT_UNKNOWN:
+		size_t end = path_len;
+		if( end - start >= sizeof( part ) )
 		{
-			struct stat s;
-			if( stat( path, &s ) != 0 )
-				return false;
-			return S_ISDIR( s.st_mode );
+			end = start + sizeof( part ) - 1;
+			while( end > start && path[end] != '/' )
+				--end;
 		}
-		default:
-			return false;
+
+		fd = -1;
+		if( end > start )
+		{
+			memcpy( part, path + start, end - start );
+			part[end - start] = '\0';
+			fd = openat( dir_fd, part, O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+		}
+		if( dir_fd != AT_FDCWD )
+			close( dir_fd );
+		if( fd < 0 )
+			return -1;
+		dir_fd = fd;
+		start  = end + 1;
+	}
+	return fd;
+}
+
+/**
+ * Start reading a directory already opened as fd, fd is owned by the reader and closed by dir_reader_close().
+ */
+static bool dir_reader_open_fd( dir_reader* reader, int fd, char* read_buffer, size_t read_buffer_size )
+{
+	reader->fd = fd;
+	#if defined( DIRUTIL_GETDENTS64 )
+	if( read_buffer != 0x0 )
+	{
+		reader->dir         = 0x0;
+		reader->buffer      = read_buffer;
+		reader->buffer_size = read_buffer_size;
+		reader->pos         = 0;
+		reader->end         = 0;
+		return true;
 	}
+	#else
+	(void)read_buffer; (void)read_buffer_size;
+	#endif
+	reader->dir = fdopendir( reader->fd );
+	if( reader->dir == 0x0 )
+	{
+		close( reader->fd );
+		return false;
+	}
+	return true;
 }
 #endif
 
-static dir_error dir_walk_impl( size_t            root_len,
-								char*             path_buffer,
-								size_t            path_len,
-								size_t            path_buffer_size,
-							#if defined( _WIN32 )
-								WIN32_FIND_DATA*  ent,
-							#endif
-								unsigned int      flags,
-								dir_walk_callback callback,
-								void*             userdata )
+/**
+ * Open a directory for reading.
+ * @param parent reader of the parent directory, if set the directory is opened relative to it by name so that
+ *               the OS do not need to resolve the full path again. 0x0 to open by full path.
+ * @param path_buffer zero terminated full path to open, windows need 2 extra chars in the buffer after path_len.
+ * @param name_offset offset in path_buffer of the name of the directory in its parent.
+ * @param read_buffer buffer to read entries into if the platform support it, readdir() is used if 0x0.
+ */
+static bool dir_reader_open( dir_reader*       reader,
+							 const dir_reader* parent,
+							 char*             path_buffer,
+							 size_t            path_len,
+							 size_t            name_offset,
+							 char*             read_buffer,
+							 size_t            read_buffer_size )
 {
 #if defined( _WIN32 )
-	if( path_buffer_size < 3 )
-		return DIR_ERROR_PATH_TO_DEEP;
-
+	(void)parent; (void)name_offset; (void)read_buffer; (void)read_buffer_size;
 	path_buffer[path_len]   = '/';
 	path_buffer[path_len+1] = '*';
 	path_buffer[path_len+2] = '\0';
-
-	HANDLE ffh = FindFirstFile( path_buffer, ent );
-	if( ffh == INVALID_HANDLE_VALUE )
-		return DIR_ERROR_PATH_DO_NOT_EXIST;
-
-	do
-	{
+	reader->ffh = FindFirstFile( path_buffer, &reader->ffd );
+	path_buffer[path_len] = '\0';
+	reader->has_entry = true;
+	return reader->ffh != INVALID_HANDLE_VALUE;
 #else
-	DIR* dir = opendir( path_buffer );
-	if( dir == 0x0 )
-		return DIR_ERROR_PATH_DO_NOT_EXIST;
+	int fd;
+	if( parent != 0x0 )
+		fd = openat( parent->fd, path_buffer + name_offset, O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+	else
+		fd = dir_open_dir_path( path_buffer, path_len );
+	if( fd < 0 )
+		return false;
+	return dir_reader_open_fd( reader, fd, read_buffer, read_buffer_size );
+#endif
+}
 
-	struct dirent* ent;
-	while( ( ent = readdir( dir ) ) != 0x0 )
+static void dir_reader_close( dir_reader* reader )
+{
+#if defined( _WIN32 )
+	FindClose( reader->ffh );
+#else
+	#if defined( DIRUTIL_GETDENTS64 )
+	if( reader->dir == 0x0 )
 	{
+		close( reader->fd );
+		return;
+	}
+	#endif
+	closedir( reader->dir );
 #endif
-		const char* item_name = dir_walk_item_name(ent);
+}
 
-		if( strcmp( item_name, "." ) == 0 || strcmp( item_name, ".." ) == 0 )
-			continue;
+static bool dir_reader_is_dot_or_dotdot( const char* name )
+{
+	return name[0] == '.' && ( name[1] == '\0' || ( name[1] == '.' && name[2] == '\0' ) );
+}
 
-		size_t item_len = strlen( item_name );
-		if( path_buffer_size < item_len + 1 )
-			return DIR_ERROR_PATH_TO_DEEP;
+#if !defined( _WIN32 )
+static dir_entry_type dir_reader_entry_type( unsigned char d_type )
+{
+	switch( d_type )
+	{
+		case DT_DIR:     return DIR_ENTRY_DIR;
+		case DT_UNKNOWN: return DIR_ENTRY_UNKNOWN;
+		default:         return DIR_ENTRY_FILE;
+	}
+}
+#endif
+
+/**
+ * Read the next entry, "." and ".." is skipped.
+ * @return false when there are no more entries.
+ */
+static bool dir_reader_next( dir_reader* reader, dir_reader_entry* entry )
+{
+#if defined( _WIN32 )
+	while( true )
+	{
+		if( !reader->has_entry && FindNextFile( reader->ffh, &reader->ffd ) == 0 )
+			return false;
+		reader->has_entry = false;
 
-		dir_item_type item_type = dir_walk_item_is_dir(path_buffer, ent) ? DIR_ITEM_DIR : DIR_ITEM_FILE;
+		if( dir_reader_is_dot_or_dotdot( reader->ffd.cFileName ) )
+			continue;
 
-		if(item_name[0] == '.')
+		entry->name = reader->ffd.cFileName;
+		entry->type = ( reader->ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY ) ? DIR_ENTRY_DIR : DIR_ENTRY_FILE;
+		return true;
+	}
+#else
+	#if defined( DIRUTIL_GETDENTS64 )
+	while( reader->dir == 0x0 )
+	{
+		if( reader->pos >= reader->end )
 		{
-			if(item_type == DIR_ITEM_DIR  && (flags & DIR_WALK_IGNORE_DOT_DIRS) > 0)
-				continue;
-			if(item_type == DIR_ITEM_FILE && (flags & DIR_WALK_IGNORE_DOT_FILES) > 0)
-				continue;
+			long res = syscall( SYS_getdents64, reader->fd, reader->buffer, reader->buffer_size );
+			if( res < 0 && errno == ENOSYS )
+			{
+				// getdents64 not available ( sandboxed? ), fallback to readdir() on the same fd.
+				reader->dir = fdopendir( reader->fd );
+				if( reader->dir == 0x0 )
+				{
+					close( reader->fd );
+					reader->fd = -1;
+					return false;
+				}
+				break;
+			}
+			if( res <= 0 )
+				return false;
+			reader->pos = 0;
+			reader->end = (size_t)res;
 		}
 
-		// TODO: check for overflow!
-		path_buffer[path_len] = '/';
-		strcpy( &path_buffer[path_len + 1], item_name );
-
-		dir_walk_item item;
-		item.path     = path_buffer;
-		item.relative = path_buffer + root_len + 1;
-		item.name     = item_name;
-		item.type     = item_type;
-		item.userdata = userdata;
+		dir_linux_dirent64* ent = (dir_linux_dirent64*)( reader->buffer + reader->pos );
+		reader->pos += ent->d_reclen;
 
-		if( item.type == DIR_ITEM_DIR )
-		{
-			bool depth_first = (flags & DIR_WALK_DEPTH_FIRST) > 0;
+		const char* name = reader->buffer + ( reader->pos - ent->d_reclen ) + offsetof( dir_linux_dirent64, d_name );
+		if( dir_reader_is_dot_or_dotdot( name ) )
+			continue;
 
-			if( !depth_first )
-				callback( &item );
-
-			dir_walk_impl( root_len,
-						   path_buffer,
-						   path_len + item_len + 1,
-						   path_buffer_size - item_len - 1, 
-						#if defined( _WIN32 )
-						   ent,
-						#endif
-						   flags,
-						   callback,
-						   userdata );
-
-			if( depth_first )
-				callback( &item );
-		}
-		else
-			callback( &item );
-#if defined( _WIN32 )
+		entry->name = name;
+		entry->type = dir_reader_entry_type( ent->d_type );
+		return true;
 	}
-	while( FindNextFile( ffh, ent ) != 0 );
-	FindClose( ffh );
-#else
+	#endif
+
+	struct dirent* ent;
+	while( ( ent = readdir( reader->dir ) ) != 0x0 )
+	{
+		if( dir_reader_is_dot_or_dotdot( ent->d_name ) )
+			continue;
+
+		entry->name = ent->d_name;
+		entry->type = dir_reader_entry_type( ent->d_type );
+		return true;
 	}
-	closedir( dir );
+	return false;
 #endif
-	path_buffer[path_len] = '\0';
-	return DIR_ERROR_OK;
 }
 
-dir_error dir_walk( const char* path, unsigned int flags, dir_walk_callback callback, void* userdata )
+/**
+ * Get item type of entry, resolving it relative to the open directory if the platform did not report a type.
+ */
+static dir_item_type dir_reader_entry_item_type( const dir_reader* reader, const dir_reader_entry* entry )
 {
-	char path_buffer[4096];
-	strncpy( path_buffer, path, sizeof( path_buffer ) );
-	size_t path_len = strlen( path_buffer );
-
-	// normalize input path to only strip of trailing / if there is one.
-	if(path_buffer[path_len-1] == '/')
+	switch( entry->type )
 	{
-		--path_len;
-		path_buffer[path_len] = '\0';
+		case DIR_ENTRY_DIR:
+			return DIR_ITEM_DIR;
+		case DIR_ENTRY_UNKNOWN:
+		{
+		#if defined( _WIN32 )
+			(void)reader;
+			return DIR_ITEM_FILE;
+		#elif defined( STATX_TYPE )
+			struct statx s;
+			if( statx( reader->fd, entry->name, 0, STATX_TYPE, &s ) != 0 )
+				return DIR_ITEM_FILE;
+			return S_ISDIR( s.stx_mode ) ? DIR_ITEM_DIR : DIR_ITEM_FILE;
+		#else
+			struct stat s;
+			if( fstatat( reader->fd, entry->name, &s, 0 ) != 0 )
+				return DIR_ITEM_FILE;
+			return S_ISDIR( s.st_mode ) ? DIR_ITEM_DIR : DIR_ITEM_FILE;
+		#endif
+		}
+		default:
+			return DIR_ITEM_FILE;
 	}
+}
 
 #if defined( _WIN32 )
-	WIN32_FIND_DATA ffd;
+static uint64_t dir_filetime_to_unix_ns( FILETIME ft )
+{
+	// FILETIME is in 100ns intervals since 1601-01-01.
+	uint64_t t = ( (uint64_t)ft.dwHighDateTime << 32 ) | (uint64_t)ft.dwLowDateTime;
+	const uint64_t EPOCH_DIFF = 116444736000000000ull;
+	return t < EPOCH_DIFF ? 0 : ( t - EPOCH_DIFF ) * 100;
+}
 #endif
-	return dir_walk_impl( path_len,
-						  path_buffer,
-						  path_len,
-						  sizeof( path_buffer ) - path_len, 
+
 #if defined( _WIN32 )
-						  &ffd,
-#endif
-						  flags,
-						  callback,
-						  userdata );
+static void dir_stat_from_win32( DWORD attributes, FILETIME mtime, DWORD size_high, DWORD size_low, dir_item_stat* stat )
+{
+	stat->size     = ( (uint64_t)size_high << 32 ) | (uint64_t)size_low;
+	stat->mtime_ns = dir_filetime_to_unix_ns( mtime );
+	stat->inode    = 0;
+	stat->device   = 0;
+	if( attributes & FILE_ATTRIBUTE_DIRECTORY )
+		stat->mode = _S_IFDIR | 0755;
+	else
+		stat->mode = _S_IFREG | ( ( attributes & FILE_ATTRIBUTE_READONLY ) ? 0444 : 0644 );
 }
+#elif defined( STATX_BASIC_STATS )
+#define DIR_STATX_MASK ( STATX_TYPE | STATX_MODE | STATX_INO | STATX_SIZE | STATX_MTIME )
 
-dir_error dir_create( const char* path )
+static void dir_stat_from_statx( const struct statx* s, dir_item_stat* stat )
 {
-#if defined( _WIN32 )
-	if( CreateDirectory( path, 0x0 ) )
-		return DIR_ERROR_OK;
-	if( GetLastError() == ERROR_ALREADY_EXISTS )
-		return DIR_ERROR_OK;
+	stat->size     = s->stx_size;
+	stat->mtime_ns = (uint64_t)s->stx_mtime.tv_sec * 1000000000ull + s->stx_mtime.tv_nsec;
+	stat->inode    = s->stx_ino;
+	stat->device   = (uint64_t)makedev( s->stx_dev_major, s->stx_dev_minor );
+	stat->mode     = s->stx_mode;
+}
 #else
-	if( mkdir( path, 0777 ) == 0 )
-		return DIR_ERROR_OK;
-	if( errno == EEXIST )
-		return DIR_ERROR_OK;
+static void dir_stat_from_stat( const struct stat* s, dir_item_stat* stat )
+{
+	stat->size     = (uint64_t)s->st_size;
+	#if defined( __APPLE__ )
+	stat->mtime_ns = (uint64_t)s->st_mtimespec.tv_sec * 1000000000ull + (uint64_t)s->st_mtimespec.tv_nsec;
+	#else
+	stat->mtime_ns = (uint64_t)s->st_mtim.tv_sec * 1000000000ull + (uint64_t)s->st_mtim.tv_nsec;
+	#endif
+	stat->inode    = (uint64_t)s->st_ino;
+	stat->device   = (uint64_t)s->st_dev;
+	stat->mode     = (uint32_t)s->st_mode;
+}
 #endif
-	return DIR_ERROR_FAILED;
+
+static bool dir_stat_is_dir( const dir_item_stat* stat )
+{
+	// S_IFMT and S_IFDIR, same values on all supported platforms.
+	return ( stat->mode & 0170000 ) == 0040000;
 }
 
-static bool dir_walk_rmfile( const char* path )
+/**
+ * Fetch metadata for entry.
+ * @return false if the metadata could not be fetched.
+ */
+static bool dir_reader_entry_stat( const dir_reader* reader, const dir_reader_entry* entry, dir_item_stat* stat )
 {
 #if defined( _WIN32 )
-	return DeleteFile( path );
+	(void)entry;
+	const WIN32_FIND_DATA* ffd = &reader->ffd;
+	dir_stat_from_win32( ffd->dwFileAttributes, ffd->ftLastWriteTime, ffd->nFileSizeHigh, ffd->nFileSizeLow, stat );
+	return true;
+#elif defined( STATX_BASIC_STATS )
+	struct statx s;
+	if( statx( reader->fd, entry->name, 0, DIR_STATX_MASK, &s ) != 0 )
+		return false;
+	dir_stat_from_statx( &s, stat );
+	return true;
 #else
-	return unlink( path ) == 0;
+	struct stat s;
+	if( fstatat( reader->fd, entry->name, &s, 0 ) != 0 )
+		return false;
+	dir_stat_from_stat( &s, stat );
+	return true;
 #endif
 }
 
-static int dir_walk_rmitem( const dir_walk_item* item )
+/**
+ * Fetch metadata for item at path.
+ * @return false if the metadata could not be fetched.
+ */
+static bool dir_stat_path( const char* path, dir_item_stat* stat )
 {
-	dir_error* err = (dir_error*)item->userdata;
-	switch( item->type )
-	{
-		case DIR_ITEM_FILE:
-			if(!dir_walk_rmfile(item->path))
-				*err = DIR_ERROR_FAILED;
-			break;
-		case DIR_ITEM_DIR:
-			if( rmdir( item->path ) != 0 )
-				*err = DIR_ERROR_FAILED;
-			break;
-		default:
-			break;
-	}
-	return *err == DIR_ERROR_OK ? 0 : 1;
+#if defined( _WIN32 )
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if( !GetFileAttributesEx( path, GetFileExInfoStandard, &data ) )
+		return false;
+	dir_stat_from_win32( data.dwFileAttributes, data.ftLastWriteTime, data.nFileSizeHigh, data.nFileSizeLow, stat );
+	return true;
+#elif defined( STATX_BASIC_STATS )
+	struct statx s;
+	if( statx( AT_FDCWD, path, 0, DIR_STATX_MASK, &s ) != 0 )
+		return false;
+	dir_stat_from_statx( &s, stat );
+	return true;
+#else
+	struct stat s;
+	if( ::stat( path, &s ) != 0 )
+		return false;
+	dir_stat_from_stat( &s, stat );
+	return true;
+#endif
 }
 
-dir_error dir_rmtree( const char* path )
+/**
+ * Fetch type and metadata for item at path the same way as dir_walk_resolve_entry() does for an entry, a symlink
+ * is a file but has the metadata of its target.
+ * @param stat storage for metadata, *out_stat is set to it if metadata was fetched, otherwise 0x0.
+ * @return false if there is no item at path.
+ */
+static bool dir_stat_path_as_entry( const char* path, dir_item_type* type, dir_item_stat* stat, const dir_item_stat** out_stat )
 {
-	dir_error res = DIR_ERROR_OK;
-	dir_error e = dir_walk( path, DIR_WALK_DEPTH_FIRST, dir_walk_rmitem, &res );
-	if( e != DIR_ERROR_OK )
-		return e;
-	if( res != DIR_ERROR_OK )
-		return res;
-	return rmdir( path ) == 0 ? DIR_ERROR_OK : DIR_ERROR_FAILED;
+#if defined( _WIN32 )
+	if( !dir_stat_path( path, stat ) )
+		return false;
+	*type     = dir_stat_is_dir( stat ) ? DIR_ITEM_DIR : DIR_ITEM_FILE;
+	*out_stat = stat;
+	return true;
+#else
+	bool is_link;
+	#if defined( STATX_BASIC_STATS )
+	struct statx s;
+	if( statx( AT_FDCWD, path, AT_SYMLINK_NOFOLLOW, DIR_STATX_MASK, &s ) != 0 )
+		return false;
+	is_link = S_ISLNK( s.stx_mode );
+	dir_stat_from_statx( &s, stat );
+	#else
+	struct stat s;
+	if( lstat( path, &s ) != 0 )
+		return false;
+	is_link = S_ISLNK( s.st_mode );
+	dir_stat_from_stat( &s, stat );
+	#endif
+
+	*type     = dir_stat_is_dir( stat ) ? DIR_ITEM_DIR : DIR_ITEM_FILE;
+	*out_stat = stat;
+	if( is_link && !dir_stat_path( path, stat ) )
+		*out_stat = 0x0;
+	return true;
+#endif
 }
 
-dir_error dir_mktree( const char* path )
+#if defined( DIRUTIL_STATS )
+/**
+ * Add the time from construction to destruction to *ns, does nothing if ns is 0x0.
+ */
+struct dir_stats_timer
 {
-	char path_buffer[4096];
-	strncpy( path_buffer, path, sizeof( path_buffer ) );
-
-	char* beg = path_buffer;
+	uint64_t*                             ns;
+	std::chrono::steady_clock::time_point start;
 
-	// if path is absolute, we need to start trying to create dirs from the second '/',
-	// otherwise we would try to create the dir ""
-	if( *beg == '/' )
-		++beg;
-
-	while( true )
+	explicit dir_stats_timer( uint64_t* ns_ )
+		: ns( ns_ )
 	{
-		char* sep = strchr( beg, '/' );
-		if( sep == 0 )
-			return dir_create( path_buffer );
+		if( ns != 0x0 )
+			start = std::chrono::steady_clock::now();
+	}
 
-		*sep = '\0';
-		dir_error err = dir_create( path_buffer );
-		if( err != DIR_ERROR_OK )
-			return err;
-		*sep = '/';
-		beg = sep + 1;
+	~dir_stats_timer()
+	{
+		if( ns != 0x0 )
+			*ns += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start ).count();
 	}
-	return DIR_ERROR_FAILED;
+};
+
+	#define DIR_STATS_TIMER( stats, field ) dir_stats_timer dir_stats_timer_##field( ( stats ) != 0x0 ? &( stats )->field : 0x0 )
+	#define DIR_STATS_ADD( stats, field, n ) do { if( ( stats ) != 0x0 ) ( stats )->field += ( n ); } while( 0 )
+	#define DIR_STATS_MAX( stats, field, n ) do { if( ( stats ) != 0x0 && ( stats )->field < ( n ) ) ( stats )->field = ( n ); } while( 0 )
+#else
+	#define DIR_STATS_TIMER( stats, field )  (void)( stats )
+	#define DIR_STATS_ADD( stats, field, n ) (void)( stats )
+	#define DIR_STATS_MAX( stats, field, n ) (void)( stats )
+#endif
+
+/**
+ * Check if a dot-item of type should be skipped due to DIR_WALK_IGNORE_DOT_* in flags.
+ */
+static bool dir_walk_skip_dot( dir_item_type type, unsigned int flags )
+{
+	return ( type == DIR_ITEM_DIR  && ( flags & DIR_WALK_IGNORE_DOT_DIRS ) > 0 ) ||
+		   ( type == DIR_ITEM_FILE && ( flags & DIR_WALK_IGNORE_DOT_FILES ) > 0 );
 }
 
-static int dir_glob_match_range( const char* range_start, const char* range_end, char match_char )
+/**
+ * Resolve type, and metadata if requested by flags, for entry and check if it should be reported.
+ * @param stat storage for metadata, *out_stat is set to it if metadata was fetched, otherwise 0x0.
+ * @param stats to count syscalls and skipped items in, or 0x0.
+ * @return false if the entry should be skipped due to flags.
+ */
+static bool dir_walk_resolve_entry( const dir_reader*       reader,
+									const dir_reader_entry* entry,
+									unsigned int            flags,
+									dir_item_type*          type,
+									dir_item_stat*          stat,
+									const dir_item_stat**   out_stat,
+									dir_walk_stats*         stats )
 {
-	int match_return = 1;
-	if( *range_start == '!' )
+	bool is_dot = entry->name[0] == '.';
+	if( is_dot && ( flags & DIR_WALK_IGNORE_DOT_ITEMS ) == DIR_WALK_IGNORE_DOT_ITEMS )
 	{
-		match_return = 0;
-		++range_start;
+		DIR_STATS_ADD( stats, dot_items_skipped, 1 );
+		return false;
 	}
 
-	while( range_start != range_end + 1 )
+	*out_stat = 0x0;
+	bool has_stat = false;
+	if( ( flags & DIR_WALK_WITH_STAT ) > 0 )
 	{
-		if( range_start[1] == '-' )
-		{
-			if( range_start[0] <= match_char && match_char <= range_start[2] )
-				return match_return;
-			range_start += 3;
-		}
+		DIR_STATS_TIMER( stats, stat_ns );
+		DIR_STATS_ADD( stats, stats_fetched, 1 );
+		has_stat = dir_reader_entry_stat( reader, entry, stat );
+	}
+
+	if( has_stat )
+	{
+		*out_stat = stat;
+		if( entry->type == DIR_ENTRY_UNKNOWN )
+			*type = dir_stat_is_dir( stat ) ? DIR_ITEM_DIR : DIR_ITEM_FILE;
 		else
-		{
-			if( *range_start == match_char )
-				return match_return;
-			++range_start;
-		}
+			*type = entry->type == DIR_ENTRY_DIR ? DIR_ITEM_DIR : DIR_ITEM_FILE;
+	}
+	else if( entry->type == DIR_ENTRY_UNKNOWN )
+	{
+		DIR_STATS_TIMER( stats, stat_ns );
+		DIR_STATS_ADD( stats, stat_fallbacks, 1 );
+		*type = dir_reader_entry_item_type( reader, entry );
 	}
+	else
+		*type = dir_reader_entry_item_type( reader, entry );
 
-	return !match_return;
+	if( is_dot && dir_walk_skip_dot( *type, flags ) )
+	{
+		DIR_STATS_ADD( stats, dot_items_skipped, 1 );
+		return false;
+	}
+	return true;
 }
 
-static int dir_glob_match_groups( const char* group_start, const char* group_end, const char* match_this )
+/**
+ * Allocate a buffer to read entries into for readers, returns 0x0 if the platform does not need one.
+ */
+static char* dir_reader_alloc_buffer()
 {
-	// ... comma separated ...
-	const char* item_start = group_start;
-	while( item_start < group_end )
-	{
-		const char* item_end = item_start;
-		while( *item_end != ',' && item_end != group_end + 1 )
-			++item_end;
+#if defined( DIRUTIL_GETDENTS64 )
+	return (char*)malloc( DIRUTIL_GETDENTS64_BUFFER_SIZE );
+#else
+	return 0x0;
+#endif
+}
 
-		size_t item_len = (size_t)(item_end - item_start);
-		if( strncmp( match_this, item_start, item_len ) == 0 )
-			return (int)item_len;
+static size_t dir_reader_buffer_size()
+{
+#if defined( DIRUTIL_GETDENTS64 )
+	return DIRUTIL_GETDENTS64_BUFFER_SIZE;
+#else
+	return 0;
+#endif
+}
 
-		item_start = item_end + 1;
+/**
+ * Grow array at *ptr, with room for *capacity items, to have room for at least needed items.
+ */
+template <typename T>
+static bool dir_array_grow( T** ptr, size_t* capacity, size_t needed )
+{
+	if( needed <= *capacity )
+		return true;
+
+	size_t new_capacity = *capacity == 0 ? 64 : *capacity;
+	while( new_capacity < needed )
+		new_capacity *= 2;
+
+	void* new_ptr = realloc( (void*)*ptr, new_capacity * sizeof( T ) );
+	if( new_ptr == 0x0 )
+		return false;
+	*ptr      = (T*)new_ptr;
+	*capacity = new_capacity;
+	return true;
+}
+
+static uint64_t dir_hash_fnv1a( const char* str, size_t len )
+{
+	uint64_t h = 0xcbf29ce484222325ull;
+	for( size_t i = 0; i < len; ++i )
+	{
+		h ^= (uint8_t)str[i];
+		h *= 0x100000001b3ull;
 	}
-	return -1;
+	return h;
 }
 
-#include <stdio.h>
+#if defined( DIRUTIL_IO_URING )
+/**
+ * Minimal io_uring, setup with raw syscalls to not depend on liburing.
+ */
+struct dir_uring
+{
+	int           fd;
+	unsigned*     sq_head;
+	unsigned*     sq_tail;
+	unsigned*     sq_mask;
+	unsigned*     sq_array;
+	unsigned*     cq_head;
+	unsigned*     cq_tail;
+	unsigned*     cq_mask;
+	io_uring_sqe* sqes;
+	io_uring_cqe* cqes;
+	void*         sq_ring;
+	size_t        sq_ring_size;
+	void*         cq_ring;
+	size_t        cq_ring_size;
+	size_t        sqes_size;
+};
+
+static bool dir_uring_supports( int fd, int op )
+{
+	const size_t num_ops = 256;
+	io_uring_probe* probe = (io_uring_probe*)calloc( 1, sizeof( io_uring_probe ) + num_ops * sizeof( io_uring_probe_op ) );
+	if( probe == 0x0 )
+		return false;
+	bool supported = syscall( __NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, num_ops ) == 0 &&
+					 op <= probe->last_op &&
+					 ( probe->ops[op].flags & IO_URING_OP_SUPPORTED ) > 0;
+	free( probe );
+	return supported;
+}
 
-static dir_glob_result dir_glob_match( const char* glob_pattern, const char* glob_end, const char* path )
+/**
+ * @return false if io_uring, or the ops used by the walk, is not available, i.e. older kernel or blocked by seccomp.
+ */
+static bool dir_uring_init( dir_uring* ring, unsigned int entries )
 {
-	const char* unverified = path;
+	io_uring_params params;
+	memset( &params, 0x0, sizeof( params ) );
+	long fd = syscall( __NR_io_uring_setup, entries, &params );
+	if( fd < 0 )
+		return false;
+	ring->fd = (int)fd;
 
-	while( glob_pattern != glob_end )
+	if( !dir_uring_supports( ring->fd, IORING_OP_OPENAT ) || !dir_uring_supports( ring->fd, IORING_OP_STATX ) )
 	{
-		switch( *glob_pattern )
-		{
-			case '\0':
-				return DIR_GLOB_NO_MATCH;
-			case '*':
-			{
-				switch( glob_pattern[1] )
-				{
-					case '\0':
-					{
-						// try to find a path-separator in unverified since a pattern without a path-separator should only match files.
-						if( strchr( unverified, '/' ) )
-							return DIR_GLOB_NO_MATCH; // should match dirs...
-						return DIR_GLOB_MATCH;
-					}
+		close( ring->fd );
+		return false;
+	}
 
-					case '*':
-					{
-						if( glob_pattern[2] != '/' )
-							return DIR_GLOB_INVALID_PATTERN; // invalid?
+	ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof( unsigned );
+	ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof( io_uring_cqe );
+	if( params.features & IORING_FEAT_SINGLE_MMAP )
+		ring->sq_ring_size = ring->cq_ring_size = std::max( ring->sq_ring_size, ring->cq_ring_size );
+	ring->sqes_size = params.sq_entries * sizeof( io_uring_sqe );
 
-						for( const char* sub_search = unverified - 1;
-							 sub_search;
-							 sub_search = strchr( sub_search + 1, '/' ) )
-						{
-							++sub_search;
-							dir_glob_result res = dir_glob_match( glob_pattern + 3, glob_end, sub_search );
-							if( res != DIR_GLOB_NO_MATCH )
-								return res;
-						}
-						return DIR_GLOB_NO_MATCH;
-					}
+	ring->sq_ring = mmap( 0x0, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING );
+	ring->cq_ring = ring->sq_ring;
+	if( ring->sq_ring != MAP_FAILED && ( params.features & IORING_FEAT_SINGLE_MMAP ) == 0 )
+		ring->cq_ring = mmap( 0x0, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING );
+	void* sqes = mmap( 0x0, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES );
+	if( ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED || sqes == MAP_FAILED )
+	{
+		if( sqes != MAP_FAILED )
+			munmap( sqes, ring->sqes_size );
+		if( ring->cq_ring != MAP_FAILED && ring->cq_ring != ring->sq_ring )
+			munmap( ring->cq_ring, ring->cq_ring_size );
+		if( ring->sq_ring != MAP_FAILED )
+			munmap( ring->sq_ring, ring->sq_ring_size );
+		close( ring->fd );
+		return false;
+	}
 
-					default:
-					{
-						// search in unverified for char
-						const char* next = unverified;
-						while( *next && ( *next != glob_pattern[1] ) && ( *next != '/' ) )
-							++next;
+	char* sq = (char*)ring->sq_ring;
+	char* cq = (char*)ring->cq_ring;
+	ring->sq_head  = (unsigned*)( sq + params.sq_off.head );
+	ring->sq_tail  = (unsigned*)( sq + params.sq_off.tail );
+	ring->sq_mask  = (unsigned*)( sq + params.sq_off.ring_mask );
+	ring->sq_array = (unsigned*)( sq + params.sq_off.array );
+	ring->cq_head  = (unsigned*)( cq + params.cq_off.head );
+	ring->cq_tail  = (unsigned*)( cq + params.cq_off.tail );
+	ring->cq_mask  = (unsigned*)( cq + params.cq_off.ring_mask );
+	ring->cqes     = (io_uring_cqe*)( cq + params.cq_off.cqes );
+	ring->sqes     = (io_uring_sqe*)sqes;
+	return true;
+}
 
-						switch( *next )
-						{
-							case '\0':
-								return DIR_GLOB_NO_MATCH; // failed, could not find char after *
-							case '/':
-								if( glob_pattern[1] == '/' )
-								{
-									unverified = next + 1;
-									glob_pattern += 2;
-								}
-								else
-									return DIR_GLOB_NO_MATCH;
-								break;
-							default:
-								unverified = next;
-								++glob_pattern;
-								break;
-						}
-					}
-					break;
+static void dir_uring_destroy( dir_uring* ring )
+{
+	munmap( ring->sqes, ring->sqes_size );
+	if( ring->cq_ring != ring->sq_ring )
+		munmap( ring->cq_ring, ring->cq_ring_size );
+	munmap( ring->sq_ring, ring->sq_ring_size );
+	close( ring->fd );
+}
 
-				}
-			}
-			break;
-			case '?':
-			{
-				if( *unverified == '/' )
-					return DIR_GLOB_NO_MATCH;
-				++unverified;
-				++glob_pattern;
-			}
-			break;
+/**
+ * Get next free submission entry, cleared, or 0x0 if the submission queue is full.
+ */
+static io_uring_sqe* dir_uring_get_sqe( dir_uring* ring )
+{
+	unsigned tail = *ring->sq_tail;
+	if( tail - __atomic_load_n( ring->sq_head, __ATOMIC_ACQUIRE ) > *ring->sq_mask )
+		return 0x0;
+	unsigned index = tail & *ring->sq_mask;
+	io_uring_sqe* sqe = &ring->sqes[index];
+	memset( sqe, 0x0, sizeof( io_uring_sqe ) );
+	ring->sq_array[index] = index;
+	__atomic_store_n( ring->sq_tail, tail + 1, __ATOMIC_RELEASE );
+	return sqe;
+}
+#endif
 
-			case '[':
-			{
-				const char* range_start = glob_pattern + 1;
-				const char* range_end   = strchr( range_start, ']' );
-				if( range_end == 0x0 )
-					return DIR_GLOB_INVALID_PATTERN; // invalid
+/**
+ * Resolved entry of a dir read in full, see dir_walk_read_all().
+ */
+struct dir_sorted_entry
+{
+	size_t               name_offset;
+	dir_entry_type       entry_type;
+	dir_item_type        type;
+	bool                 has_stat;
+	dir_item_stat        stat;
+};
 
-				if( !dir_glob_match_range( range_start, range_end - 1, *unverified ) )
-					return DIR_GLOB_NO_MATCH;
+/**
+ * All entries of one dir, sorted by name with DIR_WALK_SORTED, with the names stored after each other in names.
+ */
+struct dir_sort_buffer
+{
+	dir_sorted_entry* entries;
+	size_t            num_entries;
+	size_t            entries_capacity;
+	char*             names;
+	size_t            names_size;
+	size_t            names_capacity;
 
-				glob_pattern = range_end + 1;
-				++unverified;
+	// index in entries of all entries that need a syscall to resolve, used while reading.
+	size_t*           unresolved;
+	size_t            num_unresolved;
+	size_t            unresolved_capacity;
+};
+
+struct dir_walk_ctx
+{
+	unsigned int      flags;
+	dir_walk_callback callback;
+	void*             userdata;
+	size_t            root_len;
+	char*             path_buffer;
+	size_t            path_buffer_size;
+
+	// path_buffer when it has outgrown the buffer the walk started with, see dir_walk_path_reserve().
+	char*             path_buffer_heap;
+
+	// one read-buffer per depth in the walk, allocated on first use and reused for all dirs at that depth.
+	char**            read_buffers;
+	size_t            num_read_buffers;
+
+	// one sort-buffer per depth in the walk for dirs read in full, reused the same way as read_buffers.
+	dir_sort_buffer** sort_buffers;
+	size_t            num_sort_buffers;
+
+	// set when the filesystem reported an entry without type. All dirs after that are read in full so that the
+	// syscalls needed to resolve the types can be batched.
+	bool              types_unknown;
+
+#if defined( DIRUTIL_IO_URING )
+	// ring to queue statx() for batches on, created on first use. uring_failed is set if io_uring is not available.
+	dir_uring         uring;
+	bool              has_uring;
+	bool              uring_failed;
+#endif
+
+	// statistics to fill in, or 0x0.
+	dir_walk_stats*   stats;
+};
+
+static char* dir_walk_read_buffer( dir_walk_ctx* ctx, size_t depth )
+{
+	if( dir_reader_buffer_size() == 0 )
+		return 0x0;
+
+	if( depth >= ctx->num_read_buffers )
+	{
+		size_t new_num = depth + 8;
+		char** new_buffers = (char**)realloc( ctx->read_buffers, new_num * sizeof( char* ) );
+		if( new_buffers == 0x0 )
+			return 0x0;
+		for( size_t i = ctx->num_read_buffers; i < new_num; ++i )
+			new_buffers[i] = 0x0;
+		ctx->read_buffers     = new_buffers;
+		ctx->num_read_buffers = new_num;
+	}
+
+	if( ctx->read_buffers[depth] == 0x0 )
+		ctx->read_buffers[depth] = dir_reader_alloc_buffer();
+	return ctx->read_buffers[depth];
+}
+
+static dir_sort_buffer* dir_walk_sort_buffer( dir_walk_ctx* ctx, size_t depth )
+{
+	if( depth >= ctx->num_sort_buffers )
+	{
+		size_t new_num = depth + 8;
+		dir_sort_buffer** new_buffers = (dir_sort_buffer**)realloc( ctx->sort_buffers, new_num * sizeof( dir_sort_buffer* ) );
+		if( new_buffers == 0x0 )
+			return 0x0;
+		for( size_t i = ctx->num_sort_buffers; i < new_num; ++i )
+			new_buffers[i] = 0x0;
+		ctx->sort_buffers     = new_buffers;
+		ctx->num_sort_buffers = new_num;
+	}
+
+	if( ctx->sort_buffers[depth] == 0x0 )
+	{
+		ctx->sort_buffers[depth] = (dir_sort_buffer*)malloc( sizeof( dir_sort_buffer ) );
+		if( ctx->sort_buffers[depth] != 0x0 )
+			memset( ctx->sort_buffers[depth], 0x0, sizeof( dir_sort_buffer ) );
+	}
+	return ctx->sort_buffers[depth];
+}
+
+static void dir_walk_init_buffers( dir_walk_ctx* ctx )
+{
+	ctx->path_buffer_heap = 0x0;
+	ctx->read_buffers     = 0x0;
+	ctx->num_read_buffers = 0;
+	ctx->sort_buffers     = 0x0;
+	ctx->num_sort_buffers = 0;
+	ctx->types_unknown    = false;
+#if defined( DIRUTIL_IO_URING )
+	ctx->has_uring        = false;
+	ctx->uring_failed     = false;
+#endif
+}
+
+static void dir_walk_free_buffers( dir_walk_ctx* ctx )
+{
+	free( ctx->path_buffer_heap );
+	for( size_t i = 0; i < ctx->num_read_buffers; ++i )
+		free( ctx->read_buffers[i] );
+	free( ctx->read_buffers );
+	for( size_t i = 0; i < ctx->num_sort_buffers; ++i )
+	{
+		if( ctx->sort_buffers[i] == 0x0 )
+			continue;
+		free( ctx->sort_buffers[i]->entries );
+		free( ctx->sort_buffers[i]->names );
+		free( ctx->sort_buffers[i]->unresolved );
+		free( ctx->sort_buffers[i] );
+	}
+	free( ctx->sort_buffers );
+#if defined( DIRUTIL_IO_URING )
+	if( ctx->has_uring )
+		dir_uring_destroy( &ctx->uring );
+#endif
+}
+
+/**
+ * Make sure that path_buffer can hold size bytes, growing it if needed. The content is kept but the buffer might
+ * move, so pointers into it has to be refetched after this.
+ * @return false if size is larger than DIRUTIL_MAX_PATH_LENGTH or the buffer could not grow.
+ */
+static bool dir_walk_path_reserve( dir_walk_ctx* ctx, size_t size )
+{
+	if( size <= ctx->path_buffer_size )
+		return true;
+	if( size > DIRUTIL_MAX_PATH_LENGTH )
+		return false;
+
+	size_t new_size = std::min( std::max( ctx->path_buffer_size * 2, size ), (size_t)DIRUTIL_MAX_PATH_LENGTH );
+	char* new_buffer = (char*)malloc( new_size );
+	if( new_buffer == 0x0 )
+		return false;
+	memcpy( new_buffer, ctx->path_buffer, ctx->path_buffer_size );
+	free( ctx->path_buffer_heap );
+	ctx->path_buffer      = new_buffer;
+	ctx->path_buffer_size = new_size;
+	ctx->path_buffer_heap = new_buffer;
+	return true;
+}
+
+/**
+ * Copy root to path_buffer, stripping a trailing '/', and set root_len.
+ * @return false if root is longer than DIRUTIL_MAX_PATH_LENGTH.
+ */
+static bool dir_walk_copy_root( dir_walk_ctx* ctx, const char* root )
+{
+	size_t root_len = strlen( root );
+
+	// normalize input path to only strip of trailing / if there is one.
+	if( root_len > 0 && root[root_len-1] == '/' )
+		--root_len;
+
+	ctx->root_len = root_len;
+	if( !dir_walk_path_reserve( ctx, root_len + 3 ) )
+		return false;
+	memcpy( ctx->path_buffer, root, root_len );
+	ctx->path_buffer[root_len] = '\0';
+	return true;
+}
+
+/**
+ * dir_reader_next() that is counted and timed in stats.
+ */
+static bool dir_walk_reader_next( dir_reader* reader, dir_reader_entry* entry, dir_walk_stats* stats )
+{
+	DIR_STATS_TIMER( stats, read_ns );
+	if( !dir_reader_next( reader, entry ) )
+		return false;
+	DIR_STATS_ADD( stats, entries_read, 1 );
+	return true;
+}
+
+#if !defined( _WIN32 )
+// batches smaller than this are resolved on the calling thread when io_uring is not available.
+static const size_t DIR_WALK_BATCH_PER_THREAD = 32;
+static const size_t DIR_WALK_BATCH_MAX_THREADS = 8;
+
+/**
+ * Resolve entries buf->unresolved[begin, end) with the same fallbacks as dir_walk_resolve_entry().
+ */
+static void dir_walk_resolve_range( const dir_reader* reader, unsigned int flags, dir_sort_buffer* buf, size_t begin, size_t end )
+{
+	for( size_t i = begin; i < end; ++i )
+	{
+		dir_sorted_entry* e = &buf->entries[buf->unresolved[i]];
+		dir_reader_entry ent;
+		ent.name = buf->names + e->name_offset;
+		ent.type = e->entry_type;
+		if( ( flags & DIR_WALK_WITH_STAT ) > 0 )
+			e->has_stat = dir_reader_entry_stat( reader, &ent, &e->stat );
+
+		if( e->entry_type != DIR_ENTRY_UNKNOWN )
+			continue;
+		if( e->has_stat )
+			e->type = dir_stat_is_dir( &e->stat ) ? DIR_ITEM_DIR : DIR_ITEM_FILE;
+		else
+			e->type = dir_reader_entry_item_type( reader, &ent );
+	}
+}
+
+#if defined( DIRUTIL_IO_URING )
+static const unsigned int DIR_WALK_BATCH_QUEUE_DEPTH = 64;
+
+/**
+ * Resolve all entries in buf->unresolved with statx() relative to reader, queued on the ring in ctx.
+ * @return false if io_uring could not be used, entries might then be partially resolved.
+ */
+static bool dir_walk_resolve_uring( dir_walk_ctx* ctx, const dir_reader* reader, dir_sort_buffer* buf )
+{
+	if( !ctx->has_uring )
+	{
+		if( ctx->uring_failed || !dir_uring_init( &ctx->uring, DIR_WALK_BATCH_QUEUE_DEPTH ) )
+		{
+			ctx->uring_failed = true;
+			return false;
+		}
+		ctx->has_uring = true;
+	}
+	dir_uring* ring = &ctx->uring;
+
+	struct statx* stx = (struct statx*)malloc( buf->num_unresolved * sizeof( struct statx ) );
+	if( stx == 0x0 )
+		return false;
+
+	bool         with_stat = ( ctx->flags & DIR_WALK_WITH_STAT ) > 0;
+	size_t       submitted = 0;
+	size_t       completed = 0;
+	unsigned int in_flight = 0;
+	while( completed < buf->num_unresolved )
+	{
+		while( submitted < buf->num_unresolved && in_flight < DIR_WALK_BATCH_QUEUE_DEPTH )
+		{
+			io_uring_sqe* sqe = dir_uring_get_sqe( ring );
+			if( sqe == 0x0 )
+				break;
+
+			const dir_sorted_entry* e = &buf->entries[buf->unresolved[submitted]];
+			sqe->opcode    = IORING_OP_STATX;
+			sqe->fd        = reader->fd;
+			sqe->addr      = (uint64_t)(uintptr_t)( buf->names + e->name_offset );
+			sqe->len       = with_stat ? DIR_STATX_MASK : STATX_TYPE;
+			sqe->off       = (uint64_t)(uintptr_t)&stx[submitted];
+			sqe->user_data = submitted;
+			++submitted;
+			++in_flight;
+		}
+
+		// submit everything not yet consumed by the kernel, including what a previous interrupted call left.
+		unsigned int to_submit = *ring->sq_tail - __atomic_load_n( ring->sq_head, __ATOMIC_ACQUIRE );
+		long entered = syscall( __NR_io_uring_enter, ring->fd, to_submit, 1, IORING_ENTER_GETEVENTS, 0x0, 0 );
+		if( entered < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY )
+		{
+			// ops in flight might still be written to by the kernel, leak stx and the ring rather than risking that.
+			ctx->has_uring    = false;
+			ctx->uring_failed = true;
+			return false;
+		}
+
+		unsigned head = *ring->cq_head;
+		unsigned tail = __atomic_load_n( ring->cq_tail, __ATOMIC_ACQUIRE );
+		for( ; head != tail; ++head )
+		{
+			io_uring_cqe* cqe = &ring->cqes[head & *ring->cq_mask];
+			size_t index = (size_t)cqe->user_data;
+			int    res   = cqe->res;
+			__atomic_store_n( ring->cq_head, head + 1, __ATOMIC_RELEASE );
+			--in_flight;
+			++completed;
+
+			// same fallbacks as dir_walk_resolve_entry() if the stat failed.
+			dir_sorted_entry* e = &buf->entries[buf->unresolved[index]];
+			if( res == 0 && with_stat )
+			{
+				dir_stat_from_statx( &stx[index], &e->stat );
+				e->has_stat = true;
 			}
-			break;
+			if( e->entry_type == DIR_ENTRY_UNKNOWN )
+				e->type = res == 0 && S_ISDIR( stx[index].stx_mode ) ? DIR_ITEM_DIR : DIR_ITEM_FILE;
+		}
+	}
 
-			case '{':
+	free( stx );
+	return true;
+}
+#endif
+
+/**
+ * Resolve all entries in buf->unresolved, batched on io_uring if available, otherwise split over a few threads
+ * if there are enough of them to make up for starting the threads.
+ */
+static void dir_walk_resolve_batch( dir_walk_ctx* ctx, const dir_reader* reader, dir_sort_buffer* buf )
+{
+	size_t num = buf->num_unresolved;
+	{
+		DIR_STATS_TIMER( ctx->stats, stat_ns );
+	#if defined( DIRUTIL_IO_URING )
+		if( !dir_walk_resolve_uring( ctx, reader, buf ) )
+	#endif
+		{
+			size_t num_threads = std::min( num / DIR_WALK_BATCH_PER_THREAD, DIR_WALK_BATCH_MAX_THREADS );
+			size_t per_thread  = num_threads > 1 ? ( num + num_threads - 1 ) / num_threads : num;
+			std::thread* threads = num_threads > 1 ? new (std::nothrow) std::thread[num_threads - 1] : 0x0;
+			size_t started = 0;
+			if( threads != 0x0 )
 			{
-				const char* group_start = glob_pattern + 1;
-				const char* group_end   = group_start;
-				while( group_end != glob_end && *group_end != '}' )
-					++group_end;
+				for( ; started < num_threads - 1; ++started )
+					threads[started] = std::thread( dir_walk_resolve_range, reader, ctx->flags, buf, started * per_thread, ( started + 1 ) * per_thread );
+			}
+
+			// the calling thread resolves the last part, or everything if no threads were started.
+			dir_walk_resolve_range( reader, ctx->flags, buf, started * per_thread, num );
+
+			for( size_t i = 0; i < started; ++i )
+				threads[i].join();
+			delete[] threads;
+		}
+	}
+
+#if defined( DIRUTIL_STATS )
+	if( ctx->stats != 0x0 )
+	{
+		if( ( ctx->flags & DIR_WALK_WITH_STAT ) > 0 )
+			ctx->stats->stats_fetched += num;
+		for( size_t i = 0; i < num; ++i )
+		{
+			const dir_sorted_entry* e = &buf->entries[buf->unresolved[i]];
+			if( e->entry_type == DIR_ENTRY_UNKNOWN && !e->has_stat )
+				++ctx->stats->stat_fallbacks;
+		}
+	}
+#endif
+}
+#endif
+
+/**
+ * Read all entries left in reader into the sort-buffer for depth. Entries that need a syscall to resolve are
+ * resolved in one batch once the whole dir is read, the entries are then sorted by name with DIR_WALK_SORTED.
+ * @return the filled buffer or 0x0 on failure.
+ */
+static dir_sort_buffer* dir_walk_read_all( dir_walk_ctx* ctx, dir_reader* reader, size_t depth )
+{
+	dir_sort_buffer* buf = dir_walk_sort_buffer( ctx, depth );
+	if( buf == 0x0 )
+		return 0x0;
+	buf->num_entries    = 0;
+	buf->names_size     = 0;
+	buf->num_unresolved = 0;
+
+	dir_reader_entry ent;
+	while( dir_walk_reader_next( reader, &ent, ctx->stats ) )
+	{
+		if( ent.type == DIR_ENTRY_UNKNOWN )
+			ctx->types_unknown = true;
+
+	#if defined( _WIN32 )
+		// metadata is read from the find-data of the current entry, so it has to be resolved right away.
+		dir_item_type        item_type;
+		dir_item_stat        item_stat;
+		const dir_item_stat* item_stat_ptr;
+		if( !dir_walk_resolve_entry( reader, &ent, ctx->flags, &item_type, &item_stat, &item_stat_ptr, ctx->stats ) )
+			continue;
+	#else
+		bool is_dot = ent.name[0] == '.';
+		dir_item_type item_type = ent.type == DIR_ENTRY_DIR ? DIR_ITEM_DIR : DIR_ITEM_FILE;
+		if( is_dot && ( ( ctx->flags & DIR_WALK_IGNORE_DOT_ITEMS ) == DIR_WALK_IGNORE_DOT_ITEMS ||
+						( ent.type != DIR_ENTRY_UNKNOWN && dir_walk_skip_dot( item_type, ctx->flags ) ) ) )
+		{
+			DIR_STATS_ADD( ctx->stats, dot_items_skipped, 1 );
+			continue;
+		}
+	#endif
+
+		size_t name_size = strlen( ent.name ) + 1;
+		if( !dir_array_grow( &buf->entries, &buf->entries_capacity, buf->num_entries + 1 ) ||
+			!dir_array_grow( &buf->names, &buf->names_capacity, buf->names_size + name_size ) )
+			return 0x0;
 
-				int match_len = dir_glob_match_groups( group_start, group_end - 1, unverified );
-				if( match_len < 0 )
-					return DIR_GLOB_NO_MATCH;
+		dir_sorted_entry* e = &buf->entries[buf->num_entries++];
+		e->name_offset = buf->names_size;
+		e->entry_type  = ent.type;
+		e->type        = item_type;
+	#if defined( _WIN32 )
+		e->has_stat    = item_stat_ptr != 0x0;
+		if( e->has_stat )
+			e->stat = item_stat;
+	#else
+		e->has_stat    = false;
+		if( ent.type == DIR_ENTRY_UNKNOWN || ( ctx->flags & DIR_WALK_WITH_STAT ) > 0 )
+		{
+			if( !dir_array_grow( &buf->unresolved, &buf->unresolved_capacity, buf->num_unresolved + 1 ) )
+				return 0x0;
+			buf->unresolved[buf->num_unresolved++] = buf->num_entries - 1;
+		}
+	#endif
+		memcpy( buf->names + buf->names_size, ent.name, name_size );
+		buf->names_size += name_size;
+	}
+
+#if !defined( _WIN32 )
+	if( buf->num_unresolved > 0 )
+	{
+		dir_walk_resolve_batch( ctx, reader, buf );
 
-				glob_pattern = group_end + 1;
-				unverified += match_len;
+		// dot-items without type could not be filtered until now.
+		size_t num_kept = 0;
+		for( size_t i = 0; i < buf->num_entries; ++i )
+		{
+			const dir_sorted_entry* e = &buf->entries[i];
+			if( buf->names[e->name_offset] == '.' && dir_walk_skip_dot( e->type, ctx->flags ) )
+			{
+				DIR_STATS_ADD( ctx->stats, dot_items_skipped, 1 );
+				continue;
 			}
+			buf->entries[num_kept++] = *e;
+		}
+		buf->num_entries = num_kept;
+	}
+#endif
+
+	if( ( ctx->flags & DIR_WALK_SORTED ) > 0 )
+	{
+		const char* names = buf->names;
+		std::sort( buf->entries, buf->entries + buf->num_entries,
+			[names]( const dir_sorted_entry& e1, const dir_sorted_entry& e2 ) {
+				return strcmp( names + e1.name_offset, names + e2.name_offset ) < 0;
+			});
+	}
+	return buf;
+}
+
+/**
+ * Check if the next dir in the walk should be read in full with dir_walk_read_all() before reporting any item.
+ */
+static bool dir_walk_read_in_full( const dir_walk_ctx* ctx )
+{
+	return ( ctx->flags & DIR_WALK_SORTED ) > 0 || ctx->types_unknown;
+}
+
+/**
+ * Get next entry to report in a dir, from buffered if the dir was read in full, otherwise directly from reader.
+ * @param next index of next entry in buffered.
+ * @return false when there are no more entries.
+ */
+static bool dir_walk_next_entry( dir_walk_ctx*          ctx,
+								 dir_reader*            reader,
+								 const dir_sort_buffer* buffered,
+								 size_t*                next,
+								 const char**           name,
+								 dir_item_type*         type,
+								 dir_item_stat*         stat,
+								 const dir_item_stat**  out_stat )
+{
+	if( buffered != 0x0 )
+	{
+		if( *next >= buffered->num_entries )
+			return false;
+		const dir_sorted_entry* e = &buffered->entries[( *next )++];
+		*name     = buffered->names + e->name_offset;
+		*type     = e->type;
+		*out_stat = 0x0;
+		if( e->has_stat )
+		{
+			*stat     = e->stat;
+			*out_stat = stat;
+		}
+		return true;
+	}
+
+	dir_reader_entry ent;
+	while( dir_walk_reader_next( reader, &ent, ctx->stats ) )
+	{
+		if( ent.type == DIR_ENTRY_UNKNOWN )
+			ctx->types_unknown = true;
+		if( !dir_walk_resolve_entry( reader, &ent, ctx->flags, type, stat, out_stat, ctx->stats ) )
+			continue;
+		*name = ent.name;
+		return true;
+	}
+	return false;
+}
+
+static int dir_walk_call( dir_walk_ctx* ctx, const dir_walk_item* item )
+{
+	DIR_STATS_TIMER( ctx->stats, callback_ns );
+	return ctx->callback( item );
+}
+
+static dir_error dir_walk_impl( dir_walk_ctx* ctx, const dir_reader* parent, size_t path_len, size_t name_offset, size_t depth )
+{
+	if( !dir_walk_path_reserve( ctx, path_len + 3 ) )
+		return DIR_ERROR_PATH_TO_DEEP;
+
+	dir_reader reader;
+	bool opened;
+	{
+		DIR_STATS_TIMER( ctx->stats, open_ns );
+		opened = dir_reader_open( &reader, parent, ctx->path_buffer, path_len, name_offset, dir_walk_read_buffer( ctx, depth ), dir_reader_buffer_size() );
+	}
+	if( !opened )
+		return DIR_ERROR_PATH_DO_NOT_EXIST;
+	DIR_STATS_ADD( ctx->stats, dirs_opened, 1 );
+	DIR_STATS_MAX( ctx->stats, max_depth, depth );
+
+	const dir_sort_buffer* buffered = 0x0;
+	if( dir_walk_read_in_full( ctx ) )
+	{
+		buffered = dir_walk_read_all( ctx, &reader, depth );
+		if( buffered == 0x0 )
+		{
+			dir_reader_close( &reader );
+			return DIR_ERROR_FAILED;
+		}
+	}
+
+	dir_error            res = DIR_ERROR_OK;
+	size_t               next_buffered = 0;
+	const char*          item_name;
+	dir_item_type        item_type;
+	dir_item_stat        item_stat;
+	const dir_item_stat* item_stat_ptr;
+	while( dir_walk_next_entry( ctx, &reader, buffered, &next_buffered, &item_name, &item_type, &item_stat, &item_stat_ptr ) )
+	{
+		size_t item_len = strlen( item_name );
+		if( !dir_walk_path_reserve( ctx, path_len + item_len + 2 ) )
+		{
+			res = DIR_ERROR_PATH_TO_DEEP;
 			break;
+		}
 
-			default:
+		char* path_buffer = ctx->path_buffer;
+		path_buffer[path_len] = '/';
+		memcpy( &path_buffer[path_len + 1], item_name, item_len + 1 );
+
+		dir_walk_item item;
+		item.path     = path_buffer;
+		item.relative = path_buffer + ctx->root_len + 1;
+		item.name     = path_buffer + path_len + 1;
+		item.type     = item_type;
+		item.stat     = item_stat_ptr;
+		item.userdata = ctx->userdata;
+
+		if( item.type == DIR_ITEM_DIR )
+		{
+			bool depth_first = (ctx->flags & DIR_WALK_DEPTH_FIRST) > 0;
+
+			int cb_res = DIR_WALK_CONTINUE;
+			if( !depth_first )
+				cb_res = dir_walk_call( ctx, &item );
+			if( cb_res == DIR_WALK_ABORT )
+			{
+				res = DIR_ERROR_ABORTED;
+				break;
+			}
+
+			if( cb_res != DIR_WALK_SKIP_SUBTREE )
 			{
-				if( *unverified != *glob_pattern )
-					return DIR_GLOB_NO_MATCH;
-				++unverified;
-				++glob_pattern;
+				// other errors in the sub-dir, such as it being removed while walking, only skips it.
+				dir_error sub_res = dir_walk_impl( ctx, &reader, path_len + item_len + 1, path_len + 1, depth + 1 );
+				if( sub_res == DIR_ERROR_ABORTED || sub_res == DIR_ERROR_PATH_TO_DEEP )
+				{
+					res = sub_res;
+					break;
+				}
+
+				// the sub-walk might have moved the path-buffer.
+				item.path     = ctx->path_buffer;
+				item.relative = ctx->path_buffer + ctx->root_len + 1;
+				item.name     = ctx->path_buffer + path_len + 1;
 			}
+
+			if( depth_first && dir_walk_call( ctx, &item ) == DIR_WALK_ABORT )
+			{
+				res = DIR_ERROR_ABORTED;
+				break;
+			}
+		}
+		else if( dir_walk_call( ctx, &item ) == DIR_WALK_ABORT )
+		{
+			res = DIR_ERROR_ABORTED;
 			break;
 		}
 	}
 
-	return *unverified == '\0' ? DIR_GLOB_MATCH : DIR_GLOB_NO_MATCH;
+	dir_reader_close( &reader );
+	ctx->path_buffer[path_len] = '\0';
+	return res;
 }
 
-dir_glob_result dir_glob_match( const char* glob_pattern, const char* path )
+dir_error dir_walk_with_stats( const char* path, unsigned int flags, dir_walk_callback callback, void* userdata, dir_walk_stats* stats )
+{
+	if( stats != 0x0 )
+		memset( stats, 0x0, sizeof( dir_walk_stats ) );
+
+	char path_buffer[4096];
+	dir_walk_ctx ctx;
+	ctx.flags            = flags;
+	ctx.callback         = callback;
+	ctx.userdata         = userdata;
+	ctx.path_buffer      = path_buffer;
+	ctx.path_buffer_size = sizeof( path_buffer );
+	dir_walk_init_buffers( &ctx );
+	ctx.stats            = stats;
+
+	dir_error res = DIR_ERROR_PATH_TO_DEEP;
+	if( dir_walk_copy_root( &ctx, path ) )
+		res = dir_walk_impl( &ctx, 0x0, ctx.root_len, 0, 0 );
+
+	dir_walk_free_buffers( &ctx );
+	return res;
+}
+
+dir_error dir_walk( const char* path, unsigned int flags, dir_walk_callback callback, void* userdata )
+{
+	return dir_walk_with_stats( path, flags, callback, userdata, 0x0 );
+}
+
+struct dir_walk_parallel_dir
+{
+	// parent dir, 0x0 for the root.
+	dir_walk_parallel_dir* parent;
+
+	// 1 for the scan of the dir itself + 1 per sub-dir not yet completed.
+	std::atomic<size_t> pending;
+
+	// metadata of dir, valid if has_stat is set.
+	dir_item_stat stat;
+	bool          has_stat;
+
+	// when removing, a node can also be a batch of files in parent to remove, stored as '\0'-terminated names
+	// after each other. path is then the path of parent.
+	char*  remove_names;
+	size_t remove_names_size;
+	size_t remove_names_capacity;
+
+	size_t path_len;
+	size_t name_offset;
+	char   path[1];
+};
+
+struct dir_walk_parallel_queue
+{
+	std::mutex              lock;
+	dir_walk_parallel_dir** items;
+	size_t                  begin;
+	size_t                  end;
+	size_t                  capacity;
+};
+
+struct dir_walk_parallel_ctx
+{
+	unsigned int             flags;
+	dir_walk_callback        callback;
+	void*                    userdata;
+	size_t                   root_len;
+
+	dir_walk_parallel_queue* queues;
+	unsigned int             num_queues;
+
+	// number of dirs queued or currently being scanned, the walk is done when this reaches 0.
+	std::atomic<size_t>      outstanding;
+
+	// workers without anything to do wait on idle_cond, they are woken when work is pushed or the walk is done.
+	// work_pushed is bumped on each push so that a worker never waits after missing a push while looking for work.
+	std::mutex               idle_lock;
+	std::condition_variable  idle_cond;
+	std::atomic<size_t>      work_pushed;
+	std::atomic<unsigned>    num_idle;
+
+	// remove all items instead of reporting them, see dir_rmtree_parallel().
+	bool                     remove;
+
+	// set on the first error while removing, or when the callback abort the walk, all queued work is then dropped
+	// without being done.
+	std::atomic<bool>        aborted;
+	std::atomic<int>         error;
+};
+
+// number of files to remove in one batch, each full batch can be stolen by another worker.
+static const size_t DIR_RMTREE_BATCH_SIZE = 256;
+
+static dir_walk_parallel_dir* dir_walk_parallel_dir_alloc( dir_walk_parallel_dir* parent, const char* path, size_t path_len, size_t name_offset )
+{
+	void* mem = malloc( sizeof( dir_walk_parallel_dir ) + path_len );
+	if( mem == 0x0 )
+		return 0x0;
+
+	dir_walk_parallel_dir* dir = new (mem) dir_walk_parallel_dir;
+	dir->parent      = parent;
+	dir->pending     = 1;
+	dir->has_stat    = false;
+	dir->remove_names          = 0x0;
+	dir->remove_names_size     = 0;
+	dir->remove_names_capacity = 0;
+	dir->path_len    = path_len;
+	dir->name_offset = name_offset;
+	memcpy( dir->path, path, path_len + 1 );
+	return dir;
+}
+
+static void dir_walk_parallel_dir_free( dir_walk_parallel_dir* dir )
+{
+	free( dir->remove_names );
+	dir->~dir_walk_parallel_dir();
+	free( dir );
+}
+
+static bool dir_walk_parallel_push( dir_walk_parallel_queue* q, dir_walk_parallel_dir* dir )
+{
+	std::lock_guard<std::mutex> guard( q->lock );
+	if( q->end == q->capacity )
+	{
+		if( q->begin > 0 )
+		{
+			memmove( q->items, q->items + q->begin, ( q->end - q->begin ) * sizeof( dir_walk_parallel_dir* ) );
+			q->end  -= q->begin;
+			q->begin = 0;
+		}
+		else
+		{
+			size_t new_capacity = q->capacity == 0 ? 64 : q->capacity * 2;
+			void* new_items = realloc( q->items, new_capacity * sizeof( dir_walk_parallel_dir* ) );
+			if( new_items == 0x0 )
+				return false;
+			q->items    = (dir_walk_parallel_dir**)new_items;
+			q->capacity = new_capacity;
+		}
+	}
+	q->items[q->end++] = dir;
+	return true;
+}
+
+// the owning worker pops from the back to keep working depth-first in its own part of the tree...
+static dir_walk_parallel_dir* dir_walk_parallel_pop( dir_walk_parallel_queue* q )
+{
+	std::lock_guard<std::mutex> guard( q->lock );
+	if( q->begin == q->end )
+		return 0x0;
+	return q->items[--q->end];
+}
+
+// ... while thieves take from the front where the dirs closest to the root, and hopefully the largest sub-trees, are.
+static dir_walk_parallel_dir* dir_walk_parallel_steal( dir_walk_parallel_queue* q )
+{
+	std::lock_guard<std::mutex> guard( q->lock );
+	if( q->begin == q->end )
+		return 0x0;
+	return q->items[q->begin++];
+}
+
+static void dir_walk_parallel_fail( dir_walk_parallel_ctx* ctx, dir_error error )
+{
+	int expected = DIR_ERROR_OK;
+	ctx->error.compare_exchange_strong( expected, error );
+	ctx->aborted = true;
+}
+
+/**
+ * Make sure that a heap-allocated path-buffer, initially 0x0 with size 0, can hold size bytes. The content is kept
+ * but the buffer might move, the caller frees *buffer.
+ */
+static dir_error dir_path_buffer_reserve( char** buffer, size_t* buffer_size, size_t size )
 {
-	return dir_glob_match( glob_pattern, glob_pattern + strlen(glob_pattern), path );
+	if( size <= *buffer_size )
+		return DIR_ERROR_OK;
+	if( size > DIRUTIL_MAX_PATH_LENGTH )
+		return DIR_ERROR_PATH_TO_DEEP;
+
+	size_t new_size = std::min( std::max( *buffer_size * 2, size ), (size_t)DIRUTIL_MAX_PATH_LENGTH );
+	char* new_buffer = (char*)realloc( *buffer, new_size );
+	if( new_buffer == 0x0 )
+		return DIR_ERROR_FAILED;
+	*buffer      = new_buffer;
+	*buffer_size = new_size;
+	return DIR_ERROR_OK;
+}
+
+static void dir_walk_parallel_complete( dir_walk_parallel_ctx* ctx, dir_walk_parallel_dir* dir )
+{
+	// report dirs where all sub-items are done and propagate upwards.
+	while( dir != 0x0 && --dir->pending == 0 )
+	{
+		dir_walk_parallel_dir* parent = dir->parent;
+		if( ctx->remove )
+		{
+			// all items below dir are removed, so it can be removed as well.
+			if( dir->remove_names == 0x0 && !ctx->aborted && rmdir( dir->path ) != 0 )
+				dir_walk_parallel_fail( ctx, DIR_ERROR_FAILED );
+		}
+		else if( parent != 0x0 && ( ctx->flags & DIR_WALK_DEPTH_FIRST ) > 0 && !ctx->aborted )
+		{
+			dir_walk_item item;
+			item.path     = dir->path;
+			item.relative = dir->path + ctx->root_len + 1;
+			item.name     = dir->path + dir->name_offset;
+			item.type     = DIR_ITEM_DIR;
+			item.stat     = dir->has_stat ? &dir->stat : 0x0;
+			item.userdata = ctx->userdata;
+			if( ctx->callback( &item ) == DIR_WALK_ABORT )
+				dir_walk_parallel_fail( ctx, DIR_ERROR_ABORTED );
+		}
+		dir_walk_parallel_dir_free( dir );
+		dir = parent;
+	}
 }
+
+static bool dir_walk_parallel_queue_dir( dir_walk_parallel_ctx* ctx, dir_walk_parallel_queue* queue, dir_walk_parallel_dir* parent, dir_walk_parallel_dir* dir )
+{
+	++parent->pending;
+	++ctx->outstanding;
+	if( dir_walk_parallel_push( queue, dir ) )
+	{
+		++ctx->work_pushed;
+		if( ctx->num_idle > 0 )
+		{
+			std::lock_guard<std::mutex> guard( ctx->idle_lock );
+			ctx->idle_cond.notify_one();
+		}
+		return true;
+	}
+	--parent->pending;
+	--ctx->outstanding;
+	return false;
+}
+
+static bool dir_remove_file( const dir_reader* reader, const char* name, const char* path )
+{
+#if defined( _WIN32 )
+	(void)reader;
+	(void)name;
+	return DeleteFile( path ) || GetLastError() == ERROR_FILE_NOT_FOUND;
+#else
+	(void)path;
+	return unlinkat( reader->fd, name, 0 ) == 0 || errno == ENOENT;
+#endif
+}
+
+/**
+ * Remove all files in a batch, reader is the open dir the files are in or 0x0 if it need to be opened.
+ */
+static void dir_walk_parallel_remove_batch( dir_walk_parallel_ctx* ctx, const dir_reader* reader, const dir_walk_parallel_dir* batch, char** path_buffer, size_t* path_buffer_size )
+{
+	dir_reader opened;
+	if( reader == 0x0 )
+	{
+	#if defined( _WIN32 )
+		opened.ffh = INVALID_HANDLE_VALUE;
+	#else
+		opened.fd = dir_open_dir_path( batch->path, batch->path_len );
+		if( opened.fd < 0 )
+		{
+			dir_walk_parallel_fail( ctx, DIR_ERROR_FAILED );
+			return;
+		}
+	#endif
+		reader = &opened;
+	}
+
+	size_t path_len = batch->path_len;
+	for( size_t pos = 0; pos < batch->remove_names_size && !ctx->aborted; )
+	{
+		const char* name = batch->remove_names + pos;
+		size_t name_len = strlen( name );
+		pos += name_len + 1;
+
+		dir_error reserved = dir_path_buffer_reserve( path_buffer, path_buffer_size, path_len + name_len + 2 );
+		if( reserved != DIR_ERROR_OK )
+		{
+			dir_walk_parallel_fail( ctx, reserved );
+			break;
+		}
+		memcpy( *path_buffer, batch->path, path_len );
+		(*path_buffer)[path_len] = '/';
+		memcpy( *path_buffer + path_len + 1, name, name_len + 1 );
+
+		if( !dir_remove_file( reader, name, *path_buffer ) )
+			dir_walk_parallel_fail( ctx, DIR_ERROR_FAILED );
+	}
+
+#if !defined( _WIN32 )
+	if( reader == &opened )
+		close( opened.fd );
+#endif
+}
+
+/**
+ * Handle an entry while scanning dir for removal, files are added to the current batch of files to remove that is
+ * queued when full.
+ * @return true if the entry is a dir that need to be scanned.
+ */
+static bool dir_walk_parallel_remove_entry( dir_walk_parallel_ctx*   ctx,
+											dir_walk_parallel_queue* queue,
+											dir_walk_parallel_dir*   dir,
+											const dir_reader*        reader,
+											const dir_reader_entry*  entry,
+											dir_walk_parallel_dir**  batch,
+											size_t*                  batch_count,
+											char**                   path_buffer,
+											size_t*                  path_buffer_size )
+{
+	if( entry->type == DIR_ENTRY_DIR )
+		return true;
+
+#if !defined( _WIN32 )
+	if( entry->type == DIR_ENTRY_UNKNOWN )
+	{
+		// remove it as a file directly and only treat it as a dir if that fails, this never follow a symlink
+		// as a stat() would.
+		if( unlinkat( reader->fd, entry->name, 0 ) == 0 || errno == ENOENT )
+			return false;
+		if( errno == EISDIR || errno == EPERM )
+			return true;
+		dir_walk_parallel_fail( ctx, DIR_ERROR_FAILED );
+		return false;
+	}
+#endif
+
+	size_t name_len = strlen( entry->name );
+	if( *batch == 0x0 )
+		*batch = dir_walk_parallel_dir_alloc( dir, dir->path, dir->path_len, dir->name_offset );
+	if( *batch == 0x0 || !dir_array_grow( &(*batch)->remove_names, &(*batch)->remove_names_capacity, (*batch)->remove_names_size + name_len + 1 ) )
+	{
+		if( !dir_remove_file( reader, entry->name, *path_buffer ) )
+			dir_walk_parallel_fail( ctx, DIR_ERROR_FAILED );
+		return false;
+	}
+
+	memcpy( (*batch)->remove_names + (*batch)->remove_names_size, entry->name, name_len + 1 );
+	(*batch)->remove_names_size += name_len + 1;
+
+	if( ++*batch_count == DIR_RMTREE_BATCH_SIZE )
+	{
+		if( !dir_walk_parallel_queue_dir( ctx, queue, dir, *batch ) )
+		{
+			dir_walk_parallel_remove_batch( ctx, reader, *batch, path_buffer, path_buffer_size );
+			dir_walk_parallel_dir_free( *batch );
+		}
+		*batch       = 0x0;
+		*batch_count = 0;
+	}
+	return false;
+}
+
+static dir_error dir_walk_parallel_scan( dir_walk_parallel_ctx*   ctx,
+										 dir_walk_parallel_queue* queue,
+										 dir_walk_parallel_dir*   dir,
+										 char**                   path_buffer,
+										 size_t*                  path_buffer_size,
+										 char*                    read_buffer )
+{
+	size_t path_len = dir->path_len;
+	dir_error res = dir_path_buffer_reserve( path_buffer, path_buffer_size, path_len + 3 );
+	if( res != DIR_ERROR_OK )
+		return res;
+	memcpy( *path_buffer, dir->path, path_len + 1 );
+
+	// dirs are opened by full path here since the parent dir is most likely already closed, and might have been
+	// read by another thread, when a dir is scanned.
+	dir_reader reader;
+	if( !dir_reader_open( &reader, 0x0, *path_buffer, path_len, 0, read_buffer, dir_reader_buffer_size() ) )
+		return DIR_ERROR_PATH_DO_NOT_EXIST;
+
+	dir_reader_entry ent;
+	dir_walk_parallel_dir* remove_batch = 0x0;
+	size_t                 remove_batch_count = 0;
+	while( !ctx->aborted && dir_reader_next( &reader, &ent ) )
+	{
+		const char* item_name = ent.name;
+
+		size_t item_len = strlen( item_name );
+		res = dir_path_buffer_reserve( path_buffer, path_buffer_size, path_len + item_len + 2 );
+		if( res != DIR_ERROR_OK )
+		{
+			dir_walk_parallel_fail( ctx, res );
+			break;
+		}
+
+		(*path_buffer)[path_len] = '/';
+		memcpy( *path_buffer + path_len + 1, item_name, item_len + 1 );
+
+		if( ctx->remove )
+		{
+			if( !dir_walk_parallel_remove_entry( ctx, queue, dir, &reader, &ent, &remove_batch, &remove_batch_count, path_buffer, path_buffer_size ) )
+				continue;
+
+			dir_walk_parallel_dir* sub = dir_walk_parallel_dir_alloc( dir, *path_buffer, path_len + item_len + 1, path_len + 1 );
+			if( sub == 0x0 )
+				dir_walk_parallel_fail( ctx, DIR_ERROR_FAILED );
+			else if( !dir_walk_parallel_queue_dir( ctx, queue, dir, sub ) )
+			{
+				dir_walk_parallel_fail( ctx, DIR_ERROR_FAILED );
+				dir_walk_parallel_dir_free( sub );
+			}
+			continue;
+		}
+
+		dir_item_type        item_type;
+		dir_item_stat        item_stat;
+		const dir_item_stat* item_stat_ptr;
+		if( !dir_walk_resolve_entry( &reader, &ent, ctx->flags, &item_type, &item_stat, &item_stat_ptr, 0x0 ) )
+			continue;
+
+		dir_walk_item item;
+		item.path     = *path_buffer;
+		item.relative = *path_buffer + ctx->root_len + 1;
+		item.name     = *path_buffer + path_len + 1;
+		item.type     = item_type;
+		item.stat     = item_stat_ptr;
+		item.userdata = ctx->userdata;
+
+		if( item_type == DIR_ITEM_DIR )
+		{
+			int cb_res = DIR_WALK_CONTINUE;
+			if( ( ctx->flags & DIR_WALK_DEPTH_FIRST ) == 0 )
+				cb_res = ctx->callback( &item );
+			if( cb_res == DIR_WALK_ABORT )
+			{
+				dir_walk_parallel_fail( ctx, DIR_ERROR_ABORTED );
+				break;
+			}
+			if( cb_res == DIR_WALK_SKIP_SUBTREE )
+				continue;
+
+			dir_walk_parallel_dir* sub = dir_walk_parallel_dir_alloc( dir, *path_buffer, path_len + item_len + 1, path_len + 1 );
+			if( sub == 0x0 )
+			{
+				dir_walk_parallel_fail( ctx, DIR_ERROR_FAILED );
+				break;
+			}
+
+			if( item_stat_ptr != 0x0 )
+			{
+				sub->stat     = item_stat;
+				sub->has_stat = true;
+			}
+
+			if( !dir_walk_parallel_queue_dir( ctx, queue, dir, sub ) )
+			{
+				dir_walk_parallel_fail( ctx, DIR_ERROR_FAILED );
+				dir_walk_parallel_dir_free( sub );
+				break;
+			}
+		}
+		else if( ctx->callback( &item ) == DIR_WALK_ABORT )
+		{
+			dir_walk_parallel_fail( ctx, DIR_ERROR_ABORTED );
+			break;
+		}
+	}
+
+	// the last files, that did not fill a batch, are removed directly while the dir is still open.
+	if( remove_batch != 0x0 )
+	{
+		dir_walk_parallel_remove_batch( ctx, &reader, remove_batch, path_buffer, path_buffer_size );
+		dir_walk_parallel_dir_free( remove_batch );
+	}
+
+	// all errors while scanning has failed the walk.
+	dir_reader_close( &reader );
+	return (dir_error)(int)ctx->error;
+}
+
+static void dir_walk_parallel_worker( dir_walk_parallel_ctx* ctx, unsigned int worker_index )
+{
+	char*  path_buffer      = 0x0;
+	size_t path_buffer_size = 0;
+	char*  read_buffer      = dir_reader_alloc_buffer();
+	dir_walk_parallel_queue* own = &ctx->queues[worker_index];
+
+	while( true )
+	{
+		size_t pushed = ctx->work_pushed;
+		dir_walk_parallel_dir* dir = dir_walk_parallel_pop( own );
+		for( unsigned int i = 1; dir == 0x0 && i < ctx->num_queues; ++i )
+			dir = dir_walk_parallel_steal( &ctx->queues[( worker_index + i ) % ctx->num_queues] );
+
+		if( dir == 0x0 )
+		{
+			// wait for more work instead of spinning, a walk blocked on one slow dir should not keep all cores busy.
+			++ctx->num_idle;
+			std::unique_lock<std::mutex> lock( ctx->idle_lock );
+			while( ctx->outstanding > 0 && ctx->work_pushed == pushed )
+				ctx->idle_cond.wait( lock );
+			--ctx->num_idle;
+			if( ctx->outstanding == 0 )
+				break;
+			continue;
+		}
+
+		// after an error the queue is only drained.
+		if( !ctx->aborted )
+		{
+			if( dir->remove_names != 0x0 )
+				dir_walk_parallel_remove_batch( ctx, 0x0, dir, &path_buffer, &path_buffer_size );
+			else
+			{
+				// as with dir_walk(), a sub-dir that can not be opened, such as it being removed while walking,
+				// is skipped when not removing.
+				dir_error res = dir_walk_parallel_scan( ctx, own, dir, &path_buffer, &path_buffer_size, read_buffer );
+				if( res != DIR_ERROR_OK && ( ctx->remove || res != DIR_ERROR_PATH_DO_NOT_EXIST ) )
+					dir_walk_parallel_fail( ctx, ctx->remove ? DIR_ERROR_FAILED : res );
+			}
+		}
+		dir_walk_parallel_complete( ctx, dir );
+		if( --ctx->outstanding == 0 )
+		{
+			std::lock_guard<std::mutex> guard( ctx->idle_lock );
+			ctx->idle_cond.notify_all();
+		}
+	}
+
+	free( path_buffer );
+	free( read_buffer );
+}
+
+/**
+ * Walk path with ctx where the walk-specific members are already set up.
+ */
+static dir_error dir_walk_parallel_run( dir_walk_parallel_ctx* ctx, const char* path, unsigned int num_threads )
+{
+	if( num_threads == 0 )
+		num_threads = std::thread::hardware_concurrency();
+	if( num_threads == 0 )
+		num_threads = 1;
+
+	size_t path_len = strlen( path );
+
+	// normalize input path to only strip of trailing / if there is one.
+	if( path_len > 0 && path[path_len-1] == '/' )
+		--path_len;
+
+	if( path_len + 3 > DIRUTIL_MAX_PATH_LENGTH )
+		return DIR_ERROR_PATH_TO_DEEP;
+
+	char*  path_buffer      = 0x0;
+	size_t path_buffer_size = 0;
+	dir_walk_parallel_dir* root = dir_walk_parallel_dir_alloc( 0x0, path, path_len, 0 );
+	if( root == 0x0 )
+		return DIR_ERROR_FAILED;
+	root->path[path_len] = '\0';
+
+	dir_walk_parallel_queue* queues = new (std::nothrow) dir_walk_parallel_queue[num_threads];
+	if( queues == 0x0 )
+	{
+		dir_walk_parallel_dir_free( root );
+		return DIR_ERROR_FAILED;
+	}
+	for( unsigned int i = 0; i < num_threads; ++i )
+	{
+		queues[i].items    = 0x0;
+		queues[i].begin    = 0;
+		queues[i].end      = 0;
+		queues[i].capacity = 0;
+	}
+
+	ctx->root_len    = path_len;
+	ctx->queues      = queues;
+	ctx->num_queues  = num_threads;
+	ctx->outstanding = 1;
+	ctx->work_pushed = 0;
+	ctx->num_idle    = 0;
+	ctx->aborted     = false;
+	ctx->error       = DIR_ERROR_OK;
+
+	// scan the root on the calling thread to report a missing root directly and to seed the queue before
+	// any worker is started.
+	char* read_buffer = dir_reader_alloc_buffer();
+	dir_error res = dir_walk_parallel_scan( ctx, &queues[0], root, &path_buffer, &path_buffer_size, read_buffer );
+	free( path_buffer );
+	free( read_buffer );
+	dir_walk_parallel_complete( ctx, root );
+	--ctx->outstanding;
+
+	if( ctx->outstanding > 0 )
+	{
+		std::thread* threads = new (std::nothrow) std::thread[num_threads - 1];
+		unsigned int started = 0;
+		if( threads != 0x0 )
+		{
+			for( ; started < num_threads - 1; ++started )
+				threads[started] = std::thread( dir_walk_parallel_worker, ctx, started + 1 );
+		}
+
+		dir_walk_parallel_worker( ctx, 0 );
+
+		for( unsigned int i = 0; i < started; ++i )
+			threads[i].join();
+		delete[] threads;
+	}
+
+	for( unsigned int i = 0; i < num_threads; ++i )
+		free( queues[i].items );
+	delete[] queues;
+	return res;
+}
+
+dir_error dir_walk_parallel( const char* path, unsigned int flags, unsigned int num_threads, dir_walk_callback callback, void* userdata )
+{
+	dir_walk_parallel_ctx ctx;
+	ctx.flags    = flags;
+	ctx.callback = callback;
+	ctx.userdata = userdata;
+	ctx.remove   = false;
+	dir_error res = dir_walk_parallel_run( &ctx, path, num_threads );
+	if( res != DIR_ERROR_OK )
+		return res;
+	return (dir_error)(int)ctx.error;
+}
+
+dir_error dir_create( const char* path )
+{
+#if defined( _WIN32 )
+	if( CreateDirectory( path, 0x0 ) )
+		return DIR_ERROR_OK;
+	if( GetLastError() == ERROR_ALREADY_EXISTS )
+		return DIR_ERROR_OK;
+#else
+	if( mkdir( path, 0777 ) == 0 )
+		return DIR_ERROR_OK;
+	if( errno == EEXIST )
+		return DIR_ERROR_OK;
+#endif
+	return DIR_ERROR_FAILED;
+}
+
+static bool dir_walk_rmfile( const char* path )
+{
+#if defined( _WIN32 )
+	return DeleteFile( path );
+#else
+	return unlink( path ) == 0;
+#endif
+}
+
+static int dir_walk_rmitem( const dir_walk_item* item )
+{
+	dir_error* err = (dir_error*)item->userdata;
+	switch( item->type )
+	{
+		case DIR_ITEM_FILE:
+			if(!dir_walk_rmfile(item->path))
+				*err = DIR_ERROR_FAILED;
+			break;
+		case DIR_ITEM_DIR:
+			if( rmdir( item->path ) != 0 )
+				*err = DIR_ERROR_FAILED;
+			break;
+		default:
+			break;
+	}
+	return *err == DIR_ERROR_OK ? DIR_WALK_CONTINUE : DIR_WALK_ABORT;
+}
+
+dir_error dir_rmtree( const char* path )
+{
+	dir_error res = DIR_ERROR_OK;
+	dir_error e = dir_walk( path, DIR_WALK_DEPTH_FIRST, dir_walk_rmitem, &res );
+	if( res != DIR_ERROR_OK )
+		return res;
+	if( e != DIR_ERROR_OK )
+		return e;
+	return rmdir( path ) == 0 ? DIR_ERROR_OK : DIR_ERROR_FAILED;
+}
+
+dir_error dir_rmtree_parallel( const char* path, unsigned int num_threads )
+{
+	dir_walk_parallel_ctx ctx;
+	ctx.flags    = DIR_WALK_NO_FLAGS;
+	ctx.callback = 0x0;
+	ctx.userdata = 0x0;
+	ctx.remove   = true;
+	dir_error res = dir_walk_parallel_run( &ctx, path, num_threads );
+	if( res != DIR_ERROR_OK )
+		return res;
+	return (dir_error)(int)ctx.error;
+}
+
+// name of trash-directories created by dir_rmtree_async(), followed by "<pid>.<n>".
+#define DIR_RMTREE_TRASH_PREFIX ".dirutil-trash."
+
+struct dir_rmtree_job
+{
+	std::thread  thread;
+	unsigned int num_threads;
+	dir_error    result;
+	char         path[1];
+};
+
+static unsigned long dir_process_id()
+{
+#if defined( _WIN32 )
+	return (unsigned long)GetCurrentProcessId();
+#else
+	return (unsigned long)getpid();
+#endif
+}
+
+static bool dir_process_alive( unsigned long pid )
+{
+#if defined( _WIN32 )
+	HANDLE process = OpenProcess( SYNCHRONIZE, FALSE, (DWORD)pid );
+	if( process == 0x0 )
+		return GetLastError() == ERROR_ACCESS_DENIED;
+	bool alive = WaitForSingleObject( process, 0 ) == WAIT_TIMEOUT;
+	CloseHandle( process );
+	return alive;
+#else
+	// kill() with a pid <= 0 would check process groups.
+	if( pid == 0 || pid > 0x7fffffff )
+		return false;
+	return kill( (pid_t)pid, 0 ) == 0 || errno == EPERM;
+#endif
+}
+
+static void dir_rmtree_job_run( dir_rmtree_job* job )
+{
+	job->result = dir_rmtree_parallel( job->path, job->num_threads );
+}
+
+static void dir_rmtree_job_free( dir_rmtree_job* job )
+{
+	job->~dir_rmtree_job();
+	free( job );
+}
+
+dir_error dir_rmtree_async( const char* path, unsigned int num_threads, dir_rmtree_job** out_job )
+{
+	if( out_job != 0x0 )
+		*out_job = 0x0;
+
+	// only dirs are moved to the trash, a file or symlink is left in place as dir_rmtree() does.
+	dir_item_type        type;
+	dir_item_stat        stat;
+	const dir_item_stat* stat_ptr;
+	if( !dir_stat_path_as_entry( path, &type, &stat, &stat_ptr ) )
+		return DIR_ERROR_PATH_DO_NOT_EXIST;
+	if( type != DIR_ITEM_DIR )
+		return DIR_ERROR_PATH_IS_FILE;
+
+	size_t path_len = strlen( path );
+	if( path_len > 0 && path[path_len-1] == '/' )
+		--path_len;
+	size_t parent_len = path_len;
+	while( parent_len > 0 && path[parent_len-1] != '/' )
+		--parent_len;
+
+	static std::atomic<unsigned int> trash_counter( 0 );
+	char trash_name[64];
+	int trash_name_len = snprintf( trash_name, sizeof( trash_name ), DIR_RMTREE_TRASH_PREFIX "%lu.%u", dir_process_id(), trash_counter++ );
+
+	// the buffer is also used for path itself if the job is run in place.
+	size_t trash_len = parent_len + (size_t)trash_name_len;
+	void* mem = malloc( sizeof( dir_rmtree_job ) + std::max( trash_len, path_len ) );
+	if( mem == 0x0 )
+		return DIR_ERROR_FAILED;
+
+	dir_rmtree_job* job = new (mem) dir_rmtree_job;
+	job->num_threads = num_threads;
+	job->result      = DIR_ERROR_OK;
+	memcpy( job->path, path, parent_len );
+	memcpy( job->path + parent_len, trash_name, (size_t)trash_name_len + 1 );
+
+	if( rename( path, job->path ) != 0 )
+	{
+		if( !dir_stat_path( path, &stat ) )
+		{
+			dir_rmtree_job_free( job );
+			return DIR_ERROR_PATH_DO_NOT_EXIST;
+		}
+
+		// could not be renamed, i.e. a mount-point, remove in place instead.
+		memcpy( job->path, path, path_len );
+		job->path[path_len] = '\0';
+		dir_rmtree_job_run( job );
+		dir_error res = job->result;
+		if( res != DIR_ERROR_OK || out_job == 0x0 )
+			dir_rmtree_job_free( job );
+		else
+			*out_job = job;
+		return res;
+	}
+
+	if( out_job == 0x0 )
+	{
+		// nobody will wait for the job, the thread owns it.
+		std::thread( []( dir_rmtree_job* j ) { dir_rmtree_job_run( j ); dir_rmtree_job_free( j ); }, job ).detach();
+		return DIR_ERROR_OK;
+	}
+
+	job->thread = std::thread( dir_rmtree_job_run, job );
+	*out_job = job;
+	return DIR_ERROR_OK;
+}
+
+dir_error dir_rmtree_wait( dir_rmtree_job* job )
+{
+	if( job->thread.joinable() )
+		job->thread.join();
+	dir_error res = job->result;
+	dir_rmtree_job_free( job );
+	return res;
+}
+
+dir_error dir_rmtree_reap( const char* dir )
+{
+	if( dir[0] == '\0' )
+		dir = ".";
+	size_t dir_len = strlen( dir );
+	if( dir_len > 1 && dir[dir_len-1] == '/' )
+		--dir_len;
+
+	char*  path_buffer      = 0x0;
+	size_t path_buffer_size = 0;
+	dir_error res = dir_path_buffer_reserve( &path_buffer, &path_buffer_size, dir_len + 3 );
+	if( res != DIR_ERROR_OK )
+		return res;
+	memcpy( path_buffer, dir, dir_len );
+	path_buffer[dir_len] = '\0';
+
+	dir_reader reader;
+	if( !dir_reader_open( &reader, 0x0, path_buffer, dir_len, 0, 0x0, 0 ) )
+	{
+		free( path_buffer );
+		return DIR_ERROR_PATH_DO_NOT_EXIST;
+	}
+
+	const size_t prefix_len = sizeof( DIR_RMTREE_TRASH_PREFIX ) - 1;
+	dir_reader_entry entry;
+	while( dir_reader_next( &reader, &entry ) )
+	{
+		if( strncmp( entry.name, DIR_RMTREE_TRASH_PREFIX, prefix_len ) != 0 )
+			continue;
+
+		char* pid_end;
+		unsigned long pid = strtoul( entry.name + prefix_len, &pid_end, 10 );
+		if( pid_end == entry.name + prefix_len || *pid_end != '.' || dir_process_alive( pid ) )
+			continue;
+
+		// entries may be removed while the directory is read.
+		size_t name_len = strlen( entry.name );
+		dir_error reserved = dir_path_buffer_reserve( &path_buffer, &path_buffer_size, dir_len + name_len + 2 );
+		if( reserved != DIR_ERROR_OK )
+		{
+			if( res == DIR_ERROR_OK )
+				res = reserved;
+			continue;
+		}
+		path_buffer[dir_len] = '/';
+		memcpy( path_buffer + dir_len + 1, entry.name, name_len + 1 );
+		dir_error e = dir_rmtree_parallel( path_buffer, 0 );
+		if( e != DIR_ERROR_OK && res == DIR_ERROR_OK )
+			res = e;
+		path_buffer[dir_len] = '\0';
+	}
+	dir_reader_close( &reader );
+	free( path_buffer );
+	return res;
+}
+
+enum dir_mkdir_result
+{
+	DIR_MKDIR_OK,
+	DIR_MKDIR_NO_PARENT,
+	DIR_MKDIR_FAILED
+};
+
+/**
+ * Create directory, same as dir_create() but report if it failed due to a missing parent.
+ */
+static dir_mkdir_result dir_mkdir( const char* path )
+{
+#if defined( _WIN32 )
+	if( CreateDirectory( path, 0x0 ) )
+		return DIR_MKDIR_OK;
+	DWORD err = GetLastError();
+	if( err == ERROR_ALREADY_EXISTS )
+		return DIR_MKDIR_OK;
+	return err == ERROR_PATH_NOT_FOUND ? DIR_MKDIR_NO_PARENT : DIR_MKDIR_FAILED;
+#else
+	if( mkdir( path, 0777 ) == 0 || errno == EEXIST )
+		return DIR_MKDIR_OK;
+	return errno == ENOENT ? DIR_MKDIR_NO_PARENT : DIR_MKDIR_FAILED;
+#endif
+}
+
+/**
+ * Copy path to be created by dir_mktree_buffer() to path_buffer, stripping a trailing '/'.
+ * @return length of path in path_buffer or 0 if it did not fit.
+ */
+static size_t dir_mktree_copy_path( const char* path, char* path_buffer, size_t path_buffer_size )
+{
+	size_t path_len = strlen( path );
+	if( path_len > 1 && path[path_len-1] == '/' )
+		--path_len;
+	if( path_len + 1 > path_buffer_size )
+		return 0;
+	memcpy( path_buffer, path, path_len );
+	path_buffer[path_len] = '\0';
+	return path_len;
+}
+
+/**
+ * Create all non-existing directories in path, the '/':s in path is replaced while working.
+ * @param exists_len length of a prefix of path, ending at a '/', that is known to exist. 0 if unknown.
+ */
+static dir_error dir_mktree_buffer( char* path, size_t path_len, size_t exists_len )
+{
+	size_t len = exists_len;
+	if( len == 0 )
+	{
+		// probe from the leaf upward, when creating many dirs most of the path usually already exist so that
+		// only the missing dirs at the end cost a mkdir().
+		len = path_len;
+		while( true )
+		{
+			dir_mkdir_result res = dir_mkdir( path );
+			if( res == DIR_MKDIR_OK )
+				break;
+
+			// a missing root of an absolute path can not be created.
+			size_t sep = len;
+			while( sep > 0 && path[--sep] != '/' ) {}
+			if( res == DIR_MKDIR_FAILED || sep == 0 )
+				return DIR_ERROR_FAILED;
+			path[sep] = '\0';
+			len = sep;
+		}
+	}
+
+	// ... and create the missing dirs downward.
+	while( len < path_len )
+	{
+		path[len] = '/';
+		size_t sep = len + 1;
+		while( sep < path_len && path[sep] != '/' && path[sep] != '\0' )
+			++sep;
+		path[sep] = '\0';
+		if( dir_mkdir( path ) != DIR_MKDIR_OK )
+			return DIR_ERROR_FAILED;
+		len = sep;
+	}
+	return DIR_ERROR_OK;
+}
+
+/**
+ * Make sure that *buffer, initially pointing to stack_buffer, can hold size bytes, the content is not kept. Grows
+ * on the heap up to DIRUTIL_MAX_PATH_LENGTH, the caller frees *buffer if it is not stack_buffer.
+ */
+static dir_error dir_mktree_reserve( char** buffer, size_t* buffer_size, char* stack_buffer, size_t size )
+{
+	if( size <= *buffer_size )
+		return DIR_ERROR_OK;
+	if( size > DIRUTIL_MAX_PATH_LENGTH )
+		return DIR_ERROR_PATH_TO_DEEP;
+
+	size_t new_size = std::min( std::max( *buffer_size * 2, size ), (size_t)DIRUTIL_MAX_PATH_LENGTH );
+	char* new_buffer = (char*)realloc( *buffer == stack_buffer ? 0x0 : *buffer, new_size );
+	if( new_buffer == 0x0 )
+		return DIR_ERROR_FAILED;
+	*buffer      = new_buffer;
+	*buffer_size = new_size;
+	return DIR_ERROR_OK;
+}
+
+dir_error dir_mktree( const char* path )
+{
+	char   stack_buffer[4096];
+	char*  path_buffer      = stack_buffer;
+	size_t path_buffer_size = sizeof( stack_buffer );
+	dir_error res = dir_mktree_reserve( &path_buffer, &path_buffer_size, stack_buffer, strlen( path ) + 1 );
+	if( res != DIR_ERROR_OK )
+		return res;
+
+	size_t path_len = dir_mktree_copy_path( path, path_buffer, path_buffer_size );
+	res = path_len == 0 ? DIR_ERROR_FAILED : dir_mktree_buffer( path_buffer, path_len, 0 );
+	if( path_buffer != stack_buffer )
+		free( path_buffer );
+	return res;
+}
+
+struct dir_mktree_cache_entry
+{
+	uint64_t    hash;
+	const char* key;
+	size_t      key_len;
+	size_t      next;
+};
+
+/**
+ * Set of directories known to exist, keys point into the paths passed to dir_mktree_many().
+ */
+struct dir_mktree_cache
+{
+	size_t*                 buckets;
+	size_t                  num_buckets;
+	dir_mktree_cache_entry* entries;
+	size_t                  num_entries;
+	size_t                  entries_capacity;
+};
+
+static const size_t DIR_MKTREE_CACHE_NO_ENTRY = ~(size_t)0;
+
+static bool dir_mktree_cache_has( const dir_mktree_cache* cache, const char* key, size_t key_len )
+{
+	if( cache->num_buckets == 0 )
+		return false;
+	uint64_t hash = dir_hash_fnv1a( key, key_len );
+	for( size_t e = cache->buckets[hash & ( cache->num_buckets - 1 )]; e != DIR_MKTREE_CACHE_NO_ENTRY; e = cache->entries[e].next )
+	{
+		const dir_mktree_cache_entry* entry = &cache->entries[e];
+		if( entry->hash == hash && entry->key_len == key_len && memcmp( entry->key, key, key_len ) == 0 )
+			return true;
+	}
+	return false;
+}
+
+static bool dir_mktree_cache_insert( dir_mktree_cache* cache, const char* key, size_t key_len )
+{
+	if( !dir_array_grow( &cache->entries, &cache->entries_capacity, cache->num_entries + 1 ) )
+		return false;
+
+	// rehash to keep chains short.
+	if( cache->num_entries >= cache->num_buckets )
+	{
+		size_t num_buckets = cache->num_buckets == 0 ? 64 : cache->num_buckets * 2;
+		size_t* buckets = (size_t*)realloc( cache->buckets, num_buckets * sizeof( size_t ) );
+		if( buckets == 0x0 )
+			return false;
+		cache->buckets     = buckets;
+		cache->num_buckets = num_buckets;
+		for( size_t b = 0; b < num_buckets; ++b )
+			buckets[b] = DIR_MKTREE_CACHE_NO_ENTRY;
+		for( size_t e = 0; e < cache->num_entries; ++e )
+		{
+			size_t* bucket = &buckets[cache->entries[e].hash & ( num_buckets - 1 )];
+			cache->entries[e].next = *bucket;
+			*bucket = e;
+		}
+	}
+
+	dir_mktree_cache_entry* entry = &cache->entries[cache->num_entries];
+	entry->hash    = dir_hash_fnv1a( key, key_len );
+	entry->key     = key;
+	entry->key_len = key_len;
+	size_t* bucket = &cache->buckets[entry->hash & ( cache->num_buckets - 1 )];
+	entry->next = *bucket;
+	*bucket = cache->num_entries++;
+	return true;
+}
+
+dir_error dir_mktree_many( const char** paths, size_t num_paths )
+{
+	dir_mktree_cache cache;
+	memset( &cache, 0x0, sizeof( cache ) );
+
+	dir_error res = DIR_ERROR_OK;
+	char   stack_buffer[4096];
+	char*  path_buffer      = stack_buffer;
+	size_t path_buffer_size = sizeof( stack_buffer );
+	for( size_t i = 0; i < num_paths; ++i )
+	{
+		const char* path = paths[i];
+		dir_error reserved = dir_mktree_reserve( &path_buffer, &path_buffer_size, stack_buffer, strlen( path ) + 1 );
+		size_t path_len = reserved == DIR_ERROR_OK ? dir_mktree_copy_path( path, path_buffer, path_buffer_size ) : 0;
+		if( path_len == 0 )
+		{
+			if( res == DIR_ERROR_OK )
+				res = reserved != DIR_ERROR_OK ? reserved : DIR_ERROR_FAILED;
+			continue;
+		}
+
+		// find the longest parent already created or seen by an earlier path, if any.
+		size_t exists_len = path_len;
+		while( exists_len > 0 && !dir_mktree_cache_has( &cache, path, exists_len ) )
+			while( exists_len > 0 && path[--exists_len] != '/' ) {}
+		if( exists_len == path_len )
+			continue;
+
+		dir_error err = dir_mktree_buffer( path_buffer, path_len, exists_len );
+		if( err != DIR_ERROR_OK )
+		{
+			if( res == DIR_ERROR_OK )
+				res = err;
+			continue;
+		}
+
+		// all parents of path now exist, remember the ones not already known. If the cache can not grow the
+		// next paths are just probed again.
+		for( size_t len = exists_len + 1; len <= path_len; ++len )
+			if( ( len == path_len || path[len] == '/' ) && !dir_mktree_cache_insert( &cache, path, len ) )
+				break;
+	}
+
+	if( path_buffer != stack_buffer )
+		free( path_buffer );
+	free( cache.buckets );
+	free( cache.entries );
+	return res;
+}
+
+#if !defined( _WIN32 )
+/**
+ * Copy the content of the open file in to the open file out, fastest way first.
+ * @param buffer buffer used by the fallback, allocated on first use and owned by the caller.
+ */
+static bool dir_copy_file_data( int in, int out, uint64_t size, char** buffer )
+{
+#if defined( FICLONE )
+	// share the data-blocks with the source on filesystems that support it, i.e. btrfs and xfs.
+	if( ioctl( out, FICLONE, in ) == 0 )
+		return true;
+#endif
+
+#if defined( __linux__ )
+	uint64_t copied = 0;
+#endif
+#if defined( DIRUTIL_COPY_FILE_RANGE )
+	// ... copy in the kernel, and on some filesystems still without copying the data.
+	while( copied < size )
+	{
+		long res = syscall( SYS_copy_file_range, in, 0x0, out, 0x0, (size_t)( size - copied ), 0u );
+		if( res == 0 )
+			return true; // file was truncated while copying.
+		if( res < 0 )
+		{
+			// not supported for these files, i.e. different filesystems on older kernels, fallback if nothing is copied.
+			if( errno == EINTR )
+				continue;
+			if( copied == 0 && ( errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP ) )
+				break;
+			return false;
+		}
+		copied += (uint64_t)res;
+	}
+	if( copied >= size )
+		return true;
+#endif
+
+#if defined( __linux__ )
+	// ... sendfile() between files is still in the kernel.
+	while( copied < size )
+	{
+		ssize_t res = sendfile( out, in, 0x0, (size_t)( size - copied ) );
+		if( res == 0 )
+			return true;
+		if( res < 0 )
+		{
+			if( errno == EINTR )
+				continue;
+			if( copied == 0 && ( errno == ENOSYS || errno == EINVAL ) )
+				break;
+			return false;
+		}
+		copied += (uint64_t)res;
+	}
+	if( copied >= size )
+		return true;
+#endif
+
+	// ... and fallback to read()/write().
+	(void)size;
+	static const size_t DIR_COPY_BUFFER_SIZE = 256 * 1024;
+	if( *buffer == 0x0 )
+	{
+		*buffer = (char*)malloc( DIR_COPY_BUFFER_SIZE );
+		if( *buffer == 0x0 )
+			return false;
+	}
+	while( true )
+	{
+		ssize_t res = read( in, *buffer, DIR_COPY_BUFFER_SIZE );
+		if( res == 0 )
+			return true;
+		if( res < 0 )
+		{
+			if( errno == EINTR )
+				continue;
+			return false;
+		}
+
+		for( ssize_t written = 0; written < res; )
+		{
+			ssize_t w = write( out, *buffer + written, (size_t)( res - written ) );
+			if( w < 0 && errno == EINTR )
+				continue;
+			if( w <= 0 )
+				return false;
+			written += w;
+		}
+	}
+}
+#endif
+
+#if !defined( _WIN32 )
+/**
+ * Create dst as a symlink with the same target as the symlink src, overwriting dst if it exist.
+ */
+static bool dir_copy_symlink( const char* src, const char* dst )
+{
+	char target[PATH_MAX + 1];
+	ssize_t target_len = readlink( src, target, sizeof( target ) );
+	if( target_len < 0 || (size_t)target_len >= sizeof( target ) )
+		return false;
+	target[target_len] = '\0';
+
+	if( symlink( target, dst ) == 0 )
+		return true;
+	if( errno != EEXIST || unlink( dst ) != 0 )
+		return false;
+	return symlink( target, dst ) == 0;
+}
+#endif
+
+/**
+ * Copy file src to dst, overwriting dst if it exist, with the same permissions as src. A symlink is copied as a
+ * symlink with the same target.
+ */
+static bool dir_copy_file( const char* src, const char* dst, char** buffer )
+{
+#if defined( _WIN32 )
+	(void)buffer;
+	return CopyFile( src, dst, FALSE ) != 0;
+#else
+	int in = open( src, O_RDONLY | O_CLOEXEC | O_NOFOLLOW );
+	if( in < 0 )
+		return errno == ELOOP && dir_copy_symlink( src, dst );
+
+	struct stat s;
+	if( fstat( in, &s ) != 0 )
+	{
+		close( in );
+		return false;
+	}
+
+	int out = open( dst, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, s.st_mode & 07777 );
+	if( out < 0 )
+	{
+		close( in );
+		return false;
+	}
+
+	bool ok = dir_copy_file_data( in, out, (uint64_t)s.st_size, buffer );
+	close( in );
+	if( close( out ) != 0 )
+		ok = false;
+	if( !ok )
+		unlink( dst );
+	return ok;
+#endif
+}
+
+struct dir_copytree_ctx
+{
+	char*  dst;
+	size_t dst_size;
+	size_t dst_len;
+
+	// parent, relative dst, of the last created dir.
+	char*  last_dir;
+	size_t last_dir_capacity;
+	size_t last_dir_len;
+
+	// relative paths, '\0'-terminated, of all files to copy.
+	char*   files;
+	size_t  files_size;
+	size_t  files_capacity;
+	size_t* file_offsets;
+	size_t  num_files;
+	size_t  file_offsets_capacity;
+
+	const char*         src;
+	size_t              src_len;
+	std::atomic<size_t> next_file;
+	std::atomic<int>    error;
+};
+
+static void dir_copytree_fail( dir_copytree_ctx* ctx, dir_error err )
+{
+	int expected = DIR_ERROR_OK;
+	ctx->error.compare_exchange_strong( expected, (int)err );
+}
+
+/**
+ * Called for each item to copy, dirs are created directly and files are collected to be copied in parallel.
+ */
+static int dir_copytree_item( const dir_walk_item* item )
+{
+	dir_copytree_ctx* ctx = (dir_copytree_ctx*)item->userdata;
+	if( ctx->error != DIR_ERROR_OK )
+		return DIR_WALK_ABORT;
+
+	size_t rel_len = strlen( item->relative );
+	dir_error reserved = dir_path_buffer_reserve( &ctx->dst, &ctx->dst_size, ctx->dst_len + rel_len + 2 );
+#if !defined( _WIN32 )
+	// items are created and copied by full path, the walk itself might go deeper than the OS can resolve.
+	if( ctx->dst_len + rel_len + 1 >= PATH_MAX || ctx->src_len + rel_len + 1 >= PATH_MAX )
+		reserved = DIR_ERROR_PATH_TO_DEEP;
+#endif
+	if( reserved != DIR_ERROR_OK )
+	{
+		dir_copytree_fail( ctx, reserved );
+		return DIR_WALK_ABORT;
+	}
+
+	// symlinks are reported as files, except on filesystems that do not report the type while reading the dir.
+	// Copy them as files, i.e. as symlinks, instead of following them.
+	dir_item_type type = item->type;
+	if( type == DIR_ITEM_DIR )
+	{
+		dir_item_stat        stat;
+		const dir_item_stat* stat_ptr;
+		if( !dir_stat_path_as_entry( item->path, &type, &stat, &stat_ptr ) )
+			return DIR_WALK_SKIP_SUBTREE;
+	}
+
+	size_t dir_len = rel_len;
+	if( type == DIR_ITEM_FILE )
+	{
+		while( dir_len > 0 && item->relative[dir_len-1] != '/' )
+			--dir_len;
+		if( dir_len > 0 )
+			--dir_len;
+	}
+	else if( type != DIR_ITEM_DIR )
+		return DIR_WALK_CONTINUE;
+
+	// create the dir, or the dir of a file, unless it was the last one created. When walking without a glob
+	// pattern, or with one matching all dirs, the walk reports dirs before the items in them.
+	if( dir_len != ctx->last_dir_len || ( dir_len > 0 && memcmp( item->relative, ctx->last_dir, dir_len ) != 0 ) )
+	{
+		ctx->dst[ctx->dst_len] = '/';
+		memcpy( ctx->dst + ctx->dst_len + 1, item->relative, dir_len );
+		ctx->dst[ctx->dst_len + 1 + dir_len] = '\0';
+		dir_error err = dir_mktree( ctx->dst );
+		ctx->dst[ctx->dst_len] = '\0';
+		if( err == DIR_ERROR_OK && !dir_array_grow( &ctx->last_dir, &ctx->last_dir_capacity, dir_len ) )
+			err = DIR_ERROR_FAILED;
+		if( err != DIR_ERROR_OK )
+		{
+			dir_copytree_fail( ctx, err );
+			return DIR_WALK_ABORT;
+		}
+		memcpy( ctx->last_dir, item->relative, dir_len );
+		ctx->last_dir_len = dir_len;
+	}
+
+	if( type == DIR_ITEM_FILE )
+	{
+		if( !dir_array_grow( &ctx->files, &ctx->files_capacity, ctx->files_size + rel_len + 1 ) ||
+			!dir_array_grow( &ctx->file_offsets, &ctx->file_offsets_capacity, ctx->num_files + 1 ) )
+		{
+			dir_copytree_fail( ctx, DIR_ERROR_FAILED );
+			return DIR_WALK_ABORT;
+		}
+		ctx->file_offsets[ctx->num_files++] = ctx->files_size;
+		memcpy( ctx->files + ctx->files_size, item->relative, rel_len + 1 );
+		ctx->files_size += rel_len + 1;
+	}
+	return type != item->type ? DIR_WALK_SKIP_SUBTREE : DIR_WALK_CONTINUE;
+}
+
+static void dir_copytree_worker( dir_copytree_ctx* ctx )
+{
+	char*  src_path      = 0x0;
+	char*  dst_path      = 0x0;
+	size_t src_path_size = 0;
+	size_t dst_path_size = 0;
+	char*  buffer        = 0x0;
+
+	// the buffers keep their content when growing, so src and dst only need to be copied once.
+	dir_error reserved = dir_path_buffer_reserve( &src_path, &src_path_size, ctx->src_len + 2 );
+	if( reserved == DIR_ERROR_OK )
+		reserved = dir_path_buffer_reserve( &dst_path, &dst_path_size, ctx->dst_len + 2 );
+	if( reserved == DIR_ERROR_OK )
+	{
+		memcpy( src_path, ctx->src, ctx->src_len );
+		memcpy( dst_path, ctx->dst, ctx->dst_len );
+		src_path[ctx->src_len] = '/';
+		dst_path[ctx->dst_len] = '/';
+	}
+
+	while( ctx->error == DIR_ERROR_OK && reserved == DIR_ERROR_OK )
+	{
+		size_t file = ctx->next_file++;
+		if( file >= ctx->num_files )
+			break;
+
+		const char* rel = ctx->files + ctx->file_offsets[file];
+		size_t rel_len = strlen( rel );
+		reserved = dir_path_buffer_reserve( &src_path, &src_path_size, ctx->src_len + rel_len + 2 );
+		if( reserved == DIR_ERROR_OK )
+			reserved = dir_path_buffer_reserve( &dst_path, &dst_path_size, ctx->dst_len + rel_len + 2 );
+		if( reserved != DIR_ERROR_OK )
+			break;
+
+		memcpy( src_path + ctx->src_len + 1, rel, rel_len + 1 );
+		memcpy( dst_path + ctx->dst_len + 1, rel, rel_len + 1 );
+		if( !dir_copy_file( src_path, dst_path, &buffer ) )
+			dir_copytree_fail( ctx, DIR_ERROR_FAILED );
+	}
+	if( reserved != DIR_ERROR_OK )
+		dir_copytree_fail( ctx, reserved );
+	free( src_path );
+	free( dst_path );
+	free( buffer );
+}
+
+static dir_error dir_copytree_impl( const char* src, const char* dst, const char* glob_pattern, unsigned int flags )
+{
+	dir_item_stat stat;
+	if( !dir_stat_path( src, &stat ) )
+		return DIR_ERROR_PATH_DO_NOT_EXIST;
+	if( !dir_stat_is_dir( &stat ) )
+		return DIR_ERROR_PATH_IS_FILE;
+
+	// do not create dst for an invalid pattern.
+	if( glob_pattern != 0x0 )
+	{
+		dir_glob* glob = dir_glob_compile( glob_pattern );
+		if( glob == 0x0 )
+			return DIR_ERROR_INVALID_PATTERN;
+		dir_glob_free( glob );
+	}
+
+	dir_copytree_ctx* ctx = new (std::nothrow) dir_copytree_ctx;
+	if( ctx == 0x0 )
+		return DIR_ERROR_FAILED;
+
+	ctx->dst      = 0x0;
+	ctx->dst_size = 0;
+	ctx->dst_len  = 0;
+	ctx->src      = src;
+	ctx->src_len  = strlen( src );
+	if( ctx->src_len > 1 && src[ctx->src_len-1] == '/' )
+		--ctx->src_len;
+	ctx->last_dir          = 0x0;
+	ctx->last_dir_capacity = 0;
+	ctx->last_dir_len      = 0;
+	ctx->files        = 0x0;
+	ctx->files_size   = 0;
+	ctx->files_capacity = 0;
+	ctx->file_offsets   = 0x0;
+	ctx->num_files      = 0;
+	ctx->file_offsets_capacity = 0;
+	ctx->next_file = 0;
+	ctx->error     = DIR_ERROR_OK;
+
+	dir_error res = dir_path_buffer_reserve( &ctx->dst, &ctx->dst_size, strlen( dst ) + 1 );
+	if( res == DIR_ERROR_OK )
+	{
+		ctx->dst_len = dir_mktree_copy_path( dst, ctx->dst, ctx->dst_size );
+		res = ctx->dst_len == 0 ? DIR_ERROR_FAILED : dir_mktree( ctx->dst );
+	}
+	if( res == DIR_ERROR_OK )
+	{
+		flags &= DIR_WALK_IGNORE_DOT_ITEMS;
+		if( glob_pattern != 0x0 )
+			res = dir_walk_glob( src, glob_pattern, flags, dir_copytree_item, ctx );
+		else
+			res = dir_walk( src, flags, dir_copytree_item, ctx );
+	}
+
+	if( res == DIR_ERROR_OK && ctx->num_files > 0 && ctx->error == DIR_ERROR_OK )
+	{
+		// copy multiple files at once, most of the time is spent waiting for the filesystem.
+		unsigned int num_threads = std::thread::hardware_concurrency();
+		if( num_threads < 4 )
+			num_threads = 4;
+		if( num_threads > ctx->num_files )
+			num_threads = (unsigned int)ctx->num_files;
+
+		std::thread* threads = new (std::nothrow) std::thread[num_threads - 1];
+		unsigned int started = 0;
+		if( threads != 0x0 )
+			for( ; started < num_threads - 1; ++started )
+				threads[started] = std::thread( dir_copytree_worker, ctx );
+		dir_copytree_worker( ctx );
+		for( unsigned int i = 0; i < started; ++i )
+			threads[i].join();
+		delete[] threads;
+	}
+
+	// the walk is aborted on errors in the callback, report the actual error.
+	if( ctx->error != DIR_ERROR_OK )
+		res = (dir_error)(int)ctx->error;
+	free( ctx->dst );
+	free( ctx->last_dir );
+	free( ctx->files );
+	free( ctx->file_offsets );
+	delete ctx;
+	return res;
+}
+
+dir_error dir_copytree( const char* src, const char* dst, unsigned int flags )
+{
+	return dir_copytree_impl( src, dst, 0x0, flags );
+}
+
+dir_error dir_copytree_glob( const char* src, const char* dst, const char* glob_pattern, unsigned int flags )
+{
+	return dir_copytree_impl( src, dst, glob_pattern, flags );
+}
+
+/**
+ * Read-only mapping of a complete file.
+ */
+struct dir_mapped_file
+{
+	const uint8_t* data;
+	size_t         size;
+#if defined( _WIN32 )
+	HANDLE         file;
+	HANDLE         mapping;
+#endif
+};
+
+static bool dir_map_file( const char* path, dir_mapped_file* file )
+{
+#if defined( _WIN32 )
+	file->file = CreateFile( path, GENERIC_READ, FILE_SHARE_READ, 0x0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0x0 );
+	if( file->file == INVALID_HANDLE_VALUE )
+		return false;
+
+	LARGE_INTEGER size;
+	if( !GetFileSizeEx( file->file, &size ) || size.QuadPart == 0 )
+	{
+		CloseHandle( file->file );
+		return false;
+	}
+
+	file->mapping = CreateFileMapping( file->file, 0x0, PAGE_READONLY, 0, 0, 0x0 );
+	if( file->mapping == 0x0 )
+	{
+		CloseHandle( file->file );
+		return false;
+	}
+
+	file->data = (const uint8_t*)MapViewOfFile( file->mapping, FILE_MAP_READ, 0, 0, 0 );
+	file->size = (size_t)size.QuadPart;
+	if( file->data == 0x0 )
+	{
+		CloseHandle( file->mapping );
+		CloseHandle( file->file );
+		return false;
+	}
+	return true;
+#else
+	int fd = open( path, O_RDONLY | O_CLOEXEC );
+	if( fd < 0 )
+		return false;
+
+	struct stat s;
+	if( fstat( fd, &s ) != 0 || s.st_size <= 0 )
+	{
+		close( fd );
+		return false;
+	}
+
+	void* data = mmap( 0x0, (size_t)s.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	close( fd );
+	if( data == MAP_FAILED )
+		return false;
+
+	file->data = (const uint8_t*)data;
+	file->size = (size_t)s.st_size;
+	return true;
+#endif
+}
+
+static void dir_unmap_file( dir_mapped_file* file )
+{
+#if defined( _WIN32 )
+	UnmapViewOfFile( file->data );
+	CloseHandle( file->mapping );
+	CloseHandle( file->file );
+#else
+	munmap( (void*)file->data, file->size );
+#endif
+}
+
+/**
+ * Write data to path by writing a temporary file next to it and moving that into place when complete.
+ */
+static dir_error dir_write_file_atomic( const char* path, const void** chunks, const size_t* chunk_sizes, size_t num_chunks )
+{
+	char   stack_buffer[4096];
+	char*  tmp_path      = stack_buffer;
+	size_t tmp_path_size = sizeof( stack_buffer );
+	size_t path_len      = strlen( path );
+	dir_error res = dir_mktree_reserve( &tmp_path, &tmp_path_size, stack_buffer, path_len + 5 );
+	if( res != DIR_ERROR_OK )
+		return res;
+	memcpy( tmp_path, path, path_len );
+	memcpy( tmp_path + path_len, ".tmp", 5 );
+
+	FILE* f = fopen( tmp_path, "wb" );
+	bool ok = f != 0x0;
+	if( ok )
+	{
+		for( size_t i = 0; ok && i < num_chunks; ++i )
+			ok = fwrite( chunks[i], 1, chunk_sizes[i], f ) == chunk_sizes[i];
+		ok = fclose( f ) == 0 && ok;
+
+#if defined( _WIN32 )
+		ok = ok && MoveFileEx( tmp_path, path, MOVEFILE_REPLACE_EXISTING );
+#else
+		ok = ok && rename( tmp_path, path ) == 0;
+#endif
+		if( !ok )
+			remove( tmp_path );
+	}
+
+	if( tmp_path != stack_buffer )
+		free( tmp_path );
+	return ok ? DIR_ERROR_OK : DIR_ERROR_FAILED;
+}
+
+static const uint32_t DIR_SNAPSHOT_MAGIC   = 0x504e5344; // "DSNP"
+static const uint32_t DIR_SNAPSHOT_VERSION = 1;
+static const uint32_t DIR_SNAPSHOT_NO_NODE = 0xFFFFFFFF;
+
+/**
+ * Header of snapshot-file, followed by one array per node-field and the names of all nodes as zero-terminated
+ * strings. Node 0 is the root and the children of each dir are stored consecutively, sorted by name.
+ * size and mtime are only stored if built with DIR_WALK_WITH_STAT, otherwise their offsets are 0.
+ * This is also the in-memory layout of a dir_tree.
+ */
+struct dir_snapshot_header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t flags;
+	uint32_t node_count;
+	uint64_t file_size;
+	uint64_t names_size;
+
+	// offsets from start of file to the arrays.
+	uint64_t parent_offset;      // uint32_t[node_count]
+	uint64_t first_child_offset; // uint32_t[node_count]
+	uint64_t child_count_offset; // uint32_t[node_count]
+	uint64_t name_offset_offset; // uint32_t[node_count]
+	uint64_t type_offset;        // uint8_t[node_count]
+	uint64_t size_offset;        // uint64_t[node_count]
+	uint64_t mtime_offset;       // uint64_t[node_count]
+	uint64_t names_offset;       // char[names_size]
+};
+
+/**
+ * Snapshot as read from a file.
+ */
+struct dir_snapshot
+{
+	uint32_t        flags;
+	uint32_t        node_count;
+	const uint32_t* parent;
+	const uint32_t* first_child;
+	const uint32_t* child_count;
+	const uint32_t* name_offset;
+	const uint8_t*  type;
+	const uint64_t* size;
+	const uint64_t* mtime_ns;
+	const char*     names;
+};
+
+/**
+ * Node in snapshot while it is being built.
+ */
+struct dir_snapshot_build_node
+{
+	uint64_t size;
+	uint64_t mtime_ns;
+	uint32_t parent;
+	uint32_t first_child;
+	uint32_t child_count;
+	uint32_t name_offset;
+	uint8_t  type;
+};
+
+struct dir_snapshot_builder
+{
+	dir_snapshot_build_node* nodes;
+	size_t                   node_count;
+	size_t                   node_capacity;
+	char*                    names;
+	size_t                   names_size;
+	size_t                   names_capacity;
+
+	// open addressed hash-table of offsets into names, DIR_SNAPSHOT_NO_NODE for empty slots, used to only store
+	// each unique name once.
+	uint32_t*                name_slots;
+	size_t                   name_slot_count;
+	size_t                   name_count;
+};
+
+static void dir_snapshot_builder_free( dir_snapshot_builder* b )
+{
+	free( b->nodes );
+	free( b->names );
+	free( b->name_slots );
+}
+
+static bool dir_snapshot_builder_grow_name_slots( dir_snapshot_builder* b )
+{
+	size_t    slot_count = b->name_slot_count == 0 ? 256 : b->name_slot_count * 2;
+	uint32_t* slots      = (uint32_t*)malloc( slot_count * sizeof( uint32_t ) );
+	if( slots == 0x0 )
+		return false;
+	memset( slots, 0xFF, slot_count * sizeof( uint32_t ) );
+
+	for( size_t i = 0; i < b->name_slot_count; ++i )
+	{
+		uint32_t offset = b->name_slots[i];
+		if( offset == DIR_SNAPSHOT_NO_NODE )
+			continue;
+		const char* name = b->names + offset;
+		size_t slot = (size_t)dir_hash_fnv1a( name, strlen( name ) ) & ( slot_count - 1 );
+		while( slots[slot] != DIR_SNAPSHOT_NO_NODE )
+			slot = ( slot + 1 ) & ( slot_count - 1 );
+		slots[slot] = offset;
+	}
+
+	free( b->name_slots );
+	b->name_slots      = slots;
+	b->name_slot_count = slot_count;
+	return true;
+}
+
+/**
+ * Get offset of name in names, adding it if it is not already stored. Many names, such as 'CMakeLists.txt' or
+ * '.gitignore', are repeated all over a tree so this usually makes names a lot smaller than the sum of all names.
+ * @return offset of name or DIR_SNAPSHOT_NO_NODE on failure.
+ */
+static uint32_t dir_snapshot_builder_intern( dir_snapshot_builder* b, const char* name )
+{
+	if( ( b->name_count + 1 ) * 2 > b->name_slot_count )
+		if( !dir_snapshot_builder_grow_name_slots( b ) )
+			return DIR_SNAPSHOT_NO_NODE;
+
+	size_t name_len = strlen( name );
+	size_t slot     = (size_t)dir_hash_fnv1a( name, name_len ) & ( b->name_slot_count - 1 );
+	for( ; b->name_slots[slot] != DIR_SNAPSHOT_NO_NODE; slot = ( slot + 1 ) & ( b->name_slot_count - 1 ) )
+	{
+		const char* stored = b->names + b->name_slots[slot];
+		if( memcmp( stored, name, name_len + 1 ) == 0 )
+			return b->name_slots[slot];
+	}
+
+	if( b->names_size + name_len + 1 >= DIR_SNAPSHOT_NO_NODE )
+		return DIR_SNAPSHOT_NO_NODE;
+	if( !dir_array_grow( &b->names, &b->names_capacity, b->names_size + name_len + 1 ) )
+		return DIR_SNAPSHOT_NO_NODE;
+
+	uint32_t offset = (uint32_t)b->names_size;
+	memcpy( b->names + b->names_size, name, name_len + 1 );
+	b->names_size += name_len + 1;
+	b->name_slots[slot] = offset;
+	++b->name_count;
+	return offset;
+}
+
+static bool dir_snapshot_builder_add( dir_snapshot_builder* b, uint32_t parent, const char* name, dir_item_type type, const dir_item_stat* stat )
+{
+	if( b->node_count >= DIR_SNAPSHOT_NO_NODE )
+		return false;
+	if( !dir_array_grow( &b->nodes, &b->node_capacity, b->node_count + 1 ) )
+		return false;
+	uint32_t name_offset = dir_snapshot_builder_intern( b, name );
+	if( name_offset == DIR_SNAPSHOT_NO_NODE )
+		return false;
+
+	dir_snapshot_build_node* node = &b->nodes[b->node_count++];
+	node->size        = stat ? stat->size : 0;
+	node->mtime_ns    = stat ? stat->mtime_ns : 0;
+	node->parent      = parent;
+	node->first_child = 0;
+	node->child_count = 0;
+	node->name_offset = name_offset;
+	node->type        = (uint8_t)type;
+	return true;
+}
+
+/**
+ * Write path of node into *path_buffer after the root already stored there, growing the buffer if needed.
+ * @return DIR_ERROR_OK with the length of the path in *path_len.
+ */
+static dir_error dir_snapshot_builder_path( const dir_snapshot_builder* b, uint32_t node, char** path_buffer, size_t* path_buffer_size, size_t root_len, size_t* path_len )
+{
+	size_t len = root_len;
+	for( uint32_t n = node; n != 0; n = b->nodes[n].parent )
+		len += strlen( b->names + b->nodes[n].name_offset ) + 1;
+	dir_error res = dir_path_buffer_reserve( path_buffer, path_buffer_size, len + 3 );
+	if( res != DIR_ERROR_OK )
+		return res;
+
+	(*path_buffer)[len] = '\0';
+	char* end = *path_buffer + len;
+	for( uint32_t n = node; n != 0; n = b->nodes[n].parent )
+	{
+		const char* name = b->names + b->nodes[n].name_offset;
+		size_t name_len = strlen( name );
+		end -= name_len;
+		memcpy( end, name, name_len );
+		*--end = '/';
+	}
+	*path_len = len;
+	return DIR_ERROR_OK;
+}
+
+/**
+ * Read all dirs under root in breadth first order, appending the children of each dir after all already read nodes.
+ * This makes the children of each dir end up consecutive in the node-array.
+ */
+static dir_error dir_snapshot_build( dir_snapshot_builder* b, const char* root, unsigned int flags )
+{
+	size_t root_len = strlen( root );
+
+	// normalize input path to only strip of trailing / if there is one.
+	if( root_len > 0 && root[root_len-1] == '/' )
+		--root_len;
+
+	char*  path_buffer      = 0x0;
+	size_t path_buffer_size = 0;
+	dir_error res = dir_path_buffer_reserve( &path_buffer, &path_buffer_size, root_len + 3 );
+	if( res != DIR_ERROR_OK )
+		return res;
+	memcpy( path_buffer, root, root_len );
+	path_buffer[root_len] = '\0';
+
+	dir_item_stat root_stat;
+	if( !dir_stat_path( path_buffer, &root_stat ) )
+		res = DIR_ERROR_PATH_DO_NOT_EXIST;
+	else if( !dir_stat_is_dir( &root_stat ) )
+		res = DIR_ERROR_PATH_IS_FILE;
+	else if( !dir_snapshot_builder_add( b, DIR_SNAPSHOT_NO_NODE, "", DIR_ITEM_DIR, &root_stat ) )
+		res = DIR_ERROR_FAILED;
+	if( res != DIR_ERROR_OK )
+	{
+		free( path_buffer );
+		return res;
+	}
+
+	char* read_buffer = dir_reader_alloc_buffer();
+
+	for( size_t i = 0; i < b->node_count && res == DIR_ERROR_OK; ++i )
+	{
+		if( b->nodes[i].type != DIR_ITEM_DIR )
+			continue;
+
+		size_t path_len;
+		res = dir_snapshot_builder_path( b, (uint32_t)i, &path_buffer, &path_buffer_size, root_len, &path_len );
+		if( res != DIR_ERROR_OK )
+			break;
+
+		dir_reader reader;
+		if( !dir_reader_open( &reader, 0x0, path_buffer, path_len, 0, read_buffer, dir_reader_buffer_size() ) )
+			continue; // removed while building or no access, store as empty.
+
+		size_t first_child = b->node_count;
+		dir_reader_entry ent;
+		while( dir_reader_next( &reader, &ent ) )
+		{
+			dir_item_type        item_type;
+			dir_item_stat        item_stat;
+			const dir_item_stat* item_stat_ptr;
+			if( !dir_walk_resolve_entry( &reader, &ent, flags, &item_type, &item_stat, &item_stat_ptr, 0x0 ) )
+				continue;
+
+			if( !dir_snapshot_builder_add( b, (uint32_t)i, ent.name, item_type, item_stat_ptr ) )
+			{
+				res = DIR_ERROR_FAILED;
+				break;
+			}
+		}
+		dir_reader_close( &reader );
+
+		const char* names = b->names;
+		std::sort( b->nodes + first_child, b->nodes + b->node_count,
+			[names]( const dir_snapshot_build_node& n1, const dir_snapshot_build_node& n2 ) {
+				return strcmp( names + n1.name_offset, names + n2.name_offset ) < 0;
+			});
+
+		b->nodes[i].first_child = (uint32_t)first_child;
+		b->nodes[i].child_count = (uint32_t)( b->node_count - first_child );
+	}
+
+	free( read_buffer );
+	free( path_buffer );
+	return res;
+}
+
+static uint64_t dir_align8( uint64_t v )
+{
+	return ( v + 7 ) & ~(uint64_t)7;
+}
+
+/**
+ * Pack all nodes in builder into one allocation in the same layout as a snapshot-file, placed prefix_size bytes
+ * into the allocation. size and mtime is only stored with DIR_WALK_WITH_STAT in flags.
+ * @return allocation to free with free() or 0x0 on failure.
+ */
+static uint8_t* dir_snapshot_builder_pack( const dir_snapshot_builder* b, unsigned int flags, size_t prefix_size, uint64_t* out_size )
+{
+	uint64_t n = (uint64_t)b->node_count;
+	bool with_stat = ( flags & DIR_WALK_WITH_STAT ) > 0;
+
+	dir_snapshot_header header;
+	memset( &header, 0x0, sizeof( header ) );
+	header.magic              = DIR_SNAPSHOT_MAGIC;
+	header.version            = DIR_SNAPSHOT_VERSION;
+	header.flags              = flags & ( DIR_WALK_IGNORE_DOT_ITEMS | DIR_WALK_WITH_STAT );
+	header.node_count         = (uint32_t)n;
+	header.names_size         = b->names_size;
+	header.parent_offset      = sizeof( dir_snapshot_header );
+	header.first_child_offset = header.parent_offset      + n * sizeof( uint32_t );
+	header.child_count_offset = header.first_child_offset + n * sizeof( uint32_t );
+	header.name_offset_offset = header.child_count_offset + n * sizeof( uint32_t );
+	header.type_offset        = header.name_offset_offset + n * sizeof( uint32_t );
+	header.names_offset       = header.type_offset        + n;
+	if( with_stat )
+	{
+		header.size_offset    = dir_align8( header.type_offset + n );
+		header.mtime_offset   = header.size_offset        + n * sizeof( uint64_t );
+		header.names_offset   = header.mtime_offset       + n * sizeof( uint64_t );
+	}
+	header.file_size          = header.names_offset       + header.names_size;
+
+	uint8_t* alloc = (uint8_t*)malloc( prefix_size + (size_t)header.file_size );
+	if( alloc == 0x0 )
+		return 0x0;
+	uint8_t* data = alloc + prefix_size;
+	memset( data, 0x0, (size_t)header.file_size );
+	memcpy( data, &header, sizeof( header ) );
+
+	uint32_t* parent      = (uint32_t*)( data + header.parent_offset );
+	uint32_t* first_child = (uint32_t*)( data + header.first_child_offset );
+	uint32_t* child_count = (uint32_t*)( data + header.child_count_offset );
+	uint32_t* name_offset = (uint32_t*)( data + header.name_offset_offset );
+	uint8_t*  type        = (uint8_t*) ( data + header.type_offset );
+	for( size_t i = 0; i < b->node_count; ++i )
+	{
+		const dir_snapshot_build_node* node = &b->nodes[i];
+		parent[i]      = node->parent;
+		first_child[i] = node->first_child;
+		child_count[i] = node->child_count;
+		name_offset[i] = node->name_offset;
+		type[i]        = node->type;
+	}
+	if( with_stat )
+	{
+		uint64_t* size     = (uint64_t*)( data + header.size_offset );
+		uint64_t* mtime_ns = (uint64_t*)( data + header.mtime_offset );
+		for( size_t i = 0; i < b->node_count; ++i )
+		{
+			size[i]     = b->nodes[i].size;
+			mtime_ns[i] = b->nodes[i].mtime_ns;
+		}
+	}
+	memcpy( data + header.names_offset, b->names, b->names_size );
+
+	*out_size = header.file_size;
+	return alloc;
+}
+
+static dir_error dir_snapshot_builder_write( const dir_snapshot_builder* b, unsigned int flags, const char* snapshot_path )
+{
+	uint64_t data_size;
+	uint8_t* data = dir_snapshot_builder_pack( b, flags | DIR_WALK_WITH_STAT, 0, &data_size );
+	if( data == 0x0 )
+		return DIR_ERROR_FAILED;
+
+	const void* chunks[]      = { data };
+	const size_t chunk_size[] = { (size_t)data_size };
+	dir_error res = dir_write_file_atomic( snapshot_path, chunks, chunk_size, 1 );
+	free( data );
+	return res;
+}
+
+/**
+ * Copy path to path_buffer, stripping a trailing '/'.
+ * @return length of path in path_buffer or 0 if it did not fit.
+ */
+static size_t dir_copy_root_path( const char* path, char* path_buffer, size_t path_buffer_size )
+{
+	size_t path_len = strlen( path );
+
+	// normalize input path to only strip of trailing / if there is one.
+	if( path_len > 0 && path[path_len-1] == '/' )
+		--path_len;
+
+	if( path_len + 3 > path_buffer_size )
+		return 0;
+	memcpy( path_buffer, path, path_len );
+	path_buffer[path_len] = '\0';
+	return path_len;
+}
+
+/**
+ * One open directory in the stack of a dir_iter.
+ */
+struct dir_iter_frame
+{
+	dir_reader    reader;
+	size_t        path_len;
+	size_t        name_offset;
+
+	// dirs read in full, see dir_walk_read_in_full(), are read on push to the sort-buffer at the same depth as
+	// the frame.
+	bool          buffered;
+	size_t        next_buffered;
+
+	// metadata of the dir itself, reported after all items in it with DIR_WALK_DEPTH_FIRST.
+	dir_item_stat stat;
+	bool          has_stat;
+};
+
+struct dir_iter
+{
+	dir_walk_ctx    walk;
+	dir_iter_frame* frames;
+	size_t          num_frames;
+	size_t          frames_capacity;
+
+	// item last returned is a dir that is opened on the next call.
+	bool            open_item;
+	dir_error       error;
+	dir_walk_item   item;
+	dir_item_stat   item_stat;
+
+	// initial path-buffer of walk, before it grows.
+	char            path_buffer[4096];
+};
+
+/**
+ * Open dir at the end of the path-buffer and push it to the stack.
+ */
+static bool dir_iter_push( dir_iter* iter, size_t path_len, size_t name_offset, const dir_item_stat* stat )
+{
+	if( !dir_walk_path_reserve( &iter->walk, path_len + 3 ) )
+	{
+		iter->error = DIR_ERROR_PATH_TO_DEEP;
+		return false;
+	}
+	if( !dir_array_grow( &iter->frames, &iter->frames_capacity, iter->num_frames + 1 ) )
+	{
+		iter->error = DIR_ERROR_FAILED;
+		return false;
+	}
+
+	dir_iter_frame* frame = &iter->frames[iter->num_frames];
+	const dir_reader* parent = iter->num_frames > 0 ? &iter->frames[iter->num_frames - 1].reader : 0x0;
+	char* read_buffer = dir_walk_read_buffer( &iter->walk, iter->num_frames );
+	if( !dir_reader_open( &frame->reader, parent, iter->walk.path_buffer, path_len, name_offset, read_buffer, dir_reader_buffer_size() ) )
+		return false;
+
+	frame->buffered      = false;
+	frame->next_buffered = 0;
+	if( dir_walk_read_in_full( &iter->walk ) )
+	{
+		if( dir_walk_read_all( &iter->walk, &frame->reader, iter->num_frames ) == 0x0 )
+		{
+			dir_reader_close( &frame->reader );
+			iter->error = DIR_ERROR_FAILED;
+			return false;
+		}
+		frame->buffered = true;
+	}
+
+	frame->path_len    = path_len;
+	frame->name_offset = name_offset;
+	frame->has_stat    = stat != 0x0;
+	if( stat != 0x0 )
+		frame->stat = *stat;
+	++iter->num_frames;
+	return true;
+}
+
+dir_error dir_iter_open( const char* root, unsigned int flags, dir_iter** out_iter )
+{
+	*out_iter = 0x0;
+
+	dir_iter* iter = new (std::nothrow) dir_iter;
+	if( iter == 0x0 )
+		return DIR_ERROR_FAILED;
+
+	iter->walk.flags            = flags;
+	iter->walk.callback         = 0x0;
+	iter->walk.userdata         = 0x0;
+	iter->walk.path_buffer      = iter->path_buffer;
+	iter->walk.path_buffer_size = sizeof( iter->path_buffer );
+	dir_walk_init_buffers( &iter->walk );
+	iter->walk.stats            = 0x0;
+	iter->frames          = 0x0;
+	iter->num_frames      = 0;
+	iter->frames_capacity = 0;
+	iter->open_item       = false;
+	iter->error           = DIR_ERROR_OK;
+
+	dir_error res = DIR_ERROR_OK;
+	if( !dir_walk_copy_root( &iter->walk, root ) )
+		res = DIR_ERROR_PATH_TO_DEEP;
+	else if( !dir_iter_push( iter, iter->walk.root_len, 0, 0x0 ) )
+		res = iter->error != DIR_ERROR_OK ? iter->error : DIR_ERROR_PATH_DO_NOT_EXIST;
+
+	if( res != DIR_ERROR_OK )
+	{
+		dir_iter_close( iter );
+		return res;
+	}
+	*out_iter = iter;
+	return DIR_ERROR_OK;
+}
+
+const dir_walk_item* dir_iter_next( dir_iter* iter )
+{
+	bool depth_first = ( iter->walk.flags & DIR_WALK_DEPTH_FIRST ) > 0;
+
+	// the dir returned last time is entered now so that nothing is read if the caller stops.
+	if( iter->open_item )
+	{
+		iter->open_item = false;
+		dir_iter_push( iter, strlen( iter->walk.path_buffer ), (size_t)( iter->item.name - iter->walk.path_buffer ), 0x0 );
+	}
+
+	while( iter->num_frames > 0 )
+	{
+		// fetched every time as pushing a dir might move the path-buffer.
+		char* path_buffer = iter->walk.path_buffer;
+		dir_iter_frame* frame = &iter->frames[iter->num_frames - 1];
+		size_t path_len = frame->path_len;
+		const dir_sort_buffer* buffered = frame->buffered ? iter->walk.sort_buffers[iter->num_frames - 1] : 0x0;
+
+		const char*          item_name;
+		dir_item_type        item_type;
+		const dir_item_stat* item_stat;
+		if( !dir_walk_next_entry( &iter->walk, &frame->reader, buffered, &frame->next_buffered, &item_name, &item_type, &iter->item_stat, &item_stat ) )
+		{
+			dir_reader_close( &frame->reader );
+			--iter->num_frames;
+			path_buffer[path_len] = '\0';
+
+			// the root is not an item in the walk.
+			if( !depth_first || iter->num_frames == 0 )
+				continue;
+
+			iter->item.path     = path_buffer;
+			iter->item.relative = path_buffer + iter->walk.root_len + 1;
+			iter->item.name     = path_buffer + frame->name_offset;
+			iter->item.type     = DIR_ITEM_DIR;
+			iter->item.stat     = 0x0;
+			iter->item.userdata = 0x0;
+			if( frame->has_stat )
+			{
+				iter->item_stat = frame->stat;
+				iter->item.stat = &iter->item_stat;
+			}
+			return &iter->item;
+		}
+
+		size_t item_len = strlen( item_name );
+		if( !dir_walk_path_reserve( &iter->walk, path_len + item_len + 2 ) )
+		{
+			iter->error = DIR_ERROR_PATH_TO_DEEP;
+			continue;
+		}
+
+		path_buffer = iter->walk.path_buffer;
+		path_buffer[path_len] = '/';
+		memcpy( &path_buffer[path_len + 1], item_name, item_len + 1 );
+
+		// with DIR_WALK_DEPTH_FIRST dirs are reported when popped, or directly if they can not be opened.
+		if( item_type == DIR_ITEM_DIR && depth_first && dir_iter_push( iter, path_len + item_len + 1, path_len + 1, item_stat ) )
+			continue;
+		path_buffer = iter->walk.path_buffer;
+
+		iter->item.path     = path_buffer;
+		iter->item.relative = path_buffer + iter->walk.root_len + 1;
+		iter->item.name     = path_buffer + path_len + 1;
+		iter->item.type     = item_type;
+		iter->item.stat     = item_stat;
+		iter->item.userdata = 0x0;
+		iter->open_item     = item_type == DIR_ITEM_DIR && !depth_first;
+		return &iter->item;
+	}
+	return 0x0;
+}
+
+void dir_iter_skip_subtree( dir_iter* iter )
+{
+	iter->open_item = false;
+}
+
+dir_error dir_iter_error( const dir_iter* iter )
+{
+	return iter->error;
+}
+
+void dir_iter_close( dir_iter* iter )
+{
+	for( size_t i = 0; i < iter->num_frames; ++i )
+		dir_reader_close( &iter->frames[i].reader );
+	dir_walk_free_buffers( &iter->walk );
+	free( iter->frames );
+	delete iter;
+}
+
+#if defined( DIRUTIL_IO_URING )
+enum dir_walk_uring_op_type
+{
+	DIR_WALK_URING_OPEN,
+	DIR_WALK_URING_STAT
+};
+
+/**
+ * One operation in flight, or waiting to be submitted, with the path it operates on.
+ */
+struct dir_walk_uring_op
+{
+	dir_walk_uring_op_type type;
+	dir_entry_type         entry_type;
+	struct statx           stx;
+	size_t                 path_len;
+	size_t                 name_offset;
+	char                   path[1];
+};
+
+struct dir_walk_uring_ctx
+{
+	unsigned int       flags;
+	dir_walk_callback  callback;
+	void*              userdata;
+	size_t             root_len;
+
+	// ops waiting for a free submission entry, used as a stack to walk mostly depth first and keep it short.
+	dir_walk_uring_op** backlog;
+	size_t              backlog_size;
+	size_t              backlog_capacity;
+
+	char*               read_buffer;
+	char*               path_buffer;
+	size_t              path_buffer_size;
+	dir_error           error;
+};
+
+static dir_walk_uring_op* dir_walk_uring_push( dir_walk_uring_ctx* ctx, dir_walk_uring_op_type type, dir_entry_type entry_type, const char* path, size_t path_len, size_t name_offset )
+{
+	if( !dir_array_grow( &ctx->backlog, &ctx->backlog_capacity, ctx->backlog_size + 1 ) )
+		return 0x0;
+	dir_walk_uring_op* op = (dir_walk_uring_op*)malloc( sizeof( dir_walk_uring_op ) + path_len );
+	if( op == 0x0 )
+		return 0x0;
+	op->type        = type;
+	op->entry_type  = entry_type;
+	op->path_len    = path_len;
+	op->name_offset = name_offset;
+	memcpy( op->path, path, path_len + 1 );
+	ctx->backlog[ctx->backlog_size++] = op;
+	return op;
+}
+
+/**
+ * Report item of type at path and queue it to be read if it is a dir.
+ */
+static void dir_walk_uring_report( dir_walk_uring_ctx* ctx, const char* path, size_t path_len, size_t name_offset, dir_item_type type, const dir_item_stat* stat )
+{
+	if( ctx->error != DIR_ERROR_OK )
+		return;
+
+	if( path[name_offset] == '.' && dir_walk_skip_dot( type, ctx->flags ) )
+		return;
+
+	dir_walk_item item;
+	item.path     = path;
+	item.relative = path + ctx->root_len + 1;
+	item.name     = path + name_offset;
+	item.type     = type;
+	item.stat     = stat;
+	item.userdata = ctx->userdata;
+	int cb_res = ctx->callback( &item );
+	if( cb_res == DIR_WALK_ABORT )
+	{
+		ctx->error = DIR_ERROR_ABORTED;
+		return;
+	}
+
+	if( type == DIR_ITEM_DIR && cb_res != DIR_WALK_SKIP_SUBTREE && dir_walk_uring_push( ctx, DIR_WALK_URING_OPEN, DIR_ENTRY_DIR, path, path_len, name_offset ) == 0x0 )
+		ctx->error = DIR_ERROR_FAILED;
+}
+
+/**
+ * Read all entries in the opened dir, report the ones that are known without a stat and queue a stat for the rest.
+ */
+static void dir_walk_uring_read_dir( dir_walk_uring_ctx* ctx, const dir_walk_uring_op* dir, int fd )
+{
+	dir_reader reader;
+	if( !dir_reader_open_fd( &reader, fd, ctx->read_buffer, dir_reader_buffer_size() ) )
+		return;
+
+	dir_error reserved = dir_path_buffer_reserve( &ctx->path_buffer, &ctx->path_buffer_size, dir->path_len + 2 );
+	if( reserved != DIR_ERROR_OK && ctx->error == DIR_ERROR_OK )
+		ctx->error = reserved;
+	if( ctx->error == DIR_ERROR_OK )
+	{
+		memcpy( ctx->path_buffer, dir->path, dir->path_len );
+		ctx->path_buffer[dir->path_len] = '/';
+	}
+
+	dir_reader_entry ent;
+	while( ctx->error == DIR_ERROR_OK && dir_reader_next( &reader, &ent ) )
+	{
+		if( ent.name[0] == '.' && ( ctx->flags & DIR_WALK_IGNORE_DOT_ITEMS ) == DIR_WALK_IGNORE_DOT_ITEMS )
+			continue;
+
+		size_t item_len = strlen( ent.name );
+		size_t path_len = dir->path_len + 1 + item_len;
+		ctx->error = dir_path_buffer_reserve( &ctx->path_buffer, &ctx->path_buffer_size, path_len + 1 );
+		if( ctx->error != DIR_ERROR_OK )
+			break;
+		char* path_buffer = ctx->path_buffer;
+		memcpy( path_buffer + dir->path_len + 1, ent.name, item_len + 1 );
+
+		bool needs_stat = ent.type == DIR_ENTRY_UNKNOWN || ( ctx->flags & DIR_WALK_WITH_STAT ) > 0;
+		if( needs_stat && path_len < PATH_MAX )
+		{
+			if( dir_walk_uring_push( ctx, DIR_WALK_URING_STAT, ent.type, path_buffer, path_len, dir->path_len + 1 ) == 0x0 )
+				ctx->error = DIR_ERROR_FAILED;
+		}
+		else if( needs_stat )
+		{
+			// the kernel can not resolve paths this long in one go, stat relative to the open dir instead.
+			dir_item_type        item_type;
+			dir_item_stat        item_stat;
+			const dir_item_stat* item_stat_ptr;
+			if( dir_walk_resolve_entry( &reader, &ent, ctx->flags, &item_type, &item_stat, &item_stat_ptr, 0x0 ) )
+				dir_walk_uring_report( ctx, path_buffer, path_len, dir->path_len + 1, item_type, item_stat_ptr );
+		}
+		else
+			dir_walk_uring_report( ctx, path_buffer, path_len, dir->path_len + 1, ent.type == DIR_ENTRY_DIR ? DIR_ITEM_DIR : DIR_ITEM_FILE, 0x0 );
+	}
+	dir_reader_close( &reader );
+}
+
+/**
+ * Handle completed op, op is freed.
+ */
+static void dir_walk_uring_complete( dir_walk_uring_ctx* ctx, dir_walk_uring_op* op, int res )
+{
+	if( op->type == DIR_WALK_URING_OPEN )
+	{
+		if( res == -ENAMETOOLONG )
+			res = dir_open_dir_path( op->path, op->path_len );
+		if( res >= 0 )
+			dir_walk_uring_read_dir( ctx, op, res );
+		else if( op->name_offset == 0 )
+			ctx->error = DIR_ERROR_PATH_DO_NOT_EXIST;
+	}
+	else
+	{
+		// same fallbacks as dir_walk_resolve_entry() if the stat failed.
+		dir_item_stat stat;
+		const dir_item_stat* stat_ptr = 0x0;
+		if( res == 0 )
+		{
+			dir_stat_from_statx( &op->stx, &stat );
+			if( ( ctx->flags & DIR_WALK_WITH_STAT ) > 0 )
+				stat_ptr = &stat;
+		}
+
+		dir_item_type type;
+		if( op->entry_type != DIR_ENTRY_UNKNOWN )
+			type = op->entry_type == DIR_ENTRY_DIR ? DIR_ITEM_DIR : DIR_ITEM_FILE;
+		else
+			type = res == 0 && dir_stat_is_dir( &stat ) ? DIR_ITEM_DIR : DIR_ITEM_FILE;
+		dir_walk_uring_report( ctx, op->path, op->path_len, op->name_offset, type, stat_ptr );
+	}
+	free( op );
+}
+
+/**
+ * Walk with io_uring.
+ * @return false if io_uring could not be used.
+ */
+static bool dir_walk_uring( dir_walk_uring_ctx* ctx, const char* path, size_t path_len, unsigned int queue_depth, dir_error* res )
+{
+	dir_uring ring;
+	if( !dir_uring_init( &ring, queue_depth ) )
+		return false;
+
+	ctx->backlog          = 0x0;
+	ctx->backlog_size     = 0;
+	ctx->backlog_capacity = 0;
+	ctx->read_buffer      = dir_reader_alloc_buffer();
+	ctx->error            = DIR_ERROR_OK;
+
+	// name_offset 0 marks the root, the path is copied so path_buffer can be reused while reading dirs.
+	if( dir_walk_uring_push( ctx, DIR_WALK_URING_OPEN, DIR_ENTRY_DIR, path, path_len, 0 ) == 0x0 )
+		ctx->error = DIR_ERROR_FAILED;
+
+	unsigned int in_flight = 0;
+	while( ctx->backlog_size > 0 || in_flight > 0 )
+	{
+		while( ctx->backlog_size > 0 && in_flight < queue_depth && ctx->error == DIR_ERROR_OK )
+		{
+			io_uring_sqe* sqe = dir_uring_get_sqe( &ring );
+			if( sqe == 0x0 )
+				break;
+
+			dir_walk_uring_op* op = ctx->backlog[--ctx->backlog_size];
+			sqe->fd        = AT_FDCWD;
+			sqe->addr      = (uint64_t)(uintptr_t)op->path;
+			sqe->user_data = (uint64_t)(uintptr_t)op;
+			if( op->type == DIR_WALK_URING_OPEN )
+			{
+				sqe->opcode     = IORING_OP_OPENAT;
+				sqe->open_flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+			}
+			else
+			{
+				sqe->opcode = IORING_OP_STATX;
+				sqe->len    = DIR_STATX_MASK;
+				sqe->off    = (uint64_t)(uintptr_t)&op->stx;
+			}
+			++in_flight;
+		}
+
+		if( in_flight == 0 )
+			break; // only after an error.
+
+		// submit everything not yet consumed by the kernel, including what a previous interrupted call left.
+		unsigned int to_submit = *ring.sq_tail - __atomic_load_n( ring.sq_head, __ATOMIC_ACQUIRE );
+		long entered = syscall( __NR_io_uring_enter, ring.fd, to_submit, 1, IORING_ENTER_GETEVENTS, 0x0, 0 );
+		if( entered < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY )
+		{
+			// ops in flight might still be written to by the kernel, leak them rather than risking that.
+			ctx->error = DIR_ERROR_FAILED;
+			ctx->backlog_size = 0;
+			in_flight = 0;
+			break;
+		}
+
+		unsigned head = *ring.cq_head;
+		unsigned tail = __atomic_load_n( ring.cq_tail, __ATOMIC_ACQUIRE );
+		for( ; head != tail; ++head )
+		{
+			io_uring_cqe* cqe = &ring.cqes[head & *ring.cq_mask];
+			dir_walk_uring_op* op = (dir_walk_uring_op*)(uintptr_t)cqe->user_data;
+			int op_res = cqe->res;
+			__atomic_store_n( ring.cq_head, head + 1, __ATOMIC_RELEASE );
+			--in_flight;
+			dir_walk_uring_complete( ctx, op, op_res );
+		}
+	}
+
+	for( size_t i = 0; i < ctx->backlog_size; ++i )
+		free( ctx->backlog[i] );
+	free( ctx->backlog );
+	free( ctx->read_buffer );
+	dir_uring_destroy( &ring );
+	*res = ctx->error;
+	return true;
+}
+#endif
+
+dir_error dir_walk_async( const char* path, unsigned int flags, unsigned int queue_depth, dir_walk_callback callback, void* userdata )
+{
+#if defined( DIRUTIL_IO_URING )
+	if( ( flags & DIR_WALK_DEPTH_FIRST ) == 0 )
+	{
+		dir_walk_uring_ctx* ctx = new (std::nothrow) dir_walk_uring_ctx;
+		if( ctx == 0x0 )
+			return DIR_ERROR_FAILED;
+
+		size_t path_len = strlen( path );
+		ctx->path_buffer      = 0x0;
+		ctx->path_buffer_size = 0;
+		dir_error reserved = dir_path_buffer_reserve( &ctx->path_buffer, &ctx->path_buffer_size, path_len + 3 );
+		if( reserved != DIR_ERROR_OK )
+		{
+			delete ctx;
+			return reserved;
+		}
+		path_len = dir_copy_root_path( path, ctx->path_buffer, ctx->path_buffer_size );
+
+		ctx->flags    = flags;
+		ctx->callback = callback;
+		ctx->userdata = userdata;
+		ctx->root_len = path_len;
+
+		if( queue_depth == 0 )
+			queue_depth = 64;
+		if( queue_depth > 4096 )
+			queue_depth = 4096;
+
+		dir_error res;
+		bool walked = dir_walk_uring( ctx, ctx->path_buffer, path_len, queue_depth, &res );
+		free( ctx->path_buffer );
+		delete ctx;
+		if( walked )
+			return res;
+	}
+#endif
+	// ... fallback to keeping one read in flight per thread.
+	(void)queue_depth;
+	return dir_walk_parallel( path, flags, 0, callback, userdata );
+}
+
+dir_error dir_snapshot_write( const char* root, unsigned int flags, const char* snapshot_path )
+{
+	dir_snapshot_builder b;
+	memset( &b, 0x0, sizeof( b ) );
+
+	dir_error res = dir_snapshot_build( &b, root, flags | DIR_WALK_WITH_STAT );
+	if( res == DIR_ERROR_OK )
+		res = dir_snapshot_builder_write( &b, flags, snapshot_path );
+
+	dir_snapshot_builder_free( &b );
+	return res;
+}
+
+/**
+ * Check that an array of count items of elem_size, at offset in a snapshot, is aligned and within data_size.
+ * Written to not overflow for offsets and counts read from a corrupt file.
+ */
+static bool dir_snapshot_array_valid( uint64_t offset, uint64_t count, uint64_t elem_size, size_t data_size )
+{
+	return offset <= data_size && count <= ( data_size - offset ) / elem_size && ( offset & ( elem_size - 1 ) ) == 0;
+}
+
+/**
+ * Setup snapshot from the data in a mapped snapshot-file and validate that all indices in it are in range.
+ */
+static bool dir_snapshot_load( dir_snapshot* snap, const uint8_t* data, size_t data_size )
+{
+	if( data_size < sizeof( dir_snapshot_header ) )
+		return false;
+
+	dir_snapshot_header h;
+	memcpy( &h, data, sizeof( h ) );
+	if( h.magic != DIR_SNAPSHOT_MAGIC || h.version != DIR_SNAPSHOT_VERSION || h.file_size != data_size || h.node_count == 0 )
+		return false;
+
+	uint64_t n = h.node_count;
+	if( !dir_snapshot_array_valid( h.parent_offset,      n, sizeof( uint32_t ), data_size ) ||
+		!dir_snapshot_array_valid( h.first_child_offset, n, sizeof( uint32_t ), data_size ) ||
+		!dir_snapshot_array_valid( h.child_count_offset, n, sizeof( uint32_t ), data_size ) ||
+		!dir_snapshot_array_valid( h.name_offset_offset, n, sizeof( uint32_t ), data_size ) ||
+		!dir_snapshot_array_valid( h.type_offset,        n, sizeof( uint8_t ),  data_size ) ||
+		!dir_snapshot_array_valid( h.size_offset,        n, sizeof( uint64_t ), data_size ) ||
+		!dir_snapshot_array_valid( h.mtime_offset,       n, sizeof( uint64_t ), data_size ) ||
+		!dir_snapshot_array_valid( h.names_offset, h.names_size, sizeof( char ), data_size ) || h.names_size == 0 ||
+		( h.size_offset == 0 ) != ( h.mtime_offset == 0 ) )
+		return false;
+
+	snap->flags       = h.flags;
+	snap->node_count  = h.node_count;
+	snap->parent      = (const uint32_t*)( data + h.parent_offset );
+	snap->first_child = (const uint32_t*)( data + h.first_child_offset );
+	snap->child_count = (const uint32_t*)( data + h.child_count_offset );
+	snap->name_offset = (const uint32_t*)( data + h.name_offset_offset );
+	snap->type        = (const uint8_t*) ( data + h.type_offset );
+	snap->size        = h.size_offset  != 0 ? (const uint64_t*)( data + h.size_offset )  : 0x0;
+	snap->mtime_ns    = h.mtime_offset != 0 ? (const uint64_t*)( data + h.mtime_offset ) : 0x0;
+	snap->names       = (const char*)    ( data + h.names_offset );
+
+	if( snap->names[h.names_size - 1] != '\0' || snap->type[0] != DIR_ITEM_DIR )
+		return false;
+
+	for( uint32_t i = 0; i < h.node_count; ++i )
+	{
+		if( snap->name_offset[i] >= h.names_size )
+			return false;
+		if( i > 0 && snap->parent[i] >= i )
+			return false;
+		if( snap->type[i] != DIR_ITEM_DIR && snap->type[i] != DIR_ITEM_FILE )
+			return false;
+		if( snap->type[i] == DIR_ITEM_FILE && snap->child_count[i] != 0 )
+			return false;
+		if( snap->child_count[i] > 0 &&
+			( snap->first_child[i] <= i || (uint64_t)snap->first_child[i] + snap->child_count[i] > n ) )
+			return false;
+	}
+	return true;
+}
+
+/**
+ * Find child of node by name, children are sorted by name so this is a binary search.
+ * @return index of child or DIR_SNAPSHOT_NO_NODE.
+ */
+static uint32_t dir_snapshot_find_child( const dir_snapshot* snap, uint32_t node, const char* name )
+{
+	if( snap->type[node] != DIR_ITEM_DIR )
+		return DIR_SNAPSHOT_NO_NODE;
+
+	uint32_t lo = snap->first_child[node];
+	uint32_t hi = lo + snap->child_count[node];
+	while( lo < hi )
+	{
+		uint32_t mid = lo + ( hi - lo ) / 2;
+		int cmp = strcmp( snap->names + snap->name_offset[mid], name );
+		if( cmp == 0 )
+			return mid;
+		if( cmp < 0 )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return DIR_SNAPSHOT_NO_NODE;
+}
+
+/**
+ * A built dir_tree is one allocation, the dir_tree itself followed by the nodes in the same layout as a
+ * snapshot-file. A tree opened with dir_tree_open() instead points into the mapped file.
+ */
+struct dir_tree
+{
+	dir_snapshot    snap;
+	const uint8_t*  data;
+	size_t          data_size;
+	bool            mapped;
+	dir_mapped_file file;
+};
+
+dir_error dir_tree_build( const char* root, unsigned int flags, dir_tree** tree )
+{
+	*tree = 0x0;
+
+	dir_snapshot_builder b;
+	memset( &b, 0x0, sizeof( b ) );
+
+	dir_error res = dir_snapshot_build( &b, root, flags );
+	if( res == DIR_ERROR_OK )
+	{
+		size_t   prefix_size = (size_t)dir_align8( sizeof( dir_tree ) );
+		uint64_t data_size;
+		uint8_t* alloc = dir_snapshot_builder_pack( &b, flags, prefix_size, &data_size );
+		if( alloc == 0x0 )
+			res = DIR_ERROR_FAILED;
+		else
+		{
+			dir_tree* t = new ( alloc ) dir_tree;
+			t->data      = alloc + prefix_size;
+			t->data_size = (size_t)data_size;
+			t->mapped    = false;
+			if( dir_snapshot_load( &t->snap, t->data, t->data_size ) )
+				*tree = t;
+			else
+			{
+				free( alloc );
+				res = DIR_ERROR_FAILED;
+			}
+		}
+	}
+
+	dir_snapshot_builder_free( &b );
+	return res;
+}
+
+dir_error dir_tree_write( const dir_tree* tree, const char* tree_path )
+{
+	const void* chunks[]      = { tree->data };
+	const size_t chunk_size[] = { tree->data_size };
+	return dir_write_file_atomic( tree_path, chunks, chunk_size, 1 );
+}
+
+dir_error dir_tree_open( const char* tree_path, dir_tree** tree )
+{
+	*tree = 0x0;
+
+	void* mem = malloc( sizeof( dir_tree ) );
+	if( mem == 0x0 )
+		return DIR_ERROR_FAILED;
+	dir_tree* t = new ( mem ) dir_tree;
+
+	if( !dir_map_file( tree_path, &t->file ) )
+	{
+		free( mem );
+		return DIR_ERROR_PATH_DO_NOT_EXIST;
+	}
+
+	t->data      = t->file.data;
+	t->data_size = t->file.size;
+	t->mapped    = true;
+	if( !dir_snapshot_load( &t->snap, t->data, t->data_size ) )
+	{
+		dir_unmap_file( &t->file );
+		free( mem );
+		return DIR_ERROR_FAILED;
+	}
+
+	*tree = t;
+	return DIR_ERROR_OK;
+}
+
+void dir_tree_free( dir_tree* tree )
+{
+	if( tree == 0x0 )
+		return;
+	if( tree->mapped )
+		dir_unmap_file( &tree->file );
+	tree->~dir_tree();
+	free( tree );
+}
+
+uint32_t dir_tree_node_count( const dir_tree* tree )
+{
+	return tree->snap.node_count;
+}
+
+uint32_t dir_tree_parent( const dir_tree* tree, uint32_t node )
+{
+	return node == 0 ? DIR_TREE_NO_NODE : tree->snap.parent[node];
+}
+
+const char* dir_tree_name( const dir_tree* tree, uint32_t node )
+{
+	return tree->snap.names + tree->snap.name_offset[node];
+}
+
+dir_item_type dir_tree_type( const dir_tree* tree, uint32_t node )
+{
+	return (dir_item_type)tree->snap.type[node];
+}
+
+uint64_t dir_tree_size( const dir_tree* tree, uint32_t node )
+{
+	return tree->snap.size != 0x0 ? tree->snap.size[node] : 0;
+}
+
+uint64_t dir_tree_mtime( const dir_tree* tree, uint32_t node )
+{
+	return tree->snap.mtime_ns != 0x0 ? tree->snap.mtime_ns[node] : 0;
+}
+
+uint32_t dir_tree_children( const dir_tree* tree, uint32_t node, uint32_t* first_child )
+{
+	*first_child = tree->snap.first_child[node];
+	return tree->snap.child_count[node];
+}
+
+uint32_t dir_tree_find_child( const dir_tree* tree, uint32_t node, const char* name )
+{
+	return dir_snapshot_find_child( &tree->snap, node, name );
+}
+
+uint32_t dir_tree_find( const dir_tree* tree, const char* relative )
+{
+	char name[256];
+	uint32_t node = 0;
+	const char* curr = relative;
+	while( node != DIR_TREE_NO_NODE )
+	{
+		while( *curr == '/' )
+			++curr;
+		if( *curr == '\0' )
+			return node;
+
+		const char* end = strchr( curr, '/' );
+		size_t name_len = end ? (size_t)( end - curr ) : strlen( curr );
+		if( name_len >= sizeof( name ) )
+			return DIR_TREE_NO_NODE;
+		memcpy( name, curr, name_len );
+		name[name_len] = '\0';
+
+		node = dir_snapshot_find_child( &tree->snap, node, name );
+		curr += name_len;
+	}
+	return DIR_TREE_NO_NODE;
+}
+
+size_t dir_tree_path( const dir_tree* tree, uint32_t node, char* buffer, size_t buffer_size )
+{
+	const dir_snapshot* snap = &tree->snap;
+
+	size_t path_len = 0;
+	for( uint32_t n = node; n != 0; n = snap->parent[n] )
+		path_len += strlen( snap->names + snap->name_offset[n] ) + ( path_len > 0 ? 1 : 0 );
+	if( path_len + 1 > buffer_size )
+		return path_len;
+
+	buffer[path_len] = '\0';
+	char* end = buffer + path_len;
+	for( uint32_t n = node; n != 0; n = snap->parent[n] )
+	{
+		if( end != buffer + path_len )
+			*--end = '/';
+		const char* name = snap->names + snap->name_offset[n];
+		size_t name_len = strlen( name );
+		end -= name_len;
+		memcpy( end, name, name_len );
+	}
+	return path_len;
+}
+
+struct dir_changes_ctx
+{
+	const dir_snapshot* snap;
+	dir_change_callback callback;
+	void*               userdata;
+	size_t              root_len;
+	char*               path_buffer;
+	size_t              path_buffer_size;
+
+	// set when the callback abort the walk or on error.
+	bool                aborted;
+
+	// first error that stopped the walk, the set of changes is not complete if this is not DIR_ERROR_OK.
+	dir_error           error;
+};
+
+static void dir_changes_fail( dir_changes_ctx* ctx, dir_error err )
+{
+	if( ctx->error == DIR_ERROR_OK )
+		ctx->error = err;
+	ctx->aborted = true;
+}
+
+/**
+ * @return what the callback returned.
+ */
+static int dir_changes_report( dir_changes_ctx* ctx, dir_change_type change, size_t name_offset, dir_item_type type, const dir_item_stat* stat )
+{
+	dir_walk_item item;
+	item.path     = ctx->path_buffer;
+	item.relative = ctx->path_buffer + ctx->root_len + 1;
+	item.name     = ctx->path_buffer + name_offset;
+	item.type     = type;
+	item.stat     = stat;
+	item.userdata = ctx->userdata;
+	int cb_res = ctx->callback( change, &item );
+	if( cb_res == DIR_WALK_ABORT )
+		ctx->aborted = true;
+	return cb_res;
+}
+
+/**
+ * Write name after the path at path_len in path_buffer, growing it if needed.
+ * @return new path length or 0, and the walk failed, if the buffer could not grow.
+ */
+static size_t dir_changes_push_name( dir_changes_ctx* ctx, size_t path_len, const char* name )
+{
+	size_t name_len = strlen( name );
+	dir_error reserved = dir_path_buffer_reserve( &ctx->path_buffer, &ctx->path_buffer_size, path_len + name_len + 4 );
+	if( reserved != DIR_ERROR_OK )
+	{
+		dir_changes_fail( ctx, reserved );
+		return 0;
+	}
+	ctx->path_buffer[path_len] = '/';
+	memcpy( ctx->path_buffer + path_len + 1, name, name_len + 1 );
+	return path_len + name_len + 1;
+}
+
+/**
+ * Report node, with path already in path_buffer, and everything below it as removed.
+ */
+static void dir_changes_report_removed( dir_changes_ctx* ctx, uint32_t node, size_t path_len, size_t name_offset )
+{
+	const dir_snapshot* snap = ctx->snap;
+	int cb_res = dir_changes_report( ctx, DIR_CHANGE_REMOVED, name_offset, (dir_item_type)snap->type[node], 0x0 );
+	if( snap->type[node] != DIR_ITEM_DIR || cb_res == DIR_WALK_ABORT || cb_res == DIR_WALK_SKIP_SUBTREE )
+		return;
+
+	for( uint32_t c = snap->first_child[node]; c < snap->first_child[node] + snap->child_count[node] && !ctx->aborted; ++c )
+	{
+		size_t child_len = dir_changes_push_name( ctx, path_len, snap->names + snap->name_offset[c] );
+		if( child_len != 0 )
+			dir_changes_report_removed( ctx, c, child_len, path_len + 1 );
+	}
+	ctx->path_buffer[path_len] = '\0';
+}
+
+static int dir_changes_report_added_walk( const dir_walk_item* sub_item )
+{
+	dir_changes_ctx* ctx = (dir_changes_ctx*)sub_item->userdata;
+	dir_walk_item item = *sub_item;
+	item.relative = item.path + ctx->root_len + 1;
+	item.userdata = ctx->userdata;
+	int cb_res = ctx->callback( DIR_CHANGE_ADDED, &item );
+	if( cb_res == DIR_WALK_ABORT )
+		ctx->aborted = true;
+	return cb_res;
+}
+
+/**
+ * Report item, with path already in path_buffer, and everything below it as added.
+ */
+static void dir_changes_report_added( dir_changes_ctx* ctx, size_t name_offset, dir_item_type type, const dir_item_stat* stat )
+{
+	int cb_res = dir_changes_report( ctx, DIR_CHANGE_ADDED, name_offset, type, stat );
+	if( type == DIR_ITEM_DIR && cb_res != DIR_WALK_ABORT && cb_res != DIR_WALK_SKIP_SUBTREE )
+	{
+		dir_error err = dir_walk( ctx->path_buffer, ctx->snap->flags | DIR_WALK_WITH_STAT, dir_changes_report_added_walk, ctx );
+		if( err != DIR_ERROR_OK && err != DIR_ERROR_ABORTED )
+			dir_changes_fail( ctx, err );
+	}
+}
+
+static void dir_changes_dir( dir_changes_ctx* ctx, uint32_t node, size_t path_len, const dir_item_stat* stat );
+
+/**
+ * Compare item, with path already in path_buffer, vs node in snapshot.
+ */
+static void dir_changes_item( dir_changes_ctx* ctx, uint32_t node, size_t path_len, size_t name_offset, dir_item_type type, const dir_item_stat* stat )
+{
+	const dir_snapshot* snap = ctx->snap;
+	if( snap->type[node] != type )
+	{
+		dir_changes_report_removed( ctx, node, path_len, name_offset );
+		if( !ctx->aborted )
+			dir_changes_report_added( ctx, name_offset, type, stat );
+		return;
+	}
+
+	if( type == DIR_ITEM_DIR )
+	{
+		dir_changes_dir( ctx, node, path_len, stat );
+		return;
+	}
+
+	// no stat is treated as modified to be on the safe side.
+	if( stat == 0x0 || stat->size != snap->size[node] || stat->mtime_ns != snap->mtime_ns[node] )
+		dir_changes_report( ctx, DIR_CHANGE_MODIFIED, name_offset, type, stat );
+}
+
+/**
+ * Compare dir, with path already in path_buffer, vs node in snapshot.
+ */
+static void dir_changes_dir( dir_changes_ctx* ctx, uint32_t node, size_t path_len, const dir_item_stat* stat )
+{
+	const dir_snapshot* snap = ctx->snap;
+	uint32_t first_child = snap->first_child[node];
+	uint32_t child_count = snap->child_count[node];
+
+	bool unchanged = stat != 0x0 && stat->mtime_ns == snap->mtime_ns[node];
+#if !defined( _WIN32 )
+	// the stored items are checked by full path, paths the OS can not resolve in one go are read as a changed dir.
+	unchanged = unchanged && path_len + NAME_MAX + 2 < PATH_MAX;
+#endif
+	if( unchanged )
+	{
+		// nothing was added or removed in the dir, check the items stored in the snapshot without reading the dir.
+		for( uint32_t c = first_child; c < first_child + child_count && !ctx->aborted; ++c )
+		{
+			size_t child_len = dir_changes_push_name( ctx, path_len, snap->names + snap->name_offset[c] );
+			if( child_len == 0 )
+				break;
+
+			dir_item_type        child_type;
+			dir_item_stat        child_stat;
+			const dir_item_stat* child_stat_ptr;
+			if( !dir_stat_path_as_entry( ctx->path_buffer, &child_type, &child_stat, &child_stat_ptr ) )
+				dir_changes_report_removed( ctx, c, child_len, path_len + 1 );
+			else
+				dir_changes_item( ctx, c, child_len, path_len + 1, child_type, child_stat_ptr );
+		}
+		ctx->path_buffer[path_len] = '\0';
+		return;
+	}
+
+	uint8_t* seen = (uint8_t*)calloc( child_count + 1, 1 );
+	if( seen == 0x0 )
+	{
+		dir_changes_fail( ctx, DIR_ERROR_FAILED );
+		return;
+	}
+
+	dir_reader reader;
+	if( dir_reader_open( &reader, 0x0, ctx->path_buffer, path_len, 0, 0x0, 0 ) )
+	{
+		dir_reader_entry ent;
+		while( !ctx->aborted && dir_reader_next( &reader, &ent ) )
+		{
+			dir_item_type        item_type;
+			dir_item_stat        item_stat;
+			const dir_item_stat* item_stat_ptr;
+			if( !dir_walk_resolve_entry( &reader, &ent, snap->flags | DIR_WALK_WITH_STAT, &item_type, &item_stat, &item_stat_ptr, 0x0 ) )
+				continue;
+
+			size_t child_len = dir_changes_push_name( ctx, path_len, ent.name );
+			if( child_len == 0 )
+				break;
+
+			uint32_t c = dir_snapshot_find_child( snap, node, ent.name );
+			if( c == DIR_SNAPSHOT_NO_NODE )
+				dir_changes_report_added( ctx, path_len + 1, item_type, item_stat_ptr );
+			else
+			{
+				seen[c - first_child] = 1;
+				dir_changes_item( ctx, c, child_len, path_len + 1, item_type, item_stat_ptr );
+			}
+		}
+		dir_reader_close( &reader );
+	}
+
+	for( uint32_t c = first_child; c < first_child + child_count && !ctx->aborted; ++c )
+	{
+		if( seen[c - first_child] )
+			continue;
+		size_t child_len = dir_changes_push_name( ctx, path_len, snap->names + snap->name_offset[c] );
+		if( child_len != 0 )
+			dir_changes_report_removed( ctx, c, child_len, path_len + 1 );
+	}
+
+	ctx->path_buffer[path_len] = '\0';
+	free( seen );
+}
+
+static dir_error dir_changes_run( const dir_snapshot* snap, const char* root, dir_change_callback callback, void* userdata )
+{
+	dir_changes_ctx ctx;
+	ctx.snap             = snap;
+	ctx.callback         = callback;
+	ctx.userdata         = userdata;
+	ctx.path_buffer      = 0x0;
+	ctx.path_buffer_size = 0;
+	ctx.aborted          = false;
+	ctx.error            = dir_path_buffer_reserve( &ctx.path_buffer, &ctx.path_buffer_size, strlen( root ) + 3 );
+	if( ctx.error != DIR_ERROR_OK )
+		return ctx.error;
+	ctx.root_len = dir_copy_root_path( root, ctx.path_buffer, ctx.path_buffer_size );
+
+	dir_item_stat root_stat;
+	if( !dir_stat_path( ctx.path_buffer, &root_stat ) )
+		ctx.error = DIR_ERROR_PATH_DO_NOT_EXIST;
+	else if( !dir_stat_is_dir( &root_stat ) )
+		ctx.error = DIR_ERROR_PATH_IS_FILE;
+	else
+		dir_changes_dir( &ctx, 0, ctx.root_len, &root_stat );
+
+	free( ctx.path_buffer );
+	if( ctx.error != DIR_ERROR_OK )
+		return ctx.error;
+	return ctx.aborted ? DIR_ERROR_ABORTED : DIR_ERROR_OK;
+}
+
+dir_error dir_walk_changes( const char* root, const char* snapshot_path, dir_change_callback callback, void* userdata )
+{
+	dir_mapped_file file;
+	if( !dir_map_file( snapshot_path, &file ) )
+		return DIR_ERROR_FAILED;
+
+	dir_snapshot snap;
+	dir_error res = DIR_ERROR_FAILED;
+	if( dir_snapshot_load( &snap, file.data, file.size ) && snap.size != 0x0 )
+		res = dir_changes_run( &snap, root, callback, userdata );
+
+	dir_unmap_file( &file );
+	return res;
+}
+
+dir_error dir_tree_changes( const dir_tree* tree, const char* root, dir_change_callback callback, void* userdata )
+{
+	if( tree->snap.size == 0x0 )
+		return DIR_ERROR_FAILED;
+	return dir_changes_run( &tree->snap, root, callback, userdata );
+}
+
+enum dir_glob_op_type
+{
+	DIR_GLOB_OP_LITERAL, // match literal chars, arg = offset in literals, len = number of chars.
+	DIR_GLOB_OP_ANY,     // '?', match any one char.
+	DIR_GLOB_OP_STAR,    // '*', match any amount of chars.
+	DIR_GLOB_OP_RANGE,   // '[]', match one char in set, arg = index of set in ranges.
+	DIR_GLOB_OP_GROUP    // '{}', match one of the alternatives, arg = index of first alternative, len = number of alternatives.
+};
+
+struct dir_glob_op
+{
+	uint32_t type;
+	uint32_t arg;
+	uint32_t len;
+};
+
+/**
+ * Alternative in a '{}'-group.
+ */
+struct dir_glob_alt
+{
+	uint32_t offset;
+	uint32_t len;
+};
+
+/**
+ * Part of pattern between two '/', matched vs one part of the path between two '/'.
+ */
+struct dir_glob_segment
+{
+	uint32_t first_op;
+	uint32_t num_ops;
+
+	// segment is '**' and match zero or more path-segments.
+	bool     any_segments;
+
+	// for '**'-segments, the number of segments after this one if there is no other '**' after it, as they
+	// then can only match the last path-segments. DIR_GLOB_NO_TAIL otherwise.
+	uint32_t tail_segments;
+
+	// segment has more than one '*' or '{}' and could backtrack a lot, it is matched by tracking the set of
+	// possible positions in the path-segment instead.
+	bool     branching;
+};
+
+static const uint32_t DIR_GLOB_NO_TAIL = 0xFFFFFFFF;
+
+/**
+ * Literal that a path need to end with to match the pattern, taken from the ops ending the pattern. The last
+ * 8 bytes are also stored as a masked word to be able to check it with one compare.
+ */
+struct dir_glob_suffix
+{
+	uint64_t value;
+	uint64_t mask;
+	uint32_t offset;
+	uint32_t len;
+};
+
+/**
+ * A glob-pattern compiled into a list of segments, each with a list of ops to match. All data is allocated in
+ * the same block as the dir_glob.
+ */
+struct dir_glob
+{
+	dir_glob_segment* segments;
+	uint32_t          num_segments;
+	uint32_t          num_any_segments;
+	dir_glob_op*      ops;
+	uint64_t*         ranges; // 256 bits per range
+	dir_glob_alt*     alts;
+	char*             literals;
+
+	// the path need to end with one of these for the pattern to match, no suffixes if there is no such check.
+	dir_glob_suffix*  suffixes;
+	uint32_t          num_suffixes;
+};
+
+static void* dir_glob_alloc_from( uint8_t** block, size_t size )
+{
+	void* res = *block;
+	*block += ( size + 7 ) & ~(size_t)7;
+	return res;
+}
+
+static void dir_glob_add_suffix( dir_glob* glob, uint32_t offset, uint32_t len )
+{
+	dir_glob_suffix* suffix = &glob->suffixes[glob->num_suffixes++];
+	suffix->offset = offset;
+	suffix->len    = len;
+
+	// place the last 8 bytes of the suffix at the end of the word, the same way as when the last 8 bytes of the
+	// path is loaded, so that it works with any byte-order.
+	uint8_t value[8];
+	uint8_t mask[8];
+	uint32_t packed = len < 8 ? len : 8;
+	memset( value, 0x0, sizeof( value ) );
+	memset( mask,  0x0, sizeof( mask ) );
+	memcpy( value + 8 - packed, glob->literals + offset + len - packed, packed );
+	memset( mask  + 8 - packed, 0xFF, packed );
+	memcpy( &suffix->value, value, sizeof( value ) );
+	memcpy( &suffix->mask,  mask,  sizeof( mask ) );
+}
+
+dir_glob* dir_glob_compile( const char* glob_pattern )
+{
+	size_t pattern_len = strlen( glob_pattern );
+	if( pattern_len >= 0xFFFFFFFF )
+		return 0x0;
+
+	// size all arrays for the worst case, each char in the pattern producing one of them.
+	size_t max_items = pattern_len + 1;
+	size_t block_size = sizeof( dir_glob ) + 8 +
+						max_items * sizeof( dir_glob_segment ) + 8 +
+						max_items * sizeof( dir_glob_op ) + 8 +
+						( max_items / 2 + 1 ) * 4 * sizeof( uint64_t ) + 8 +
+						max_items * sizeof( dir_glob_alt ) + 8 +
+						max_items + 8 +
+						max_items * sizeof( dir_glob_suffix ) + 8;
+
+	uint8_t* block = (uint8_t*)malloc( block_size );
+	if( block == 0x0 )
+		return 0x0;
+
+	uint8_t* alloc = block;
+	dir_glob* glob = (dir_glob*)dir_glob_alloc_from( &alloc, sizeof( dir_glob ) );
+	glob->segments = (dir_glob_segment*)dir_glob_alloc_from( &alloc, max_items * sizeof( dir_glob_segment ) );
+	glob->ops      = (dir_glob_op*)     dir_glob_alloc_from( &alloc, max_items * sizeof( dir_glob_op ) );
+	glob->ranges   = (uint64_t*)        dir_glob_alloc_from( &alloc, ( max_items / 2 + 1 ) * 4 * sizeof( uint64_t ) );
+	glob->alts     = (dir_glob_alt*)    dir_glob_alloc_from( &alloc, max_items * sizeof( dir_glob_alt ) );
+	glob->literals = (char*)            dir_glob_alloc_from( &alloc, max_items );
+	glob->suffixes = (dir_glob_suffix*) dir_glob_alloc_from( &alloc, max_items * sizeof( dir_glob_suffix ) );
+	glob->num_suffixes = 0;
+
+	uint32_t num_ops      = 0;
+	uint32_t num_ranges   = 0;
+	uint32_t num_alts     = 0;
+	uint32_t num_literals = 0;
+
+	glob->num_segments = 1;
+	dir_glob_segment* seg = &glob->segments[0];
+	seg->first_op     = 0;
+	seg->num_ops      = 0;
+	seg->any_segments = false;
+
+	const char* p = glob_pattern;
+	while( true )
+	{
+		switch( *p )
+		{
+			case '\0':
+			{
+				uint32_t tail = 0;
+				glob->num_any_segments = 0;
+				for( uint32_t i = glob->num_segments; i > 0; --i )
+				{
+					dir_glob_segment* s = &glob->segments[i - 1];
+					s->tail_segments = tail;
+					if( s->any_segments )
+					{
+						tail = DIR_GLOB_NO_TAIL;
+						++glob->num_any_segments;
+					}
+					else if( tail != DIR_GLOB_NO_TAIL )
+						++tail;
+
+					uint32_t branches = 0;
+					for( uint32_t op = s->first_op; op < s->first_op + s->num_ops; ++op )
+						branches += glob->ops[op].type == DIR_GLOB_OP_STAR || glob->ops[op].type == DIR_GLOB_OP_GROUP;
+					s->branching = branches > 1;
+				}
+
+				// a literal or '{}' ending the pattern give the suffixes of all matching paths.
+				const dir_glob_segment* last = &glob->segments[glob->num_segments - 1];
+				if( last->num_ops > 0 )
+				{
+					const dir_glob_op* op = &glob->ops[last->first_op + last->num_ops - 1];
+					if( op->type == DIR_GLOB_OP_LITERAL )
+						dir_glob_add_suffix( glob, op->arg, op->len );
+					else if( op->type == DIR_GLOB_OP_GROUP )
+					{
+						for( uint32_t i = 0; i < op->len; ++i )
+							dir_glob_add_suffix( glob, glob->alts[op->arg + i].offset, glob->alts[op->arg + i].len );
+					}
+				}
+				return glob;
+			}
+
+			case '/':
+			{
+				seg = &glob->segments[glob->num_segments++];
+				seg->first_op     = num_ops;
+				seg->num_ops      = 0;
+				seg->any_segments = false;
+				++p;
+			}
+			continue;
+
+			case '*':
+			{
+				if( p[1] == '*' )
+				{
+					// '**' need to be a complete segment followed by a '/'
+					if( seg->num_ops != 0 || p[2] != '/' )
+						break;
+					seg->any_segments = true;
+					p += 2;
+					continue;
+				}
+
+				dir_glob_op* op = &glob->ops[num_ops++];
+				op->type = DIR_GLOB_OP_STAR;
+				op->arg  = 0;
+				op->len  = 0;
+				++seg->num_ops;
+				++p;
+			}
+			continue;
+
+			case '?':
+			{
+				dir_glob_op* op = &glob->ops[num_ops++];
+				op->type = DIR_GLOB_OP_ANY;
+				op->arg  = 0;
+				op->len  = 0;
+				++seg->num_ops;
+				++p;
+			}
+			continue;
+
+			case '[':
+			{
+				const char* range_start = p + 1;
+				const char* range_end   = strchr( range_start, ']' );
+				if( range_end == 0x0 )
+					break;
+
+				bool negate = *range_start == '!';
+				if( negate )
+					++range_start;
+				if( range_start == range_end )
+					break;
+
+				uint64_t* bits = &glob->ranges[num_ranges * 4];
+				memset( bits, 0x0, 4 * sizeof( uint64_t ) );
+				const char* r = range_start;
+				while( r < range_end )
+				{
+					unsigned char first = (unsigned char)r[0];
+					unsigned char last  = first;
+					if( r + 2 < range_end && r[1] == '-' )
+					{
+						last = (unsigned char)r[2];
+						r += 3;
+					}
+					else
+						++r;
+					for( unsigned int c = first; c <= last; ++c )
+						bits[c >> 6] |= (uint64_t)1 << ( c & 63 );
+				}
+				if( negate )
+				{
+					for( int i = 0; i < 4; ++i )
+						bits[i] = ~bits[i];
+				}
+
+				// ranges never match the dir-separator or end of string.
+				bits['/' >> 6] &= ~( (uint64_t)1 << ( '/' & 63 ) );
+				bits[0] &= ~(uint64_t)1;
+
+				dir_glob_op* op = &glob->ops[num_ops++];
+				op->type = DIR_GLOB_OP_RANGE;
+				op->arg  = num_ranges++;
+				op->len  = 0;
+				++seg->num_ops;
+				p = range_end + 1;
+			}
+			continue;
+
+			case '{':
+			{
+				const char* group_start = p + 1;
+				const char* group_end   = strchr( group_start, '}' );
+				if( group_end == 0x0 )
+					break;
+
+				dir_glob_op* op = &glob->ops[num_ops++];
+				op->type = DIR_GLOB_OP_GROUP;
+				op->arg  = num_alts;
+				op->len  = 0;
+				++seg->num_ops;
+
+				const char* item_start = group_start;
+				bool valid = true;
+				while( true )
+				{
+					const char* item_end = item_start;
+					while( item_end != group_end && *item_end != ',' )
+					{
+						valid = valid && *item_end != '/';
+						++item_end;
+					}
+
+					dir_glob_alt* alt = &glob->alts[num_alts++];
+					alt->offset = num_literals;
+					alt->len    = (uint32_t)( item_end - item_start );
+					memcpy( glob->literals + num_literals, item_start, alt->len );
+					num_literals += alt->len;
+					++op->len;
+
+					if( item_end == group_end )
+						break;
+					item_start = item_end + 1;
+				}
+				if( !valid )
+					break;
+				p = group_end + 1;
+			}
+			continue;
+
+			default:
+			{
+				dir_glob_op* prev = seg->num_ops > 0 ? &glob->ops[num_ops - 1] : 0x0;
+				if( prev == 0x0 || prev->type != DIR_GLOB_OP_LITERAL || prev->arg + prev->len != num_literals )
+				{
+					prev = &glob->ops[num_ops++];
+					prev->type = DIR_GLOB_OP_LITERAL;
+					prev->arg  = num_literals;
+					prev->len  = 0;
+					++seg->num_ops;
+				}
+				// consume all chars up to the next special one at once.
+				const char* run_end = p + 1;
+				while( *run_end != '\0' && *run_end != '/' && *run_end != '*' && *run_end != '?' && *run_end != '[' && *run_end != '{' )
+					++run_end;
+				uint32_t run_len = (uint32_t)( run_end - p );
+				memcpy( glob->literals + num_literals, p, run_len );
+				num_literals += run_len;
+				prev->len    += run_len;
+				p = run_end;
+			}
+			continue;
+		}
+
+		// all valid cases continue, so this is an invalid pattern.
+		free( glob );
+		return 0x0;
+	}
+}
+
+void dir_glob_free( dir_glob* glob )
+{
+	free( glob );
+}
+
+#if defined( DIRUTIL_SSE2 )
+static inline unsigned int dir_count_trailing_zeros( unsigned int mask )
+{
+#if defined( _MSC_VER )
+	unsigned long index;
+	_BitScanForward( &index, mask );
+	return (unsigned int)index;
+#else
+	return (unsigned int)__builtin_ctz( mask );
+#endif
+}
+
+#if defined( __GNUC__ )
+	// the scans below read whole aligned blocks, that never cross a page, but might read past the end of the
+	// string, which is fine for the hardware but not for the address-sanitizer.
+	#define DIRUTIL_NO_SANITIZE_ADDRESS __attribute__(( no_sanitize_address ))
+#else
+	#define DIRUTIL_NO_SANITIZE_ADDRESS
+#endif
+
+DIRUTIL_NO_SANITIZE_ADDRESS
+static const char* dir_glob_segment_end_sse2( const char* path )
+{
+	const __m128i slash = _mm_set1_epi8( '/' );
+	const __m128i zero  = _mm_setzero_si128();
+
+	// start at the aligned block containing path and mask away the bytes before it.
+	size_t         misalign = (size_t)( (uintptr_t)path & 15 );
+	const __m128i* block    = (const __m128i*)( path - misalign );
+	__m128i        v        = _mm_load_si128( block );
+	unsigned int   mask     = (unsigned int)_mm_movemask_epi8( _mm_or_si128( _mm_cmpeq_epi8( v, slash ), _mm_cmpeq_epi8( v, zero ) ) ) >> misalign;
+	if( mask != 0 )
+		return path + dir_count_trailing_zeros( mask );
+
+	while( true )
+	{
+		v    = _mm_load_si128( ++block );
+		mask = (unsigned int)_mm_movemask_epi8( _mm_or_si128( _mm_cmpeq_epi8( v, slash ), _mm_cmpeq_epi8( v, zero ) ) );
+		if( mask != 0 )
+			return (const char*)block + dir_count_trailing_zeros( mask );
+	}
+}
+#endif
+
+#if defined( DIRUTIL_AVX2 )
+DIRUTIL_NO_SANITIZE_ADDRESS __attribute__(( target( "avx2" ) ))
+static const char* dir_glob_segment_end_avx2( const char* path )
+{
+	const __m256i slash = _mm256_set1_epi8( '/' );
+	const __m256i zero  = _mm256_setzero_si256();
+
+	size_t         misalign = (size_t)( (uintptr_t)path & 31 );
+	const __m256i* block    = (const __m256i*)( path - misalign );
+	__m256i        v        = _mm256_load_si256( block );
+	unsigned int   mask     = (unsigned int)_mm256_movemask_epi8( _mm256_or_si256( _mm256_cmpeq_epi8( v, slash ), _mm256_cmpeq_epi8( v, zero ) ) ) >> misalign;
+	if( mask != 0 )
+		return path + dir_count_trailing_zeros( mask );
+
+	while( true )
+	{
+		v    = _mm256_load_si256( ++block );
+		mask = (unsigned int)_mm256_movemask_epi8( _mm256_or_si256( _mm256_cmpeq_epi8( v, slash ), _mm256_cmpeq_epi8( v, zero ) ) );
+		if( mask != 0 )
+			return (const char*)block + dir_count_trailing_zeros( mask );
+	}
+}
+#endif
+
+#if !defined( DIRUTIL_SSE2 )
+static const char* dir_glob_segment_end_scalar( const char* path )
+{
+	while( *path != '\0' && *path != '/' )
+		++path;
+	return path;
+}
+#endif
+
+typedef const char* ( *dir_glob_scan_func )( const char* path );
+
+static dir_glob_scan_func dir_glob_select_segment_end()
+{
+#if defined( DIRUTIL_AVX2 )
+	__builtin_cpu_init();
+	if( __builtin_cpu_supports( "avx2" ) )
+		return dir_glob_segment_end_avx2;
+#endif
+#if defined( DIRUTIL_SSE2 )
+	return dir_glob_segment_end_sse2;
+#else
+	return dir_glob_segment_end_scalar;
+#endif
+}
+
+/**
+ * Find the end of the path-segment starting at path, i.e. the next '/' or '\0'.
+ */
+static inline const char* dir_glob_segment_end( const char* path )
+{
+	// most segments are short, check the first bytes before doing a call.
+	for( int i = 0; i < 4; ++i, ++path )
+		if( *path == '\0' || *path == '/' )
+			return path;
+
+	// selected on first use, and not during static init, to also work for globs matched from static initializers
+	// in other translation units.
+	static const dir_glob_scan_func impl = dir_glob_select_segment_end();
+	return impl( path );
+}
+
+/**
+ * Match ops vs the path-segment starting at str.
+ * @param str_end end of the path-segment if already known, otherwise 0x0 and it is only searched for if needed.
+ * @return end of the path-segment on match, otherwise 0x0.
+ */
+static const char* dir_glob_match_ops( const dir_glob* glob, const dir_glob_op* op, const dir_glob_op* op_end, const char* str, const char* str_end )
+{
+	for( ; op != op_end; ++op )
+	{
+		switch( op->type )
+		{
+			case DIR_GLOB_OP_LITERAL:
+			{
+				// literals never contain '/' or '\0' so without a known end the compare will stop at the end of
+				// the segment.
+				const char* lit = glob->literals + op->arg;
+				if( str_end != 0x0 )
+				{
+					if( (size_t)( str_end - str ) < op->len || memcmp( str, lit, op->len ) != 0 )
+						return 0x0;
+				}
+				else if( strncmp( str, lit, op->len ) != 0 )
+					return 0x0;
+				str += op->len;
+			}
+			break;
+
+			case DIR_GLOB_OP_ANY:
+				if( *str == '/' || *str == '\0' || str == str_end )
+					return 0x0;
+				++str;
+				break;
+
+			case DIR_GLOB_OP_RANGE:
+			{
+				// '/' and '\0' is never part of a range.
+				unsigned char c = (unsigned char)*str;
+				if( str == str_end || ( glob->ranges[op->arg * 4 + ( c >> 6 )] & ( (uint64_t)1 << ( c & 63 ) ) ) == 0 )
+					return 0x0;
+				++str;
+			}
+			break;
+
+			case DIR_GLOB_OP_GROUP:
+			{
+				if( str_end == 0x0 )
+					str_end = dir_glob_segment_end( str );
+
+				for( uint32_t i = 0; i < op->len; ++i )
+				{
+					const dir_glob_alt* alt = &glob->alts[op->arg + i];
+					if( (size_t)( str_end - str ) < alt->len || memcmp( str, glob->literals + alt->offset, alt->len ) != 0 )
+						continue;
+					if( dir_glob_match_ops( glob, op + 1, op_end, str + alt->len, str_end ) )
+						return str_end;
+				}
+				return 0x0;
+			}
+
+			case DIR_GLOB_OP_STAR:
+			{
+				if( str_end == 0x0 )
+					str_end = dir_glob_segment_end( str );
+				if( op + 1 == op_end )
+					return str_end;
+
+				const dir_glob_op* next = op + 1;
+				if( next->type == DIR_GLOB_OP_LITERAL )
+				{
+					const char* lit = glob->literals + next->arg;
+					if( (size_t)( str_end - str ) < next->len )
+						return 0x0;
+
+					// '*' followed by a literal that ends the segment, such as '*.txt', is just a suffix-check.
+					if( next + 1 == op_end )
+						return memcmp( str_end - next->len, lit, next->len ) == 0 ? str_end : 0x0;
+
+					// ... otherwise only try positions where the literal could start.
+					const char* last = str_end - next->len;
+					for( const char* s = str; s <= last; ++s )
+					{
+						s = (const char*)memchr( s, lit[0], (size_t)( last - s ) + 1 );
+						if( s == 0x0 )
+							return 0x0;
+						if( memcmp( s, lit, next->len ) == 0 && dir_glob_match_ops( glob, next + 1, op_end, s + next->len, str_end ) )
+							return str_end;
+					}
+					return 0x0;
+				}
+
+				for( const char* s = str; s <= str_end; ++s )
+					if( dir_glob_match_ops( glob, next, op_end, s, str_end ) )
+						return str_end;
+				return 0x0;
+			}
+		}
+	}
+
+	if( str_end != 0x0 )
+		return str == str_end ? str_end : 0x0;
+	return ( *str == '/' || *str == '\0' ) ? str : 0x0;
+}
+
+/**
+ * Match ops vs the path-segment str -> str_end by tracking the set of positions in the segment that can be
+ * reached after each op. Runs in O( ops * segment length ) no matter how many '*' or '{}' there is.
+ */
+static bool dir_glob_match_ops_set( const dir_glob* glob, const dir_glob_op* op, const dir_glob_op* op_end, const char* str, const char* str_end )
+{
+	size_t len   = (size_t)( str_end - str );
+	size_t words = len / 64 + 1;
+
+	uint64_t  stack_sets[2 * 64];
+	uint64_t* sets = stack_sets;
+	if( words > 64 )
+	{
+		sets = (uint64_t*)malloc( 2 * words * sizeof( uint64_t ) );
+		if( sets == 0x0 )
+			return dir_glob_match_ops( glob, op, op_end, str, str_end ) != 0x0;
+	}
+
+	uint64_t* cur  = sets;
+	uint64_t* next = sets + words;
+	memset( cur, 0x0, words * sizeof( uint64_t ) );
+	cur[0] = 1;
+
+	bool any = true;
+	for( ; op != op_end && any; ++op )
+	{
+		memset( next, 0x0, words * sizeof( uint64_t ) );
+		any = false;
+
+		for( size_t pos = 0; pos <= len; ++pos )
+		{
+			if( ( cur[pos / 64] & ( (uint64_t)1 << ( pos % 64 ) ) ) == 0 )
+				continue;
+
+			switch( op->type )
+			{
+				case DIR_GLOB_OP_STAR:
+					// all positions from the first reachable one are reachable after a '*'.
+					for( size_t p = pos; p <= len; ++p )
+						next[p / 64] |= (uint64_t)1 << ( p % 64 );
+					any = true;
+					pos = len;
+					break;
+
+				case DIR_GLOB_OP_LITERAL:
+					if( len - pos >= op->len && memcmp( str + pos, glob->literals + op->arg, op->len ) == 0 )
+					{
+						next[( pos + op->len ) / 64] |= (uint64_t)1 << ( ( pos + op->len ) % 64 );
+						any = true;
+					}
+					break;
+
+				case DIR_GLOB_OP_ANY:
+					if( pos < len )
+					{
+						next[( pos + 1 ) / 64] |= (uint64_t)1 << ( ( pos + 1 ) % 64 );
+						any = true;
+					}
+					break;
+
+				case DIR_GLOB_OP_RANGE:
+				{
+					unsigned char c = (unsigned char)str[pos];
+					if( pos < len && ( glob->ranges[op->arg * 4 + ( c >> 6 )] & ( (uint64_t)1 << ( c & 63 ) ) ) != 0 )
+					{
+						next[( pos + 1 ) / 64] |= (uint64_t)1 << ( ( pos + 1 ) % 64 );
+						any = true;
+					}
+				}
+				break;
+
+				case DIR_GLOB_OP_GROUP:
+					for( uint32_t i = 0; i < op->len; ++i )
+					{
+						const dir_glob_alt* alt = &glob->alts[op->arg + i];
+						if( len - pos >= alt->len && memcmp( str + pos, glob->literals + alt->offset, alt->len ) == 0 )
+						{
+							next[( pos + alt->len ) / 64] |= (uint64_t)1 << ( ( pos + alt->len ) % 64 );
+							any = true;
+						}
+					}
+					break;
+			}
+		}
+
+		uint64_t* tmp = cur;
+		cur  = next;
+		next = tmp;
+	}
+
+	bool match = any && ( cur[len / 64] & ( (uint64_t)1 << ( len % 64 ) ) ) != 0;
+	if( sets != stack_sets )
+		free( sets );
+	return match;
+}
+
+/**
+ * Match a pattern-segment, that is not '**', vs the path-segment starting at str.
+ * @param str_end end of the path-segment if already known, otherwise 0x0.
+ * @return end of the path-segment on match, otherwise 0x0.
+ */
+static const char* dir_glob_match_segment( const dir_glob* glob, const dir_glob_segment* seg, const char* str, const char* str_end )
+{
+	const dir_glob_op* ops = glob->ops + seg->first_op;
+	if( !seg->branching )
+		return dir_glob_match_ops( glob, ops, ops + seg->num_ops, str, str_end );
+
+	if( str_end == 0x0 )
+		str_end = dir_glob_segment_end( str );
+	return dir_glob_match_ops_set( glob, ops, ops + seg->num_ops, str, str_end ) ? str_end : 0x0;
+}
+
+/**
+ * Add segment to a set of segment-states, one bit per segment + one for "complete pattern matched".
+ */
+static void dir_glob_add_state( const dir_glob* glob, uint64_t* states, uint32_t segment )
+{
+	// '**' match zero path-segments as well, so the segment after it can also be matched directly.
+	while( true )
+	{
+		states[segment / 64] |= (uint64_t)1 << ( segment % 64 );
+		if( segment == glob->num_segments || !glob->segments[segment].any_segments )
+			return;
+		++segment;
+	}
+}
+
+/**
+ * Advance all segment-states in from past the path-segment str -> str_end.
+ * @return true if any state remains.
+ */
+static bool dir_glob_step_states( const dir_glob* glob, size_t state_words, const uint64_t* from, uint64_t* to, const char* str, const char* str_end )
+{
+	memset( to, 0, state_words * sizeof( uint64_t ) );
+
+	bool any = false;
+	for( uint32_t segment = 0; segment < glob->num_segments; ++segment )
+	{
+		if( ( from[segment / 64] & ( (uint64_t)1 << ( segment % 64 ) ) ) == 0 )
+			continue;
+
+		const dir_glob_segment* seg = &glob->segments[segment];
+		if( seg->any_segments )
+			dir_glob_add_state( glob, to, segment );
+		else if( dir_glob_match_segment( glob, seg, str, str_end ) )
+			dir_glob_add_state( glob, to, segment + 1 );
+		else
+			continue;
+		any = true;
+	}
+	return any;
+}
+
+/**
+ * Match path by tracking the set of pattern-segments that the next path-segment can match, used for patterns
+ * with multiple '**' where trying each split of the path recursively could explode. Each path-segment is
+ * matched at most once per pattern-segment.
+ */
+static bool dir_glob_match_states( const dir_glob* glob, const char* path )
+{
+	size_t state_words = glob->num_segments / 64 + 1;
+
+	uint64_t  stack_states[2 * 16];
+	uint64_t* states = stack_states;
+	if( state_words > 16 )
+	{
+		states = (uint64_t*)malloc( 2 * state_words * sizeof( uint64_t ) );
+		if( states == 0x0 )
+			return false;
+	}
+
+	uint64_t* cur  = states;
+	uint64_t* next = states + state_words;
+	memset( cur, 0x0, state_words * sizeof( uint64_t ) );
+	dir_glob_add_state( glob, cur, 0 );
+
+	bool match = false;
+	while( true )
+	{
+		const char* end = dir_glob_segment_end( path );
+		if( !dir_glob_step_states( glob, state_words, cur, next, path, end ) )
+			break;
+
+		uint64_t* tmp = cur;
+		cur  = next;
+		next = tmp;
+
+		if( *end == '\0' )
+		{
+			match = ( cur[glob->num_segments / 64] & ( (uint64_t)1 << ( glob->num_segments % 64 ) ) ) != 0;
+			break;
+		}
+		path = end + 1;
+	}
+
+	if( states != stack_states )
+		free( states );
+	return match;
+}
+
+/**
+ * Match segments from segment_index and forward vs path, path pointing to the start of a path-segment.
+ */
+static bool dir_glob_match_segments( const dir_glob* glob, uint32_t segment_index, const char* path, const char* path_end )
+{
+	while( segment_index < glob->num_segments )
+	{
+		const dir_glob_segment* seg = &glob->segments[segment_index];
+		if( seg->any_segments )
+		{
+			if( seg->tail_segments != DIR_GLOB_NO_TAIL )
+			{
+				// the rest of the pattern can only match the last tail_segments path-segments, find where they start.
+				const char* s = path_end;
+				for( uint32_t i = 0; i < seg->tail_segments; ++i )
+				{
+					while( s > path && s[-1] != '/' )
+						--s;
+					if( i + 1 < seg->tail_segments )
+					{
+						if( s == path )
+							return false;
+						--s;
+					}
+				}
+				return dir_glob_match_segments( glob, segment_index + 1, s, path_end );
+			}
+
+			// try to match the rest of the pattern at the start of each of the remaining path-segments.
+			for( const char* s = path; ; ++s )
+			{
+				if( dir_glob_match_segments( glob, segment_index + 1, s, path_end ) )
+					return true;
+				s = dir_glob_segment_end( s );
+				if( *s == '\0' )
+					return false;
+			}
+		}
+
+		const char* end = dir_glob_match_segment( glob, seg, path, 0x0 );
+		if( end == 0x0 )
+			return false;
+
+		++segment_index;
+		if( *end == '\0' )
+			return segment_index == glob->num_segments;
+		path = end + 1;
+	}
+	return false;
+}
+
+/**
+ * Check if path ends with any of the suffixes required by the pattern.
+ */
+static bool dir_glob_match_suffix( const dir_glob* glob, const char* path, size_t path_len )
+{
+	if( glob->num_suffixes == 0 )
+		return true;
+
+	uint64_t last_word = 0;
+	if( path_len >= 8 )
+		memcpy( &last_word, path + path_len - 8, sizeof( last_word ) );
+
+	for( uint32_t i = 0; i < glob->num_suffixes; ++i )
+	{
+		const dir_glob_suffix* suffix = &glob->suffixes[i];
+		if( suffix->len > path_len )
+			continue;
+		if( path_len >= 8 && ( last_word & suffix->mask ) != suffix->value )
+			continue;
+		if( suffix->len <= 8 && path_len >= 8 )
+			return true;
+		if( memcmp( path + path_len - suffix->len, glob->literals + suffix->offset, suffix->len ) == 0 )
+			return true;
+	}
+	return false;
+}
+
+dir_glob_result dir_glob_match_compiled( const dir_glob* glob, const char* path )
+{
+	// reject on the extension, or whatever literal ends the pattern, before matching any segments.
+	size_t path_len = strlen( path );
+	if( !dir_glob_match_suffix( glob, path, path_len ) )
+		return DIR_GLOB_NO_MATCH;
+
+	// with at most one '**' the recursive matcher never tries more than one split of the path, as the segments
+	// after a single '**' can only match the end of it.
+	if( glob->num_any_segments > 1 )
+		return dir_glob_match_states( glob, path ) ? DIR_GLOB_MATCH : DIR_GLOB_NO_MATCH;
+	return dir_glob_match_segments( glob, 0, path, path + path_len ) ? DIR_GLOB_MATCH : DIR_GLOB_NO_MATCH;
+}
+
+/**
+ * The last pattern compiled by dir_glob_match() on this thread, as it is usually called with the same pattern
+ * for many paths in a row.
+ */
+struct dir_glob_match_cache
+{
+	char*     pattern;
+	size_t    pattern_capacity;
+	dir_glob* glob;
+
+	~dir_glob_match_cache()
+	{
+		free( pattern );
+		dir_glob_free( glob );
+	}
+};
+
+dir_glob_result dir_glob_match( const char* glob_pattern, const char* path )
+{
+	static thread_local dir_glob_match_cache cache = { 0x0, 0, 0x0 };
+
+	if( cache.glob == 0x0 || strcmp( cache.pattern, glob_pattern ) != 0 )
+	{
+		dir_glob_free( cache.glob );
+		cache.glob = 0x0;
+
+		size_t pattern_len = strlen( glob_pattern );
+		if( !dir_array_grow( &cache.pattern, &cache.pattern_capacity, pattern_len + 1 ) )
+			return DIR_GLOB_NO_MATCH;
+
+		dir_glob* glob = dir_glob_compile( glob_pattern );
+		if( glob == 0x0 )
+			return DIR_GLOB_INVALID_PATTERN;
+		memcpy( cache.pattern, glob_pattern, pattern_len + 1 );
+		cache.glob = glob;
+	}
+	return dir_glob_match_compiled( cache.glob, path );
+}
+
+/**
+ * Strategies used by dir_globset to find candidate patterns for a path, each with its own table keyed by a part
+ * of the path.
+ */
+enum dir_globset_table_type
+{
+	DIR_GLOBSET_EXACT,         // pattern without wildcards, keyed by the complete path.
+	DIR_GLOBSET_BASENAME,      // '**' + '/name', keyed by last path-segment.
+	DIR_GLOBSET_EXT,           // '**' + '/*.ext', keyed by extension of last path-segment.
+	DIR_GLOBSET_EXT_NO_DIR,    // '*.ext', keyed by extension of path without '/'.
+	DIR_GLOBSET_DIR_CANDIDATE, // any other pattern starting with literal dirs, keyed by them and verified with a full match.
+	DIR_GLOBSET_EXT_CANDIDATE, // any other pattern requiring an extension, keyed by extension and verified with a full match.
+	DIR_GLOBSET_TABLE_COUNT
+};
+
+struct dir_globset_entry
+{
+	uint64_t hash;
+	uint32_t key_offset;
+	uint32_t key_len;
+	uint32_t pattern;
+	uint32_t next;
+};
+
+struct dir_globset_table
+{
+	uint32_t* buckets;
+	uint32_t  bucket_mask;
+};
+
+static const uint32_t DIR_GLOBSET_NO_ENTRY = 0xFFFFFFFF;
+
+struct dir_globset
+{
+	dir_globset_table  tables[DIR_GLOBSET_TABLE_COUNT];
+	dir_globset_entry* entries;
+	size_t             num_entries;
+	size_t             entries_capacity;
+	char*              keys;
+	size_t             keys_size;
+	size_t             keys_capacity;
+
+	// patterns that need a full match, with a compiled glob for all patterns needing it.
+	uint32_t*          fallback;
+	size_t             num_fallback;
+	dir_glob**         globs;
+	size_t             num_patterns;
+
+	// literal start of patterns needing a full match, compared before doing the full match.
+	uint32_t*          prefix_offsets;
+	uint32_t*          prefix_lengths;
+};
+
+static bool dir_glob_has_wildcard( const char* str, size_t len )
+{
+	for( size_t i = 0; i < len; ++i )
+		if( str[i] == '*' || str[i] == '?' || str[i] == '[' || str[i] == '{' )
+			return true;
+	return false;
+}
+
+/**
+ * Get the extension, including the '.', of the last path-segment in str.
+ * @return length of extension or 0 if there is none.
+ */
+static size_t dir_path_extension( const char* str, size_t len, const char** ext )
+{
+	for( size_t i = len; i > 0; --i )
+	{
+		if( str[i - 1] == '/' )
+			return 0;
+		if( str[i - 1] == '.' )
+		{
+			*ext = str + i - 1;
+			return len - i + 1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Expand all {}-groups in pattern, that is known to be valid, into a list of zero-terminated patterns.
+ * @return number of expanded patterns or 0 if there were too many.
+ */
+static size_t dir_glob_expand_groups( const char* pattern, char** out, size_t* out_size, size_t* out_capacity, size_t max_expansions )
+{
+	const char* group_start = strchr( pattern, '{' );
+	if( group_start == 0x0 )
+	{
+		size_t len = strlen( pattern ) + 1;
+		if( !dir_array_grow( out, out_capacity, *out_size + len ) )
+			return 0;
+		memcpy( *out + *out_size, pattern, len );
+		*out_size += len;
+		return 1;
+	}
+
+	const char* group_end = strchr( group_start, '}' );
+	size_t prefix_len = (size_t)( group_start - pattern );
+	size_t suffix_len = strlen( group_end + 1 );
+
+	char expanded[4096];
+	size_t num = 0;
+	const char* item_start = group_start + 1;
+	while( true )
+	{
+		const char* item_end = item_start;
+		while( item_end != group_end && *item_end != ',' )
+			++item_end;
+
+		// items are matched literally, so an item containing wildcards can not be expanded to a new pattern.
+		size_t item_len = (size_t)( item_end - item_start );
+		if( dir_glob_has_wildcard( item_start, item_len ) )
+			return 0;
+		if( prefix_len + item_len + suffix_len + 1 > sizeof( expanded ) )
+			return 0;
+		memcpy( expanded, pattern, prefix_len );
+		memcpy( expanded + prefix_len, item_start, item_len );
+		memcpy( expanded + prefix_len + item_len, group_end + 1, suffix_len + 1 );
+
+		size_t sub = dir_glob_expand_groups( expanded, out, out_size, out_capacity, max_expansions - num );
+		if( sub == 0 || num + sub > max_expansions )
+			return 0;
+		num += sub;
+
+		if( item_end == group_end )
+			return num;
+		item_start = item_end + 1;
+	}
+}
+
+/**
+ * Classify an expanded pattern, without {}-groups, and find the key to store it by.
+ */
+static dir_globset_table_type dir_globset_classify( const char* pattern, const char** key, size_t* key_len )
+{
+	size_t len = strlen( pattern );
+	if( !dir_glob_has_wildcard( pattern, len ) )
+	{
+		*key = pattern;
+		*key_len = len;
+		return DIR_GLOBSET_EXACT;
+	}
+
+	const char* rest = pattern;
+	bool any_dir = strncmp( pattern, "**/", 3 ) == 0;
+	if( any_dir )
+		rest += 3;
+	size_t rest_len = len - (size_t)( rest - pattern );
+
+	if( any_dir && strchr( rest, '/' ) == 0x0 && !dir_glob_has_wildcard( rest, rest_len ) )
+	{
+		*key = rest;
+		*key_len = rest_len;
+		return DIR_GLOBSET_BASENAME;
+	}
+
+	if( rest[0] == '*' && rest[1] == '.' && strchr( rest + 1, '/' ) == 0x0 && strchr( rest + 2, '.' ) == 0x0 && !dir_glob_has_wildcard( rest + 1, rest_len - 1 ) )
+	{
+		*key = rest + 1;
+		*key_len = rest_len - 1;
+		return any_dir ? DIR_GLOBSET_EXT : DIR_GLOBSET_EXT_NO_DIR;
+	}
+
+	// if the pattern start with literal directories any matching path need to start with the same directories.
+	size_t dir_len = 0;
+	for( size_t i = 0; i < len && !dir_glob_has_wildcard( pattern + i, 1 ); ++i )
+		if( pattern[i] == '/' )
+			dir_len = i + 1;
+	if( dir_len > 0 )
+	{
+		*key = pattern;
+		*key_len = dir_len;
+		return DIR_GLOBSET_DIR_CANDIDATE;
+	}
+
+	// if the last segment ends with a literal extension any matching path need to have that extension.
+	const char* ext;
+	size_t ext_len = dir_path_extension( pattern, len, &ext );
+	if( ext_len > 1 && !dir_glob_has_wildcard( ext, ext_len ) && strchr( ext, ']' ) == 0x0 )
+	{
+		*key = ext;
+		*key_len = ext_len;
+		return DIR_GLOBSET_EXT_CANDIDATE;
+	}
+
+	return DIR_GLOBSET_TABLE_COUNT;
+}
+
+static bool dir_globset_insert( dir_globset* set, dir_globset_table_type table, const char* key, size_t key_len, uint32_t pattern )
+{
+	uint64_t hash = dir_hash_fnv1a( key, key_len );
+
+	// the same key for the same pattern might come from multiple expansions of a group, only store it once.
+	for( uint32_t e = set->tables[table].buckets[hash & set->tables[table].bucket_mask]; e != DIR_GLOBSET_NO_ENTRY; e = set->entries[e].next )
+	{
+		const dir_globset_entry* entry = &set->entries[e];
+		if( entry->pattern == pattern && entry->hash == hash && entry->key_len == key_len && memcmp( set->keys + entry->key_offset, key, key_len ) == 0 )
+			return true;
+	}
+
+	if( set->num_entries >= DIR_GLOBSET_NO_ENTRY || set->keys_size + key_len >= 0xFFFFFFFF )
+		return false;
+	if( !dir_array_grow( &set->entries, &set->entries_capacity, set->num_entries + 1 ) )
+		return false;
+	if( !dir_array_grow( &set->keys, &set->keys_capacity, set->keys_size + key_len ) )
+		return false;
+
+	uint32_t* bucket = &set->tables[table].buckets[hash & set->tables[table].bucket_mask];
+	dir_globset_entry* entry = &set->entries[set->num_entries];
+	entry->hash       = hash;
+	entry->key_offset = (uint32_t)set->keys_size;
+	entry->key_len    = (uint32_t)key_len;
+	entry->pattern    = pattern;
+	entry->next       = *bucket;
+	*bucket = (uint32_t)set->num_entries++;
+
+	memcpy( set->keys + set->keys_size, key, key_len );
+	set->keys_size += key_len;
+	return true;
+}
+
+/**
+ * Classify all expansions of pattern and add it to the tables, patterns that can not be put in one of the
+ * tables are added to the fallback-list.
+ */
+static bool dir_globset_add( dir_globset* set, const char* pattern, uint32_t index, char** expanded, size_t* expanded_capacity )
+{
+	size_t expanded_size = 0;
+	size_t num_expanded = dir_glob_expand_groups( pattern, expanded, &expanded_size, expanded_capacity, 256 );
+
+	// all expansions need to end up in the same table, otherwise a path could match the same pattern twice.
+	dir_globset_table_type table = DIR_GLOBSET_TABLE_COUNT;
+	const char* e = *expanded;
+	for( size_t i = 0; i < num_expanded; ++i, e += strlen( e ) + 1 )
+	{
+		const char* key;
+		size_t key_len;
+		dir_globset_table_type t = dir_globset_classify( e, &key, &key_len );
+		if( i > 0 && t != table )
+			t = DIR_GLOBSET_TABLE_COUNT;
+		table = t;
+		if( table == DIR_GLOBSET_TABLE_COUNT )
+			break;
+	}
+
+	if( num_expanded == 0 || table == DIR_GLOBSET_TABLE_COUNT )
+	{
+		set->fallback[set->num_fallback++] = index;
+		return true;
+	}
+
+	e = *expanded;
+	for( size_t i = 0; i < num_expanded; ++i, e += strlen( e ) + 1 )
+	{
+		const char* key;
+		size_t key_len;
+		dir_globset_classify( e, &key, &key_len );
+		if( !dir_globset_insert( set, table, key, key_len, index ) )
+			return false;
+	}
+
+	// candidates still need to be verified with a full match.
+	if( table != DIR_GLOBSET_DIR_CANDIDATE && table != DIR_GLOBSET_EXT_CANDIDATE )
+	{
+		dir_glob_free( set->globs[index] );
+		set->globs[index] = 0x0;
+	}
+	return true;
+}
+
+dir_globset* dir_globset_compile( const char** glob_patterns, size_t num_patterns, size_t* invalid_pattern )
+{
+	if( num_patterns >= DIR_GLOBSET_NO_ENTRY )
+		return 0x0;
+
+	dir_globset* set = (dir_globset*)calloc( 1, sizeof( dir_globset ) );
+	if( set == 0x0 )
+		return 0x0;
+
+	uint32_t num_buckets = 16;
+	while( num_buckets < num_patterns * 2 )
+		num_buckets *= 2;
+
+	bool ok = true;
+	for( int t = 0; t < DIR_GLOBSET_TABLE_COUNT; ++t )
+	{
+		set->tables[t].buckets     = (uint32_t*)malloc( num_buckets * sizeof( uint32_t ) );
+		set->tables[t].bucket_mask = num_buckets - 1;
+		ok = ok && set->tables[t].buckets != 0x0;
+		if( set->tables[t].buckets )
+			memset( set->tables[t].buckets, 0xFF, num_buckets * sizeof( uint32_t ) );
+	}
+
+	set->num_patterns = num_patterns;
+	set->fallback     = (uint32_t*)malloc( ( num_patterns + 1 ) * sizeof( uint32_t ) );
+	set->globs        = (dir_glob**)calloc( num_patterns + 1, sizeof( dir_glob* ) );
+	set->prefix_offsets = (uint32_t*)calloc( num_patterns + 1, sizeof( uint32_t ) );
+	set->prefix_lengths = (uint32_t*)calloc( num_patterns + 1, sizeof( uint32_t ) );
+	ok = ok && set->fallback != 0x0 && set->globs != 0x0 && set->prefix_offsets != 0x0 && set->prefix_lengths != 0x0;
+
+	char*  expanded = 0x0;
+	size_t expanded_capacity = 0;
+	for( size_t i = 0; ok && i < num_patterns; ++i )
+	{
+		// compile all patterns to validate them, the compiled glob is kept for the ones that need a full match.
+		set->globs[i] = dir_glob_compile( glob_patterns[i] );
+		if( set->globs[i] == 0x0 )
+		{
+			if( invalid_pattern )
+				*invalid_pattern = i;
+			ok = false;
+			break;
+		}
+		ok = dir_globset_add( set, glob_patterns[i], (uint32_t)i, &expanded, &expanded_capacity );
+	}
+	free( expanded );
+
+	for( size_t i = 0; ok && i < num_patterns; ++i )
+	{
+		if( set->globs[i] == 0x0 )
+			continue;
+		size_t prefix_len = 0;
+		while( glob_patterns[i][prefix_len] != '\0' && !dir_glob_has_wildcard( glob_patterns[i] + prefix_len, 1 ) )
+			++prefix_len;
+		ok = set->keys_size + prefix_len < 0xFFFFFFFF && dir_array_grow( &set->keys, &set->keys_capacity, set->keys_size + prefix_len );
+		if( ok )
+		{
+			memcpy( set->keys + set->keys_size, glob_patterns[i], prefix_len );
+			set->prefix_lengths[i] = (uint32_t)prefix_len;
+			set->prefix_offsets[i] = (uint32_t)set->keys_size;
+			set->keys_size += prefix_len;
+		}
+	}
+
+	if( !ok )
+	{
+		dir_globset_free( set );
+		return 0x0;
+	}
+	return set;
+}
+
+void dir_globset_free( dir_globset* set )
+{
+	if( set == 0x0 )
+		return;
+	for( int t = 0; t < DIR_GLOBSET_TABLE_COUNT; ++t )
+		free( set->tables[t].buckets );
+	if( set->globs )
+	{
+		for( size_t i = 0; i < set->num_patterns; ++i )
+			dir_glob_free( set->globs[i] );
+	}
+	free( set->globs );
+	free( set->fallback );
+	free( set->prefix_offsets );
+	free( set->prefix_lengths );
+	free( set->entries );
+	free( set->keys );
+	free( set );
+}
+
+/**
+ * Add pattern to the matches found so far, keeping the smallest max_matches indices sorted.
+ */
+static void dir_globset_add_match( uint32_t pattern, uint32_t* matches, size_t max_matches, size_t* num_matches )
+{
+	size_t stored = *num_matches < max_matches ? *num_matches : max_matches;
+	++*num_matches;
+
+	size_t pos = stored;
+	while( pos > 0 && matches[pos - 1] > pattern )
+		--pos;
+	if( pos >= max_matches )
+		return;
+
+	size_t move = stored < max_matches ? stored - pos : stored - pos - 1;
+	memmove( matches + pos + 1, matches + pos, move * sizeof( uint32_t ) );
+	matches[pos] = pattern;
+}
+
+static bool dir_globset_full_match( const dir_globset* set, uint32_t pattern, const char* path, size_t path_len )
+{
+	size_t prefix_len = set->prefix_lengths[pattern];
+	if( prefix_len > path_len || memcmp( set->keys + set->prefix_offsets[pattern], path, prefix_len ) != 0 )
+		return false;
+	return dir_glob_match_compiled( set->globs[pattern], path ) == DIR_GLOB_MATCH;
+}
+
+static void dir_globset_lookup( const dir_globset* set, dir_globset_table_type table, const char* key, size_t key_len, const char* path, size_t path_len, uint32_t* matches, size_t max_matches, size_t* num_matches )
+{
+	uint64_t hash = dir_hash_fnv1a( key, key_len );
+	for( uint32_t e = set->tables[table].buckets[hash & set->tables[table].bucket_mask]; e != DIR_GLOBSET_NO_ENTRY; e = set->entries[e].next )
+	{
+		const dir_globset_entry* entry = &set->entries[e];
+		if( entry->hash != hash || entry->key_len != key_len || memcmp( set->keys + entry->key_offset, key, key_len ) != 0 )
+			continue;
+		if( ( table == DIR_GLOBSET_DIR_CANDIDATE || table == DIR_GLOBSET_EXT_CANDIDATE ) && !dir_globset_full_match( set, entry->pattern, path, path_len ) )
+			continue;
+		dir_globset_add_match( entry->pattern, matches, max_matches, num_matches );
+	}
+}
+
+size_t dir_globset_match( const dir_globset* set, const char* path, uint32_t* matches, size_t max_matches )
+{
+	size_t num_matches = 0;
+	size_t path_len = strlen( path );
+
+	const char* basename = path + path_len;
+	while( basename > path && basename[-1] != '/' )
+		--basename;
+	size_t basename_len = (size_t)( path + path_len - basename );
+
+	dir_globset_lookup( set, DIR_GLOBSET_EXACT,    path,     path_len,     path, path_len, matches, max_matches, &num_matches );
+	dir_globset_lookup( set, DIR_GLOBSET_BASENAME, basename, basename_len, path, path_len, matches, max_matches, &num_matches );
+
+	for( const char* dir_end = strchr( path, '/' ); dir_end != 0x0; dir_end = strchr( dir_end + 1, '/' ) )
+		dir_globset_lookup( set, DIR_GLOBSET_DIR_CANDIDATE, path, (size_t)( dir_end - path ) + 1, path, path_len, matches, max_matches, &num_matches );
+
+	const char* ext;
+	size_t ext_len = dir_path_extension( basename, basename_len, &ext );
+	if( ext_len > 0 )
+	{
+		dir_globset_lookup( set, DIR_GLOBSET_EXT, ext, ext_len, path, path_len, matches, max_matches, &num_matches );
+		if( basename == path )
+			dir_globset_lookup( set, DIR_GLOBSET_EXT_NO_DIR, ext, ext_len, path, path_len, matches, max_matches, &num_matches );
+		dir_globset_lookup( set, DIR_GLOBSET_EXT_CANDIDATE, ext, ext_len, path, path_len, matches, max_matches, &num_matches );
+	}
+
+	for( size_t i = 0; i < set->num_fallback; ++i )
+	{
+		uint32_t pattern = set->fallback[i];
+		if( dir_globset_full_match( set, pattern, path, path_len ) )
+			dir_globset_add_match( pattern, matches, max_matches, &num_matches );
+	}
+	return num_matches;
+}
+
+/**
+ * While walking with dir_walk_glob() each directory has a set of pattern-segments that the next path-segment
+ * can be matched against, stored as a bitset with one bit per segment + one for "the complete pattern matched".
+ */
+struct dir_walk_glob_ctx
+{
+	dir_walk_ctx    walk;
+	const dir_glob* glob;
+
+	// words per state-set and one state-set per depth.
+	size_t          state_words;
+	uint64_t*       states;
+	size_t          states_capacity;
+};
+
+/**
+ * Advance all states in from past the path-segment name.
+ * @return true if any state remains.
+ */
+static bool dir_walk_glob_step( const dir_walk_glob_ctx* ctx, const uint64_t* from, uint64_t* to, const char* name )
+{
+	return dir_glob_step_states( ctx->glob, ctx->state_words, from, to, name, name + strlen( name ) );
+}
+
+static bool dir_walk_glob_is_match( const dir_walk_glob_ctx* ctx, const uint64_t* states )
+{
+	uint32_t final_state = ctx->glob->num_segments;
+	return ( states[final_state / 64] & ( (uint64_t)1 << ( final_state % 64 ) ) ) != 0;
+}
+
+static bool dir_walk_glob_can_descend( const dir_walk_glob_ctx* ctx, const uint64_t* states )
+{
+	// any state except the final one can match something further down.
+	uint32_t final_state = ctx->glob->num_segments;
+	for( size_t i = 0; i < ctx->state_words; ++i )
+	{
+		uint64_t word = states[i];
+		if( i == final_state / 64 )
+			word &= ~( (uint64_t)1 << ( final_state % 64 ) );
+		if( word != 0 )
+			return true;
+	}
+	return false;
+}
+
+static dir_error dir_walk_glob_impl( dir_walk_glob_ctx* ctx, const dir_reader* parent, size_t path_len, size_t name_offset, size_t depth )
+{
+	if( !dir_walk_path_reserve( &ctx->walk, path_len + 3 ) )
+		return DIR_ERROR_PATH_TO_DEEP;
+
+	// states are indexed by depth as the array might move while walking sub-dirs.
+	if( !dir_array_grow( &ctx->states, &ctx->states_capacity, ( depth + 2 ) * ctx->state_words ) )
+		return DIR_ERROR_FAILED;
+
+	dir_reader reader;
+	if( !dir_reader_open( &reader, parent, ctx->walk.path_buffer, path_len, name_offset, dir_walk_read_buffer( &ctx->walk, depth ), dir_reader_buffer_size() ) )
+		return DIR_ERROR_PATH_DO_NOT_EXIST;
+
+	// with DIR_WALK_SORTED all entries are resolved up front, so items that can not match might cost a syscall.
+	const dir_sort_buffer* sorted = 0x0;
+	if( ( ctx->walk.flags & DIR_WALK_SORTED ) > 0 )
+	{
+		sorted = dir_walk_read_all( &ctx->walk, &reader, depth );
+		if( sorted == 0x0 )
+		{
+			dir_reader_close( &reader );
+			return DIR_ERROR_FAILED;
+		}
+	}
+
+	dir_error res = DIR_ERROR_OK;
+	size_t next_sorted = 0;
+	while( true )
+	{
+		const char*          item_name;
+		dir_item_type        item_type;
+		dir_item_stat        item_stat;
+		const dir_item_stat* item_stat_ptr;
+		dir_reader_entry     ent;
+		if( sorted != 0x0 )
+		{
+			if( !dir_walk_next_entry( &ctx->walk, &reader, sorted, &next_sorted, &item_name, &item_type, &item_stat, &item_stat_ptr ) )
+				break;
+		}
+		else
+		{
+			if( !dir_reader_next( &reader, &ent ) )
+				break;
+			item_name = ent.name;
+		}
+
+		// match the name before resolving the type so that items that can not match never cost a syscall.
+		if( !dir_walk_glob_step( ctx, ctx->states + depth * ctx->state_words, ctx->states + ( depth + 1 ) * ctx->state_words, item_name ) )
+			continue;
+
+		size_t item_len = strlen( item_name );
+		if( !dir_walk_path_reserve( &ctx->walk, path_len + item_len + 2 ) )
+		{
+			res = DIR_ERROR_PATH_TO_DEEP;
+			break;
+		}
+
+		char* path_buffer = ctx->walk.path_buffer;
+		path_buffer[path_len] = '/';
+		memcpy( &path_buffer[path_len + 1], item_name, item_len + 1 );
+
+		if( sorted == 0x0 && !dir_walk_resolve_entry( &reader, &ent, ctx->walk.flags, &item_type, &item_stat, &item_stat_ptr, ctx->walk.stats ) )
+			continue;
+
+		dir_walk_item item;
+		item.path     = path_buffer;
+		item.relative = path_buffer + ctx->walk.root_len + 1;
+		item.name     = path_buffer + path_len + 1;
+		item.type     = item_type;
+		item.stat     = item_stat_ptr;
+		item.userdata = ctx->walk.userdata;
+
+		const uint64_t* item_states = ctx->states + ( depth + 1 ) * ctx->state_words;
+		bool is_match = dir_walk_glob_is_match( ctx, item_states );
+
+		if( item.type == DIR_ITEM_DIR && dir_walk_glob_can_descend( ctx, item_states ) )
+		{
+			bool depth_first = (ctx->walk.flags & DIR_WALK_DEPTH_FIRST) > 0;
+
+			int cb_res = DIR_WALK_CONTINUE;
+			if( !depth_first && is_match )
+				cb_res = ctx->walk.callback( &item );
+			if( cb_res == DIR_WALK_ABORT )
+			{
+				res = DIR_ERROR_ABORTED;
+				break;
+			}
+
+			if( cb_res != DIR_WALK_SKIP_SUBTREE )
+			{
+				dir_error sub_res = dir_walk_glob_impl( ctx, &reader, path_len + item_len + 1, path_len + 1, depth + 1 );
+				if( sub_res == DIR_ERROR_ABORTED || sub_res == DIR_ERROR_PATH_TO_DEEP )
+				{
+					res = sub_res;
+					break;
+				}
+
+				// the sub-walk might have moved the path-buffer.
+				item.path     = ctx->walk.path_buffer;
+				item.relative = ctx->walk.path_buffer + ctx->walk.root_len + 1;
+				item.name     = ctx->walk.path_buffer + path_len + 1;
+			}
+
+			if( depth_first && is_match && ctx->walk.callback( &item ) == DIR_WALK_ABORT )
+			{
+				res = DIR_ERROR_ABORTED;
+				break;
+			}
+		}
+		else if( is_match && ctx->walk.callback( &item ) == DIR_WALK_ABORT )
+		{
+			res = DIR_ERROR_ABORTED;
+			break;
+		}
+	}
+
+	dir_reader_close( &reader );
+	ctx->walk.path_buffer[path_len] = '\0';
+	return res;
+}
+
+dir_error dir_walk_glob( const char* root, const char* glob_pattern, unsigned int flags, dir_walk_callback callback, void* userdata )
+{
+	dir_glob* glob = dir_glob_compile( glob_pattern );
+	if( glob == 0x0 )
+		return DIR_ERROR_INVALID_PATTERN;
+
+	char path_buffer[4096];
+	dir_walk_glob_ctx ctx;
+	ctx.walk.flags            = flags;
+	ctx.walk.callback         = callback;
+	ctx.walk.userdata         = userdata;
+	ctx.walk.path_buffer      = path_buffer;
+	ctx.walk.path_buffer_size = sizeof( path_buffer );
+	dir_walk_init_buffers( &ctx.walk );
+	ctx.walk.stats            = 0x0;
+	ctx.glob                  = glob;
+	ctx.state_words           = glob->num_segments / 64 + 1;
+	ctx.states                = 0x0;
+	ctx.states_capacity       = 0;
+
+	// leading path-segments that are plain names, except the last one, can only match one dir each and that dir
+	// can never match the complete pattern, so go directly to the first dir that need to be read.
+	// dirs starting with '.' are left to the walk to be filtered by flags.
+	size_t    root_len      = 0;
+	size_t    path_len      = 0;
+	uint32_t  first_segment = 0;
+	dir_error res           = DIR_ERROR_OK;
+	if( dir_walk_copy_root( &ctx.walk, root ) )
+		root_len = path_len = ctx.walk.root_len;
+	else
+		res = DIR_ERROR_PATH_TO_DEEP;
+	while( res == DIR_ERROR_OK && first_segment + 1 < glob->num_segments )
+	{
+		const dir_glob_segment* seg = &glob->segments[first_segment];
+		const dir_glob_op*      op  = &glob->ops[seg->first_op];
+		if( seg->any_segments || seg->num_ops != 1 || op->type != DIR_GLOB_OP_LITERAL )
+			break;
+
+		const char* name = glob->literals + op->arg;
+		if( !dir_walk_path_reserve( &ctx.walk, path_len + op->len + 3 ) )
+		{
+			res = DIR_ERROR_PATH_TO_DEEP;
+			break;
+		}
+		if( name[0] == '.' )
+			break;
+		ctx.walk.path_buffer[path_len] = '/';
+		memcpy( ctx.walk.path_buffer + path_len + 1, name, op->len );
+		path_len += op->len + 1;
+		ctx.walk.path_buffer[path_len] = '\0';
+		++first_segment;
+	}
+
+	if( res == DIR_ERROR_OK )
+	{
+		if( dir_array_grow( &ctx.states, &ctx.states_capacity, 2 * ctx.state_words ) )
+		{
+			memset( ctx.states, 0, ctx.state_words * sizeof( uint64_t ) );
+			dir_glob_add_state( glob, ctx.states, first_segment );
+			res = dir_walk_glob_impl( &ctx, 0x0, path_len, 0, 0 );
+
+			// a missing literal dir is just no matches, but the root need to exist.
+			dir_item_stat root_stat;
+			ctx.walk.path_buffer[root_len] = '\0';
+			if( res == DIR_ERROR_PATH_DO_NOT_EXIST && first_segment > 0 && dir_stat_path( ctx.walk.path_buffer, &root_stat ) && dir_stat_is_dir( &root_stat ) )
+				res = DIR_ERROR_OK;
+		}
+		else
+			res = DIR_ERROR_FAILED;
+	}
+
+	dir_walk_free_buffers( &ctx.walk );
+	free( ctx.states );
+	dir_glob_free( glob );
+	return res;
+}
+
+/**
+ * Same as dir_walk_glob_impl() but over the nodes of a tree, ctx->walk.path_buffer only contains the path relative
+ * the root of the tree.
+ */
+static dir_error dir_tree_walk_glob_impl( dir_walk_glob_ctx* ctx, const dir_tree* tree, uint32_t node, size_t path_len, size_t depth )
+{
+	if( !dir_array_grow( &ctx->states, &ctx->states_capacity, ( depth + 2 ) * ctx->state_words ) )
+		return DIR_ERROR_FAILED;
+
+	const dir_snapshot* snap        = &tree->snap;
+	size_t              name_offset = path_len > 0 ? path_len + 1 : 0;
+	bool                depth_first = ( ctx->walk.flags & DIR_WALK_DEPTH_FIRST ) > 0;
+
+	dir_error res = DIR_ERROR_OK;
+	uint32_t first_child = snap->first_child[node];
+	uint32_t child_end   = first_child + snap->child_count[node];
+	for( uint32_t child = first_child; child < child_end; ++child )
+	{
+		const char*   item_name = snap->names + snap->name_offset[child];
+		dir_item_type item_type = (dir_item_type)snap->type[child];
+		if( item_name[0] == '.' && dir_walk_skip_dot( item_type, ctx->walk.flags ) )
+			continue;
+
+		if( !dir_walk_glob_step( ctx, ctx->states + depth * ctx->state_words, ctx->states + ( depth + 1 ) * ctx->state_words, item_name ) )
+			continue;
+
+		size_t item_len = strlen( item_name );
+		if( !dir_walk_path_reserve( &ctx->walk, name_offset + item_len + 1 ) )
+		{
+			res = DIR_ERROR_PATH_TO_DEEP;
+			break;
+		}
+		char* path_buffer = ctx->walk.path_buffer;
+		if( path_len > 0 )
+			path_buffer[path_len] = '/';
+		memcpy( &path_buffer[name_offset], item_name, item_len + 1 );
+
+		dir_item_stat item_stat;
+		memset( &item_stat, 0x0, sizeof( item_stat ) );
+		if( snap->size != 0x0 )
+		{
+			item_stat.size     = snap->size[child];
+			item_stat.mtime_ns = snap->mtime_ns[child];
+		}
+
+		dir_walk_item item;
+		item.path     = path_buffer;
+		item.relative = path_buffer;
+		item.name     = path_buffer + name_offset;
+		item.type     = item_type;
+		item.stat     = snap->size != 0x0 ? &item_stat : 0x0;
+		item.userdata = ctx->walk.userdata;
+
+		const uint64_t* item_states = ctx->states + ( depth + 1 ) * ctx->state_words;
+		bool is_match = dir_walk_glob_is_match( ctx, item_states );
+
+		if( item.type == DIR_ITEM_DIR && dir_walk_glob_can_descend( ctx, item_states ) )
+		{
+			int cb_res = DIR_WALK_CONTINUE;
+			if( !depth_first && is_match )
+				cb_res = ctx->walk.callback( &item );
+			if( cb_res == DIR_WALK_ABORT )
+			{
+				res = DIR_ERROR_ABORTED;
+				break;
+			}
+
+			if( cb_res != DIR_WALK_SKIP_SUBTREE )
+			{
+				dir_error sub_res = dir_tree_walk_glob_impl( ctx, tree, child, name_offset + item_len, depth + 1 );
+				if( sub_res != DIR_ERROR_OK )
+				{
+					res = sub_res;
+					break;
+				}
+
+				// the sub-walk might have moved the path-buffer.
+				item.path     = ctx->walk.path_buffer;
+				item.relative = ctx->walk.path_buffer;
+				item.name     = ctx->walk.path_buffer + name_offset;
+			}
+
+			if( depth_first && is_match && ctx->walk.callback( &item ) == DIR_WALK_ABORT )
+			{
+				res = DIR_ERROR_ABORTED;
+				break;
+			}
+		}
+		else if( is_match && ctx->walk.callback( &item ) == DIR_WALK_ABORT )
+		{
+			res = DIR_ERROR_ABORTED;
+			break;
+		}
+	}
+
+	ctx->walk.path_buffer[path_len] = '\0';
+	return res;
+}
+
+dir_error dir_tree_walk_glob( const dir_tree* tree, const char* glob_pattern, unsigned int flags, dir_walk_callback callback, void* userdata )
+{
+	dir_glob* glob = dir_glob_compile( glob_pattern );
+	if( glob == 0x0 )
+		return DIR_ERROR_INVALID_PATTERN;
+
+	char path_buffer[4096];
+	path_buffer[0] = '\0';
+
+	dir_walk_glob_ctx ctx;
+	ctx.walk.flags            = flags;
+	ctx.walk.callback         = callback;
+	ctx.walk.userdata         = userdata;
+	ctx.walk.root_len         = 0;
+	ctx.walk.path_buffer      = path_buffer;
+	ctx.walk.path_buffer_size = sizeof( path_buffer );
+	dir_walk_init_buffers( &ctx.walk );
+	ctx.walk.stats            = 0x0;
+	ctx.glob                  = glob;
+	ctx.state_words           = glob->num_segments / 64 + 1;
+	ctx.states                = 0x0;
+	ctx.states_capacity       = 0;
+
+	dir_error res = DIR_ERROR_FAILED;
+	if( dir_array_grow( &ctx.states, &ctx.states_capacity, 2 * ctx.state_words ) )
+	{
+		memset( ctx.states, 0, ctx.state_words * sizeof( uint64_t ) );
+		dir_glob_add_state( glob, ctx.states, 0 );
+		res = dir_tree_walk_glob_impl( &ctx, tree, 0, 0, 0 );
+	}
+
+	dir_walk_free_buffers( &ctx.walk );
+	free( ctx.states );
+	dir_glob_free( glob );
+	return res;
+}
+
+#if defined( __linux__ )
+static const size_t DIR_WATCH_NO_NODE = ~(size_t)0;
+
+// stop collecting a batch after this many changes, even if events keep arriving.
+static const size_t DIR_WATCH_MAX_BATCH = 64 * 1024;
+
+#define DIR_WATCH_MASK ( IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | \
+						 IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK )
+
+/**
+ * Item known by a watch, node 0 is the root itself.
+ */
+struct dir_watch_node
+{
+	// path relative root, "" for the root and 0x0 for unused nodes.
+	char*         path;
+	size_t        path_len;
+	uint64_t      hash;
+
+	// next node in the same bucket, or the next unused node.
+	size_t        next;
+
+	dir_item_type type;
+
+	// inotify watch-descriptor if the node is a watched dir, otherwise -1.
+	int           wd;
+
+	// number of nodes directly below this one.
+	size_t        num_children;
+
+	// metadata last reported, used to find modified files when rescanning.
+	uint64_t      size;
+	uint64_t      mtime_ns;
+
+	// generation of the last scan that found the node.
+	uint32_t      generation;
+};
+
+/**
+ * Change collected while a batch settles, several changes of the same item are coalesced before reporting.
+ */
+struct dir_watch_change
+{
+	size_t          path_offset;
+	size_t          seq;
+	dir_change_type change;
+	dir_item_type   type;
+};
+
+struct dir_watch
+{
+	int               fd;
+	unsigned int      flags;
+	dir_glob*         glob;
+	size_t            root_len;
+	bool              root_removed;
+	bool              overflowed;
+	uint32_t          generation;
+
+	dir_watch_node*   nodes;
+	size_t            num_nodes;
+	size_t            nodes_capacity;
+	size_t            free_nodes;
+	size_t*           buckets;
+	size_t            num_buckets;
+	size_t            num_used;
+
+	// node watched by each watch-descriptor, indexed by wd.
+	size_t*           wd_nodes;
+	size_t            wd_nodes_capacity;
+
+	// changes in the current batch with their paths relative root stored after each other in change_names.
+	dir_watch_change* changes;
+	size_t            num_changes;
+	size_t            changes_capacity;
+	char*             change_names;
+	size_t            change_names_size;
+	size_t            change_names_capacity;
+
+	// root followed by '/' and the relative path of the item currently handled.
+	char*             path_buffer;
+	size_t            path_buffer_capacity;
+
+	// what is passed to the callback when reporting a batch, paths are stored in event_paths.
+	dir_watch_event*  events;
+	size_t            events_capacity;
+	dir_item_stat*    event_stats;
+	size_t            event_stats_capacity;
+	char*             event_paths;
+	size_t            event_paths_capacity;
+};
+
+static size_t dir_watch_find( const dir_watch* w, const char* path, size_t path_len )
+{
+	if( w->num_buckets == 0 )
+		return DIR_WATCH_NO_NODE;
+	uint64_t hash = dir_hash_fnv1a( path, path_len );
+	for( size_t n = w->buckets[hash & ( w->num_buckets - 1 )]; n != DIR_WATCH_NO_NODE; n = w->nodes[n].next )
+	{
+		const dir_watch_node* node = &w->nodes[n];
+		if( node->hash == hash && node->path_len == path_len && memcmp( node->path, path, path_len ) == 0 )
+			return n;
+	}
+	return DIR_WATCH_NO_NODE;
+}
+
+/**
+ * Find the node of the dir that path is in.
+ */
+static size_t dir_watch_find_parent( const dir_watch* w, const char* path, size_t path_len )
+{
+	while( path_len > 0 && path[path_len - 1] != '/' )
+		--path_len;
+	return dir_watch_find( w, path, path_len > 0 ? path_len - 1 : 0 );
+}
+
+static bool dir_watch_rehash( dir_watch* w )
+{
+	size_t num_buckets = w->num_buckets == 0 ? 64 : w->num_buckets * 2;
+	size_t* buckets = (size_t*)realloc( w->buckets, num_buckets * sizeof( size_t ) );
+	if( buckets == 0x0 )
+		return false;
+	w->buckets     = buckets;
+	w->num_buckets = num_buckets;
+	for( size_t b = 0; b < num_buckets; ++b )
+		buckets[b] = DIR_WATCH_NO_NODE;
+	for( size_t n = 0; n < w->num_nodes; ++n )
+	{
+		if( w->nodes[n].path == 0x0 )
+			continue;
+		size_t* bucket = &buckets[w->nodes[n].hash & ( num_buckets - 1 )];
+		w->nodes[n].next = *bucket;
+		*bucket = n;
+	}
+	return true;
+}
+
+/**
+ * Add node for path, that must not already be known.
+ * @return index of the new node or DIR_WATCH_NO_NODE on failure.
+ */
+static size_t dir_watch_insert( dir_watch* w, const char* path, size_t path_len, dir_item_type type )
+{
+	// rehash to keep chains short.
+	if( w->num_used >= w->num_buckets && !dir_watch_rehash( w ) )
+		return DIR_WATCH_NO_NODE;
+
+	size_t n = w->free_nodes;
+	if( n == DIR_WATCH_NO_NODE )
+	{
+		if( !dir_array_grow( &w->nodes, &w->nodes_capacity, w->num_nodes + 1 ) )
+			return DIR_WATCH_NO_NODE;
+		n = w->num_nodes;
+	}
+
+	char* node_path = (char*)malloc( path_len + 1 );
+	if( node_path == 0x0 )
+		return DIR_WATCH_NO_NODE;
+	memcpy( node_path, path, path_len );
+	node_path[path_len] = '\0';
+
+	if( n == w->free_nodes )
+		w->free_nodes = w->nodes[n].next;
+	else
+		++w->num_nodes;
+
+	dir_watch_node* node = &w->nodes[n];
+	node->path         = node_path;
+	node->path_len     = path_len;
+	node->hash         = dir_hash_fnv1a( path, path_len );
+	node->type         = type;
+	node->wd           = -1;
+	node->num_children = 0;
+	node->size         = 0;
+	node->mtime_ns     = 0;
+	node->generation   = w->generation;
+
+	size_t* bucket = &w->buckets[node->hash & ( w->num_buckets - 1 )];
+	node->next = *bucket;
+	*bucket = n;
+	++w->num_used;
+
+	if( path_len > 0 )
+	{
+		size_t parent = dir_watch_find_parent( w, path, path_len );
+		if( parent != DIR_WATCH_NO_NODE )
+			++w->nodes[parent].num_children;
+	}
+	return n;
+}
+
+/**
+ * Forget node and stop watching it if it is a dir, nodes below it are not touched.
+ */
+static void dir_watch_remove( dir_watch* w, size_t n )
+{
+	dir_watch_node* node = &w->nodes[n];
+	for( size_t* link = &w->buckets[node->hash & ( w->num_buckets - 1 )]; *link != DIR_WATCH_NO_NODE; link = &w->nodes[*link].next )
+	{
+		if( *link == n )
+		{
+			*link = node->next;
+			break;
+		}
+	}
+
+	if( node->wd >= 0 )
+	{
+		// the watch might already be gone with the dir, then this just fails.
+		inotify_rm_watch( w->fd, node->wd );
+		w->wd_nodes[node->wd] = DIR_WATCH_NO_NODE;
+	}
+
+	if( node->path_len > 0 )
+	{
+		size_t parent = dir_watch_find_parent( w, node->path, node->path_len );
+		if( parent != DIR_WATCH_NO_NODE )
+			--w->nodes[parent].num_children;
+	}
+
+	free( node->path );
+	node->path = 0x0;
+	node->next = w->free_nodes;
+	w->free_nodes = n;
+	--w->num_used;
+}
+
+/**
+ * Write root + '/' + path to the path-buffer.
+ * @return the full path or 0x0 on failure, the relative path starts at root_len + 1 in it.
+ */
+static char* dir_watch_full_path( dir_watch* w, const char* path, size_t path_len )
+{
+	if( !dir_array_grow( &w->path_buffer, &w->path_buffer_capacity, w->root_len + path_len + 2 ) )
+		return 0x0;
+	if( path_len == 0 )
+	{
+		w->path_buffer[w->root_len] = '\0';
+		return w->path_buffer;
+	}
+	w->path_buffer[w->root_len] = '/';
+	memmove( w->path_buffer + w->root_len + 1, path, path_len );
+	w->path_buffer[w->root_len + 1 + path_len] = '\0';
+	return w->path_buffer;
+}
+
+static bool dir_watch_add_watch( dir_watch* w, size_t n, const char* full_path )
+{
+	int wd = inotify_add_watch( w->fd, full_path, DIR_WATCH_MASK );
+	if( wd < 0 )
+		return false;
+
+	size_t old_capacity = w->wd_nodes_capacity;
+	if( !dir_array_grow( &w->wd_nodes, &w->wd_nodes_capacity, (size_t)wd + 1 ) )
+	{
+		inotify_rm_watch( w->fd, wd );
+		return false;
+	}
+	for( size_t i = old_capacity; i < w->wd_nodes_capacity; ++i )
+		w->wd_nodes[i] = DIR_WATCH_NO_NODE;
+	w->wd_nodes[wd] = n;
+	w->nodes[n].wd  = wd;
+	return true;
+}
+
+static void dir_watch_push( dir_watch* w, dir_change_type change, dir_item_type type, const char* path, size_t path_len )
+{
+	// if this fails the change is lost, but the watch keeps working.
+	if( !dir_array_grow( &w->changes, &w->changes_capacity, w->num_changes + 1 ) ||
+		!dir_array_grow( &w->change_names, &w->change_names_capacity, w->change_names_size + path_len + 1 ) )
+		return;
+
+	dir_watch_change* c = &w->changes[w->num_changes];
+	c->path_offset = w->change_names_size;
+	c->seq         = w->num_changes++;
+	c->change      = change;
+	c->type        = type;
+	memcpy( w->change_names + w->change_names_size, path, path_len );
+	w->change_names[w->change_names_size + path_len] = '\0';
+	w->change_names_size += path_len + 1;
+}
+
+/**
+ * Forget node and everything below it, reporting it all as removed.
+ */
+static void dir_watch_remove_tree( dir_watch* w, size_t n )
+{
+	dir_watch_node* node = &w->nodes[n];
+	if( node->num_children > 0 )
+	{
+		for( size_t i = 0; i < w->num_nodes; ++i )
+		{
+			const dir_watch_node* child = &w->nodes[i];
+			if( child->path == 0x0 || child->path_len <= node->path_len ||
+				child->path[node->path_len] != '/' || memcmp( child->path, node->path, node->path_len ) != 0 )
+				continue;
+			dir_watch_push( w, DIR_CHANGE_REMOVED, child->type, child->path, child->path_len );
+			dir_watch_remove( w, i );
+		}
+	}
+	if( n != 0 )
+	{
+		dir_watch_push( w, DIR_CHANGE_REMOVED, node->type, node->path, node->path_len );
+		dir_watch_remove( w, n );
+	}
+}
+
+struct dir_watch_scan_ctx
+{
+	dir_watch* watch;
+	bool       report;
+	dir_error  error;
+};
+
+static int dir_watch_scan_item( const dir_walk_item* item )
+{
+	dir_watch_scan_ctx* ctx = (dir_watch_scan_ctx*)item->userdata;
+	dir_watch* w = ctx->watch;
+	const char* path = item->path + w->root_len + 1;
+	size_t path_len  = strlen( path );
+
+	size_t n = dir_watch_find( w, path, path_len );
+	if( n != DIR_WATCH_NO_NODE && w->nodes[n].type != item->type )
+	{
+		// replaced by an item of another type.
+		dir_watch_remove_tree( w, n );
+		n = DIR_WATCH_NO_NODE;
+	}
+
+	if( n == DIR_WATCH_NO_NODE )
+	{
+		n = dir_watch_insert( w, path, path_len, item->type );
+		if( n == DIR_WATCH_NO_NODE )
+		{
+			ctx->error = DIR_ERROR_FAILED;
+			return DIR_WALK_ABORT;
+		}
+		if( ctx->report )
+			dir_watch_push( w, DIR_CHANGE_ADDED, item->type, path, path_len );
+	}
+	else if( ctx->report && item->type == DIR_ITEM_FILE && item->stat != 0x0 &&
+			 ( w->nodes[n].size != item->stat->size || w->nodes[n].mtime_ns != item->stat->mtime_ns ) )
+		dir_watch_push( w, DIR_CHANGE_MODIFIED, item->type, path, path_len );
+
+	dir_watch_node* node = &w->nodes[n];
+	node->generation = w->generation;
+	if( item->stat != 0x0 )
+	{
+		node->size     = item->stat->size;
+		node->mtime_ns = item->stat->mtime_ns;
+	}
+
+	// watch before the dir is read by the walk so that nothing created in between is missed.
+	if( item->type == DIR_ITEM_DIR && node->wd < 0 && !dir_watch_add_watch( w, n, item->path ) )
+		return DIR_WALK_SKIP_SUBTREE;
+	return DIR_WALK_CONTINUE;
+}
+
+/**
+ * Walk the dir of node n, adding all items not known and, if report is set, report them as added and files that
+ * changed as modified.
+ */
+static dir_error dir_watch_scan( dir_watch* w, size_t n, bool report )
+{
+	char* full_path = dir_watch_full_path( w, w->nodes[n].path, w->nodes[n].path_len );
+	if( full_path == 0x0 )
+		return DIR_ERROR_FAILED;
+
+	// the walk use its own path-buffer, as the watch path-buffer is reused while walking.
+	dir_watch_scan_ctx ctx;
+	ctx.watch  = w;
+	ctx.report = report;
+	ctx.error  = DIR_ERROR_OK;
+	char* root = (char*)malloc( strlen( full_path ) + 1 );
+	if( root == 0x0 )
+		return DIR_ERROR_FAILED;
+	strcpy( root, full_path );
+	dir_error res = dir_walk( root, ( w->flags & DIR_WALK_IGNORE_DOT_ITEMS ) | DIR_WALK_WITH_STAT, dir_watch_scan_item, &ctx );
+	free( root );
+	return ctx.error != DIR_ERROR_OK ? ctx.error : res;
+}
+
+/**
+ * Rescan the whole tree and report everything that differ from the known nodes, used when events were lost.
+ */
+static dir_error dir_watch_rescan_all( dir_watch* w )
+{
+	++w->generation;
+	w->nodes[0].generation = w->generation;
+	dir_error res = dir_watch_scan( w, 0, true );
+	if( res != DIR_ERROR_OK )
+		return res;
+
+	// nodes not found by the scan are gone.
+	for( size_t n = 1; n < w->num_nodes; ++n )
+	{
+		if( w->nodes[n].path == 0x0 || w->nodes[n].generation == w->generation )
+			continue;
+		dir_watch_push( w, DIR_CHANGE_REMOVED, w->nodes[n].type, w->nodes[n].path, w->nodes[n].path_len );
+		dir_watch_remove( w, n );
+	}
+	return DIR_ERROR_OK;
+}
+
+static void dir_watch_added( dir_watch* w, const char* full_path, const char* path, size_t path_len, dir_item_type type )
+{
+	size_t n = dir_watch_find( w, path, path_len );
+	if( n != DIR_WATCH_NO_NODE && w->nodes[n].type != type )
+	{
+		dir_watch_remove_tree( w, n );
+		n = DIR_WATCH_NO_NODE;
+	}
+
+	if( n != DIR_WATCH_NO_NODE )
+	{
+		// i.e. a file renamed over an existing one.
+		if( type == DIR_ITEM_FILE )
+			dir_watch_push( w, DIR_CHANGE_MODIFIED, type, path, path_len );
+		return;
+	}
+
+	n = dir_watch_insert( w, path, path_len, type );
+	if( n == DIR_WATCH_NO_NODE )
+		return;
+	dir_watch_push( w, DIR_CHANGE_ADDED, type, path, path_len );
+
+	// items might have been created, or moved, into a new dir before it was watched.
+	if( type == DIR_ITEM_DIR && dir_watch_add_watch( w, n, full_path ) )
+		dir_watch_scan( w, n, true );
+}
+
+static void dir_watch_handle_event( dir_watch* w, const struct inotify_event* ev )
+{
+	if( ( ev->mask & IN_Q_OVERFLOW ) > 0 )
+	{
+		w->overflowed = true;
+		return;
+	}
+	if( ev->wd < 0 || (size_t)ev->wd >= w->wd_nodes_capacity )
+		return;
+
+	size_t dir = w->wd_nodes[ev->wd];
+	if( dir == DIR_WATCH_NO_NODE )
+		return;
+
+	if( ( ev->mask & ( IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED ) ) > 0 )
+	{
+		// dirs below the root are handled via the events of their parent.
+		if( dir == 0 && !w->root_removed )
+		{
+			w->root_removed = true;
+			dir_watch_remove_tree( w, 0 );
+		}
+		if( ( ev->mask & IN_IGNORED ) > 0 )
+		{
+			w->nodes[dir].wd = -1;
+			w->wd_nodes[ev->wd] = DIR_WATCH_NO_NODE;
+		}
+		return;
+	}
+	if( ev->len == 0 || w->root_removed )
+		return;
+
+	dir_item_type type = ( ev->mask & IN_ISDIR ) > 0 ? DIR_ITEM_DIR : DIR_ITEM_FILE;
+	if( ev->name[0] == '.' && dir_walk_skip_dot( type, w->flags ) )
+		return;
+
+	// build the path in the path-buffer via a copy of the dir-path, as the buffer might move.
+	const dir_watch_node* dir_node = &w->nodes[dir];
+	size_t name_len = strlen( ev->name );
+	size_t path_len = dir_node->path_len > 0 ? dir_node->path_len + 1 + name_len : name_len;
+	if( !dir_array_grow( &w->path_buffer, &w->path_buffer_capacity, w->root_len + path_len + 2 ) )
+		return;
+	char* full_path = w->path_buffer;
+	char* path      = full_path + w->root_len + 1;
+	full_path[w->root_len] = '/';
+	memcpy( path, dir_node->path, dir_node->path_len );
+	if( dir_node->path_len > 0 )
+		path[dir_node->path_len] = '/';
+	memcpy( path + path_len - name_len, ev->name, name_len + 1 );
+
+	if( ( ev->mask & ( IN_DELETE | IN_MOVED_FROM ) ) > 0 )
+	{
+		size_t n = dir_watch_find( w, path, path_len );
+		if( n != DIR_WATCH_NO_NODE )
+			dir_watch_remove_tree( w, n );
+	}
+	else if( ( ev->mask & ( IN_CREATE | IN_MOVED_TO ) ) > 0 )
+		dir_watch_added( w, full_path, path, path_len, type );
+	else if( type == DIR_ITEM_FILE )
+	{
+		if( dir_watch_find( w, path, path_len ) == DIR_WATCH_NO_NODE )
+			dir_watch_added( w, full_path, path, path_len, type );
+		else
+			dir_watch_push( w, DIR_CHANGE_MODIFIED, type, path, path_len );
+	}
+}
+
+/**
+ * Read and handle all events available on the inotify fd.
+ * @return false on read-error.
+ */
+static bool dir_watch_read( dir_watch* w )
+{
+	char buffer[16 * 1024] __attribute__(( aligned( __alignof__( struct inotify_event ) ) ));
+	while( true )
+	{
+		ssize_t size = read( w->fd, buffer, sizeof( buffer ) );
+		if( size < 0 )
+			return errno == EAGAIN || errno == EINTR;
+		if( size == 0 )
+			return true;
+
+		for( ssize_t pos = 0; pos < size; )
+		{
+			const struct inotify_event* ev = (const struct inotify_event*)( buffer + pos );
+			dir_watch_handle_event( w, ev );
+			pos += (ssize_t)( sizeof( struct inotify_event ) + ev->len );
+		}
+
+		if( w->overflowed )
+		{
+			// events are lost, so everything known about the tree has to be verified.
+			w->overflowed = false;
+			dir_watch_rescan_all( w );
+		}
+	}
+}
+
+/**
+ * Coalesce the changes of the current batch to at most one per item and pass them to callback.
+ */
+static void dir_watch_report( dir_watch* w, dir_watch_callback callback, void* userdata )
+{
+	const char* names = w->change_names;
+	std::sort( w->changes, w->changes + w->num_changes,
+		[names]( const dir_watch_change& c1, const dir_watch_change& c2 ) {
+			int cmp = strcmp( names + c1.path_offset, names + c2.path_offset );
+			return cmp != 0 ? cmp < 0 : c1.seq < c2.seq;
+		});
+
+	// first find what to report, with offsets into event_paths as it might move while growing.
+	size_t num_events       = 0;
+	size_t event_paths_size = 0;
+	for( size_t first = 0; first < w->num_changes; )
+	{
+		const char* path = names + w->changes[first].path_offset;
+		size_t last = first;
+		while( last + 1 < w->num_changes && strcmp( names + w->changes[last + 1].path_offset, path ) == 0 )
+			++last;
+
+		// only the state before the first and after the last change matters.
+		bool existed = w->changes[first].change != DIR_CHANGE_ADDED;
+		bool exists  = w->changes[last].change  != DIR_CHANGE_REMOVED;
+		dir_item_type type = w->changes[last].type;
+		first = last + 1;
+
+		dir_change_type change;
+		if( existed && exists )
+		{
+			// dirs are never reported as modified, changes of the items in them are reported instead.
+			if( type == DIR_ITEM_DIR )
+				continue;
+			change = DIR_CHANGE_MODIFIED;
+		}
+		else if( exists )
+			change = DIR_CHANGE_ADDED;
+		else if( existed )
+			change = DIR_CHANGE_REMOVED;
+		else
+			continue;
+
+		if( w->glob != 0x0 && dir_glob_match_compiled( w->glob, path ) != DIR_GLOB_MATCH )
+			continue;
+
+		size_t path_len = strlen( path );
+		char* full_path = dir_watch_full_path( w, path, path_len );
+		size_t full_len = w->root_len + 1 + path_len;
+		if( full_path == 0x0 ||
+			!dir_array_grow( &w->events, &w->events_capacity, num_events + 1 ) ||
+			!dir_array_grow( &w->event_stats, &w->event_stats_capacity, num_events + 1 ) ||
+			!dir_array_grow( &w->event_paths, &w->event_paths_capacity, event_paths_size + full_len + 1 ) )
+			break;
+		memcpy( w->event_paths + event_paths_size, full_path, full_len + 1 );
+
+		dir_watch_event* e = &w->events[num_events];
+		e->change        = change;
+		e->item.path     = (const char*)(uintptr_t)event_paths_size;
+		e->item.type     = type;
+		e->item.stat     = 0x0;
+		e->item.userdata = userdata;
+		event_paths_size += full_len + 1;
+
+		// remember the current metadata so that a rescan does not report the change again.
+		dir_item_stat* stat = &w->event_stats[num_events];
+		if( change != DIR_CHANGE_REMOVED && dir_stat_path( full_path, stat ) )
+		{
+			size_t n = dir_watch_find( w, path, path_len );
+			if( n != DIR_WATCH_NO_NODE )
+			{
+				w->nodes[n].size     = stat->size;
+				w->nodes[n].mtime_ns = stat->mtime_ns;
+			}
+			if( ( w->flags & DIR_WALK_WITH_STAT ) > 0 )
+				e->item.stat = stat;
+		}
+		++num_events;
+	}
+
+	for( size_t i = 0; i < num_events; ++i )
+	{
+		dir_walk_item* item = &w->events[i].item;
+		item->path     = w->event_paths + (uintptr_t)item->path;
+		item->relative = item->path + w->root_len + 1;
+		item->name     = strrchr( item->path, '/' ) + 1;
+	}
+
+	w->num_changes       = 0;
+	w->change_names_size = 0;
+	if( num_events > 0 )
+		callback( w->events, num_events, userdata );
+}
+
+static uint64_t dir_watch_now_ms()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+dir_error dir_watch_open( const char* root, const char* glob_pattern, unsigned int flags, dir_watch** out_watch )
+{
+	*out_watch = 0x0;
+
+	dir_glob* glob = 0x0;
+	if( glob_pattern != 0x0 && ( glob = dir_glob_compile( glob_pattern ) ) == 0x0 )
+		return DIR_ERROR_INVALID_PATTERN;
+
+	dir_item_stat root_stat;
+	if( !dir_stat_path( root, &root_stat ) || !dir_stat_is_dir( &root_stat ) )
+	{
+		dir_glob_free( glob );
+		return DIR_ERROR_PATH_DO_NOT_EXIST;
+	}
+
+	dir_watch* w = (dir_watch*)malloc( sizeof( dir_watch ) );
+	if( w == 0x0 )
+	{
+		dir_glob_free( glob );
+		return DIR_ERROR_FAILED;
+	}
+	memset( w, 0x0, sizeof( dir_watch ) );
+	w->fd         = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+	w->flags      = flags;
+	w->glob       = glob;
+	w->free_nodes = DIR_WATCH_NO_NODE;
+
+	// normalize input path to only strip of trailing / if there is one.
+	w->root_len = strlen( root );
+	if( w->root_len > 0 && root[w->root_len - 1] == '/' )
+		--w->root_len;
+
+	dir_error res = DIR_ERROR_FAILED;
+	if( w->fd >= 0 && dir_array_grow( &w->path_buffer, &w->path_buffer_capacity, w->root_len + 2 ) )
+	{
+		memcpy( w->path_buffer, root, w->root_len );
+		w->path_buffer[w->root_len] = '\0';
+		if( dir_watch_insert( w, "", 0, DIR_ITEM_DIR ) == 0 && dir_watch_add_watch( w, 0, w->path_buffer ) )
+			res = dir_watch_scan( w, 0, false );
+	}
+
+	if( res != DIR_ERROR_OK )
+	{
+		dir_watch_close( w );
+		return res;
+	}
+	*out_watch = w;
+	return DIR_ERROR_OK;
+}
+
+void dir_watch_close( dir_watch* watch )
+{
+	if( watch->fd >= 0 )
+		close( watch->fd );
+	for( size_t n = 0; n < watch->num_nodes; ++n )
+		free( watch->nodes[n].path );
+	free( watch->nodes );
+	free( watch->buckets );
+	free( watch->wd_nodes );
+	free( watch->changes );
+	free( watch->change_names );
+	free( watch->path_buffer );
+	free( watch->events );
+	free( watch->event_stats );
+	free( watch->event_paths );
+	dir_glob_free( watch->glob );
+	free( watch );
+}
+
+int dir_watch_fd( const dir_watch* watch )
+{
+	return watch->fd;
+}
+
+dir_error dir_watch_poll( dir_watch* watch, int timeout_ms, unsigned int settle_ms, dir_watch_callback callback, void* userdata )
+{
+	if( watch->root_removed )
+		return DIR_ERROR_PATH_DO_NOT_EXIST;
+
+	// a batch is reported when events stop arriving, or after a while if they never do.
+	uint64_t deadline = 0;
+	int      wait_ms  = timeout_ms;
+	dir_error res = DIR_ERROR_OK;
+	while( true )
+	{
+		struct pollfd pfd;
+		pfd.fd      = watch->fd;
+		pfd.events  = POLLIN;
+		pfd.revents = 0;
+		int ready = poll( &pfd, 1, wait_ms );
+		if( ready < 0 && errno == EINTR )
+			continue;
+		if( ready < 0 )
+			res = DIR_ERROR_FAILED;
+		if( ready <= 0 )
+			break;
+
+		if( !dir_watch_read( watch ) )
+		{
+			res = DIR_ERROR_FAILED;
+			break;
+		}
+		if( watch->root_removed || watch->num_changes >= DIR_WATCH_MAX_BATCH )
+			break;
+
+		uint64_t now = dir_watch_now_ms();
+		if( deadline == 0 )
+			deadline = now + std::max( (uint64_t)settle_ms * 10, (uint64_t)1000 );
+		if( now >= deadline )
+			break;
+		wait_ms = (int)std::min( (uint64_t)settle_ms, deadline - now );
+	}
+
+	dir_watch_report( watch, callback, userdata );
+	if( res == DIR_ERROR_OK && watch->root_removed )
+		res = DIR_ERROR_PATH_DO_NOT_EXIST;
+	return res;
+}
+
+dir_error dir_watch_rescan( dir_watch* watch, dir_watch_callback callback, void* userdata )
+{
+	if( watch->root_removed )
+		return DIR_ERROR_PATH_DO_NOT_EXIST;
+
+	// handle what is already queued first, so that it is not reported as found by the rescan.
+	dir_error res = dir_watch_read( watch ) ? dir_watch_rescan_all( watch ) : DIR_ERROR_FAILED;
+	dir_watch_report( watch, callback, userdata );
+	return res;
+}
+#else
+dir_error dir_watch_open( const char* root, const char* glob_pattern, unsigned int flags, dir_watch** watch )
+{
+	(void)root; (void)glob_pattern; (void)flags;
+	*watch = 0x0;
+	return DIR_ERROR_FAILED;
+}
+
+void dir_watch_close( dir_watch* watch )
+{
+	(void)watch;
+}
+
+int dir_watch_fd( const dir_watch* watch )
+{
+	(void)watch;
+	return -1;
+}
+
+dir_error dir_watch_poll( dir_watch* watch, int timeout_ms, unsigned int settle_ms, dir_watch_callback callback, void* userdata )
+{
+	(void)watch; (void)timeout_ms; (void)settle_ms; (void)callback; (void)userdata;
+	return DIR_ERROR_FAILED;
+}
+
+dir_error dir_watch_rescan( dir_watch* watch, dir_watch_callback callback, void* userdata )
+{
+	(void)watch; (void)callback; (void)userdata;
+	return DIR_ERROR_FAILED;
+}
+#endif
@@ -0,0 +1,538 @@
+/*
+    A small drop-in library providing some functions related to directories.
+
+    version 0.1, April, 2015
+
+    Copyright (C) 2015- Fredrik Kihlander
+
+    This software is provided 'as-is', without any express or implied
+    warranty.  In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+       claim that you wrote the original software. If you use this software
+       in a product, an acknowledgment in the product documentation would be
+       appreciated but is not required.
+    2. Altered source versions must be plainly marked as such, and must not be
+       misrepresented as being the original software.
+    3. This notice may not be removed or altered from any source distribution.
+
+    Fredrik Kihlander
+*/
+
+
+#include <dirutil/dirutil.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#if defined( _WIN32 )
+#  include <windows.h>
+#else
+#  include <unistd.h>
+#endif
+
+// benchmark of the dirutil operations vs a generated tree and of glob-matching vs a generated set of paths.
+//
+// usage: dirutil_bench [options]
+//   --fanout N      sub-dirs per dir, default 4.
+//   --depth N       levels of sub-dirs below the root, default 3.
+//   --files N       files per dir, default 16.
+//   --name-len N    length of generated names, default 12.
+//   --dot-ratio F   part of the files and dirs that start with '.', default 0.1.
+//   --iterations N  times to run each tree operation, default 10.
+//   --glob-iterations N times to match each glob-pattern vs all paths, default 100.
+//   --root PATH     dir to generate trees in, default a new dir in the temp-dir.
+//   --json          print results as json, for regression tracking, instead of a table.
+//
+// each benchmark reports the number of ops, entries processed per second and p50/p99 latency of one op. A tree
+// operation, such as a complete dir_walk(), is one op. For glob-matching one op is the average of matching
+// all paths once. The dir_walk() benchmarks also report the syscalls of one op, as counted by
+// dir_walk_with_stats(): dirs opened, entries read, stats fetched for DIR_WALK_WITH_STAT and stats needed to find
+// the type of an entry.
+
+struct bench_config
+{
+	int         fanout;
+	int         depth;
+	int         files;
+	int         name_len;
+	double      dot_ratio;
+	int         iterations;
+	int         glob_iterations;
+	const char* root;
+	bool        json;
+};
+
+struct bench_result
+{
+	std::string         name;
+	double              entries_per_op;
+	std::vector<double> op_ns;
+
+	// average syscalls per op, only for benchmarks that can count them.
+	bool                has_syscalls;
+	double              dirs_opened;
+	double              entries_read;
+	double              stats_fetched;
+	double              stat_fallbacks;
+};
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double bench_ns_since( bench_clock::time_point start )
+{
+	return (double)std::chrono::duration_cast<std::chrono::nanoseconds>( bench_clock::now() - start ).count();
+}
+
+static double bench_percentile( std::vector<double> v, double p )
+{
+	if( v.empty() )
+		return 0.0;
+	std::sort( v.begin(), v.end() );
+	size_t i = (size_t)( p * (double)( v.size() - 1 ) + 0.5 );
+	return v[i];
+}
+
+static void bench_print( const bench_config& cfg, const std::vector<bench_result>& results )
+{
+	if( cfg.json )
+	{
+		printf( "{\n\t\"config\": { \"fanout\": %d, \"depth\": %d, \"files\": %d, \"name_len\": %d, \"dot_ratio\": %.3f, \"iterations\": %d, \"glob_iterations\": %d },\n",
+				cfg.fanout, cfg.depth, cfg.files, cfg.name_len, cfg.dot_ratio, cfg.iterations, cfg.glob_iterations );
+		printf( "\t\"results\": [\n" );
+	}
+	else
+		printf( "%-48s %8s %12s %14s %12s %12s %10s %12s %10s %10s\n", "benchmark", "ops", "entries/op", "entries/sec", "p50 us", "p99 us",
+				"opens/op", "reads/op", "stats/op", "fallbk/op" );
+
+	for( size_t i = 0; i < results.size(); ++i )
+	{
+		const bench_result& r = results[i];
+		double total_ns = 0.0;
+		for( size_t op = 0; op < r.op_ns.size(); ++op )
+			total_ns += r.op_ns[op];
+		double entries_per_sec = total_ns > 0.0 ? r.entries_per_op * (double)r.op_ns.size() * 1e9 / total_ns : 0.0;
+		double p50 = bench_percentile( r.op_ns, 0.50 );
+		double p99 = bench_percentile( r.op_ns, 0.99 );
+
+		if( cfg.json )
+		{
+			printf( "\t\t{ \"name\": \"%s\", \"ops\": %zu, \"entries_per_op\": %.0f, \"entries_per_sec\": %.0f, \"p50_ns\": %.0f, \"p99_ns\": %.0f",
+					r.name.c_str(), r.op_ns.size(), r.entries_per_op, entries_per_sec, p50, p99 );
+			if( r.has_syscalls )
+				printf( ", \"dirs_opened_per_op\": %.0f, \"entries_read_per_op\": %.0f, \"stats_fetched_per_op\": %.0f, \"stat_fallbacks_per_op\": %.0f",
+						r.dirs_opened, r.entries_read, r.stats_fetched, r.stat_fallbacks );
+			printf( " }%s\n", i + 1 < results.size() ? "," : "" );
+		}
+		else if( r.has_syscalls )
+			printf( "%-48s %8zu %12.0f %14.0f %12.2f %12.2f %10.0f %12.0f %10.0f %10.0f\n", r.name.c_str(), r.op_ns.size(), r.entries_per_op, entries_per_sec, p50 / 1000.0, p99 / 1000.0,
+					r.dirs_opened, r.entries_read, r.stats_fetched, r.stat_fallbacks );
+		else
+			printf( "%-48s %8zu %12.0f %14.0f %12.2f %12.2f %10s %12s %10s %10s\n", r.name.c_str(), r.op_ns.size(), r.entries_per_op, entries_per_sec, p50 / 1000.0, p99 / 1000.0,
+					"-", "-", "-", "-" );
+	}
+
+	if( cfg.json )
+		printf( "\t]\n}\n" );
+}
+
+/**
+ * Generates names and trees deterministically so that runs are comparable.
+ */
+struct bench_tree_gen
+{
+	const bench_config* cfg;
+	uint32_t            seed;
+	std::vector<std::string> leaf_dirs;
+	size_t              num_dirs;
+	size_t              num_files;
+};
+
+static uint32_t bench_rand( bench_tree_gen* gen )
+{
+	gen->seed = gen->seed * 1664525u + 1013904223u;
+	return gen->seed >> 8;
+}
+
+static std::string bench_name( bench_tree_gen* gen, char kind, int index, const char* ext )
+{
+	static const char CHARS[] = "abcdefghijklmnopqrstuvwxyz0123456789_-";
+	char name[256];
+	int len = snprintf( name, sizeof( name ), "%s%c%d_",
+						(double)( bench_rand( gen ) % 1000 ) < gen->cfg->dot_ratio * 1000.0 ? "." : "", kind, index );
+	while( len < gen->cfg->name_len && len < 200 )
+		name[len++] = CHARS[bench_rand( gen ) % ( sizeof( CHARS ) - 1 )];
+	name[len] = '\0';
+	return std::string( name ) + ext;
+}
+
+static bool bench_write_file( const char* path )
+{
+	FILE* f = fopen( path, "wb" );
+	if( f == 0x0 )
+		return false;
+	fwrite( path, 1, strlen( path ), f );
+	fclose( f );
+	return true;
+}
+
+/**
+ * Collect the dirs of a tree, with the leafs in gen->leaf_dirs, and optionally create them with their files.
+ */
+static void bench_gen_tree( bench_tree_gen* gen, const std::string& path, int level, bool create )
+{
+	static const char* EXTS[] = { ".cpp", ".h", ".txt", ".inl" };
+
+	if( create )
+	{
+		dir_mktree( path.c_str() );
+		for( int f = 0; f < gen->cfg->files; ++f )
+			bench_write_file( ( path + "/" + bench_name( gen, 'f', f, EXTS[f % 4] ) ).c_str() );
+	}
+	gen->num_files += (size_t)gen->cfg->files;
+
+	if( level == gen->cfg->depth )
+	{
+		gen->leaf_dirs.push_back( path );
+		return;
+	}
+
+	for( int d = 0; d < gen->cfg->fanout; ++d )
+	{
+		++gen->num_dirs;
+		bench_gen_tree( gen, path + "/" + bench_name( gen, 'd', d, "" ), level + 1, create );
+	}
+}
+
+static size_t bench_create_tree( const bench_config& cfg, const std::string& path, bool create, std::vector<std::string>* leaf_dirs )
+{
+	bench_tree_gen gen;
+	gen.cfg       = &cfg;
+	gen.seed      = 1234;
+	gen.num_dirs  = 0;
+	gen.num_files = 0;
+	bench_gen_tree( &gen, path, 0, create );
+	if( leaf_dirs )
+		leaf_dirs->swap( gen.leaf_dirs );
+	return gen.num_dirs + gen.num_files;
+}
+
+static bench_result bench_result_create( const char* name, double entries_per_op )
+{
+	bench_result r;
+	r.name           = name;
+	r.entries_per_op = entries_per_op;
+	r.has_syscalls   = false;
+	r.dirs_opened    = 0.0;
+	r.entries_read   = 0.0;
+	r.stats_fetched  = 0.0;
+	r.stat_fallbacks = 0.0;
+	return r;
+}
+
+template <typename FUNC>
+static void bench_run( std::vector<bench_result>& results, const char* name, double entries_per_op, int ops, FUNC&& func )
+{
+	bench_result r = bench_result_create( name, entries_per_op );
+	for( int i = 0; i < ops; ++i )
+	{
+		bench_clock::time_point start = bench_clock::now();
+		func();
+		r.op_ns.push_back( bench_ns_since( start ) );
+	}
+	results.push_back( r );
+}
+
+/**
+ * Run dir_walk_with_stats() ops times, entries/op is the number of items the walk reported.
+ */
+static void bench_run_walk( std::vector<bench_result>& results, const char* name, int ops, const char* path, unsigned int flags )
+{
+	bench_result r = bench_result_create( name, 0.0 );
+	r.has_syscalls = true;
+
+	size_t found = 0;
+	for( int i = 0; i < ops; ++i )
+	{
+		dir_walk_stats stats;
+		bench_clock::time_point start = bench_clock::now();
+		dir_walk_with_stats( path, flags, &stats, [&found]( const dir_walk_item* ) { ++found; return DIR_WALK_CONTINUE; } );
+		r.op_ns.push_back( bench_ns_since( start ) );
+
+		r.dirs_opened    += (double)stats.dirs_opened;
+		r.entries_read   += (double)stats.entries_read;
+		r.stats_fetched  += (double)stats.stats_fetched;
+		r.stat_fallbacks += (double)stats.stat_fallbacks;
+	}
+
+	if( ops > 0 )
+	{
+		r.entries_per_op  = (double)found / ops;
+		r.dirs_opened    /= ops;
+		r.entries_read   /= ops;
+		r.stats_fetched  /= ops;
+		r.stat_fallbacks /= ops;
+	}
+	results.push_back( r );
+}
+
+static void bench_tree_ops( const bench_config& cfg, const std::string& root, std::vector<bench_result>& results )
+{
+	std::string tree = root + "/tree";
+	size_t entries = bench_create_tree( cfg, tree, true, 0x0 );
+	double n = (double)entries;
+	const unsigned int HIDE_DOT = DIR_WALK_IGNORE_DOT_ITEMS;
+
+	std::atomic<size_t> found( 0 );
+	auto count = [&found]( const dir_walk_item* ) -> int { ++found; return DIR_WALK_CONTINUE; };
+
+	bench_run_walk( results, "walk",            cfg.iterations, tree.c_str(), DIR_WALK_NO_FLAGS );
+	bench_run_walk( results, "walk_ignore_dot", cfg.iterations, tree.c_str(), HIDE_DOT );
+	bench_run_walk( results, "walk_with_stat",  cfg.iterations, tree.c_str(), DIR_WALK_WITH_STAT );
+	bench_run_walk( results, "walk_sorted",     cfg.iterations, tree.c_str(), DIR_WALK_SORTED );
+	bench_run( results, "walk_parallel",       n, cfg.iterations, [&]() { dir_walk_parallel( tree.c_str(), DIR_WALK_NO_FLAGS, 0, count ); } );
+	bench_run( results, "walk_async_with_stat", n, cfg.iterations, [&]() { dir_walk_async( tree.c_str(), DIR_WALK_WITH_STAT, 0, count ); } );
+	bench_run( results, "iter",                n, cfg.iterations, [&]() {
+		for( const dir_walk_item& item : dir_walk_range( tree.c_str(), DIR_WALK_NO_FLAGS ) )
+			count( &item );
+	});
+	bench_run( results, "walk_glob_cpp",       n, cfg.iterations, [&]() { dir_walk_glob( tree.c_str(), "**/*.cpp", DIR_WALK_NO_FLAGS, count ); } );
+	bench_run( results, "tree_build",          n, cfg.iterations, [&]() {
+		dir_tree* t;
+		if( dir_tree_build( tree.c_str(), DIR_WALK_NO_FLAGS, &t ) == DIR_ERROR_OK )
+			dir_tree_free( t );
+	});
+
+	// create dirs only, one op per call to dir_mktree() with a leaf-dir.
+	std::string mk_root = root + "/mktree";
+	std::vector<std::string> leaf_dirs;
+	bench_create_tree( cfg, mk_root, false, &leaf_dirs );
+	bench_result mk = bench_result_create( "mktree", 1.0 );
+	for( int it = 0; it < cfg.iterations; ++it )
+	{
+		for( size_t i = 0; i < leaf_dirs.size(); ++i )
+		{
+			bench_clock::time_point start = bench_clock::now();
+			dir_mktree( leaf_dirs[i].c_str() );
+			mk.op_ns.push_back( bench_ns_since( start ) );
+		}
+		dir_rmtree( mk_root.c_str() );
+	}
+	results.push_back( mk );
+
+	// remove complete copies of the tree, only the removal is timed.
+	bench_result rm     = bench_result_create( "rmtree", n );
+	bench_result rm_par = bench_result_create( "rmtree_parallel", n );
+	for( int it = 0; it < cfg.iterations; ++it )
+	{
+		std::string copy = root + "/rm";
+		bench_create_tree( cfg, copy, true, 0x0 );
+		bench_clock::time_point start = bench_clock::now();
+		dir_rmtree( copy.c_str() );
+		rm.op_ns.push_back( bench_ns_since( start ) );
+
+		bench_create_tree( cfg, copy, true, 0x0 );
+		start = bench_clock::now();
+		dir_rmtree_parallel( copy.c_str(), 0 );
+		rm_par.op_ns.push_back( bench_ns_since( start ) );
+	}
+	results.push_back( rm );
+	results.push_back( rm_par );
+
+	dir_rmtree( tree.c_str() );
+}
+
+// matching a set of patterns vs a generated set of paths with dir_glob_match(), that looks up the pattern in its
+// cache on each call, and a pattern compiled with dir_glob_compile(), then matching many patterns at once
+// with dir_globset_match() vs matching them one by one. Last, patterns that would explode in a backtracking
+// matcher vs growing paths to show that time grows linearly.
+
+static const char* GLOB_PATTERNS[] = {
+	"**/*.cpp",
+	"*.txt",
+	"src/engine/**/*.h",
+	"**/file1?.{cpp,h}",
+	"src/*/module[0-4]*/**/*.cpp",
+	"src/engine/module1/sub0/file10.cpp",
+};
+
+// all end in a wildcard so the paths are not rejected on a literal suffix before matching.
+static const char* GLOB_PATHOLOGICAL[] = {
+	"**/a/**/a/**/a/**/a/**/a/**/a/**/b/*",
+	"*a*a*a*a*a*a*a*a*a*a*b*",
+	"{a,aa}{a,aa}{a,aa}{a,aa}{a,aa}{a,aa}{a,aa}{a,aa}{a,aa}{a,aa}b*",
+};
+
+static const int NUM_GLOB_PATHS = 4096;
+static const int NUM_SET_PATTERNS = 2000;
+
+static void bench_glob( const bench_config& cfg, std::vector<bench_result>& results )
+{
+	static char paths[NUM_GLOB_PATHS][128];
+	const char* exts[] = { "cpp", "h", "txt", "inl" };
+	const char* roots[] = { "src/engine", "src/tools", "data/textures", "." };
+	for( int i = 0; i < NUM_GLOB_PATHS; ++i )
+		snprintf( paths[i], sizeof( paths[i] ), "%s/module%d/sub%d/file%d.%s", roots[i % 4], i % 13, i % 3, i % 97, exts[i % 7 % 4] );
+
+	for( size_t p = 0; p < sizeof( GLOB_PATTERNS ) / sizeof( GLOB_PATTERNS[0] ); ++p )
+	{
+		const char* pattern = GLOB_PATTERNS[p];
+		dir_glob* glob = dir_glob_compile( pattern );
+		if( glob == 0x0 )
+			continue;
+
+		int matches = 0;
+		std::string name = std::string( "glob_match " ) + pattern;
+		bench_run( results, name.c_str(), NUM_GLOB_PATHS, cfg.glob_iterations, [&]() {
+			for( int i = 0; i < NUM_GLOB_PATHS; ++i )
+				matches += dir_glob_match( pattern, paths[i] ) == DIR_GLOB_MATCH;
+		});
+		name = std::string( "glob_compiled " ) + pattern;
+		bench_run( results, name.c_str(), NUM_GLOB_PATHS, cfg.glob_iterations, [&]() {
+			for( int i = 0; i < NUM_GLOB_PATHS; ++i )
+				matches += dir_glob_match_compiled( glob, paths[i] ) == DIR_GLOB_MATCH;
+		});
+		dir_glob_free( glob );
+	}
+
+	// a rule-set like the ones used in asset-pipelines and ignore-files.
+	static char set_pattern_data[NUM_SET_PATTERNS][128];
+	static const char* set_patterns[NUM_SET_PATTERNS];
+	for( int i = 0; i < NUM_SET_PATTERNS; ++i )
+	{
+		switch( i % 5 )
+		{
+			case 0:  snprintf( set_pattern_data[i], sizeof( set_pattern_data[i] ), "%s/module%d/sub%d/file%d.%s", roots[i % 4], i % 13, i % 3, i, exts[i % 4] ); break;
+			case 1:  snprintf( set_pattern_data[i], sizeof( set_pattern_data[i] ), "**/file%d.%s", i, exts[i % 4] ); break;
+			case 2:  snprintf( set_pattern_data[i], sizeof( set_pattern_data[i] ), "**/*.ext%d", i ); break;
+			case 3:  snprintf( set_pattern_data[i], sizeof( set_pattern_data[i] ), "src/module%d/**/*.%s", i, exts[i % 4] ); break;
+			default: snprintf( set_pattern_data[i], sizeof( set_pattern_data[i] ), "data/*/sub%d/file%d*", i % 3, i ); break;
+		}
+		set_patterns[i] = set_pattern_data[i];
+	}
+
+	dir_globset* set = dir_globset_compile( set_patterns, NUM_SET_PATTERNS, 0x0 );
+	static dir_glob* set_globs[NUM_SET_PATTERNS];
+	for( int i = 0; i < NUM_SET_PATTERNS; ++i )
+		set_globs[i] = dir_glob_compile( set_patterns[i] );
+
+	int set_iterations = cfg.glob_iterations / 10 > 0 ? cfg.glob_iterations / 10 : 1;
+	size_t matches = 0;
+	uint32_t found[16];
+	bench_run( results, "glob_2000_compiled", NUM_GLOB_PATHS, set_iterations, [&]() {
+		for( int i = 0; i < NUM_GLOB_PATHS; ++i )
+			for( int p = 0; p < NUM_SET_PATTERNS; ++p )
+				matches += dir_glob_match_compiled( set_globs[p], paths[i] ) == DIR_GLOB_MATCH;
+	});
+	bench_run( results, "globset_2000", NUM_GLOB_PATHS, set_iterations, [&]() {
+		for( int i = 0; i < NUM_GLOB_PATHS; ++i )
+			matches += dir_globset_match( set, paths[i], found, 16 );
+	});
+
+	for( int i = 0; i < NUM_SET_PATTERNS; ++i )
+		dir_glob_free( set_globs[i] );
+	dir_globset_free( set );
+
+	for( size_t p = 0; p < sizeof( GLOB_PATHOLOGICAL ) / sizeof( GLOB_PATHOLOGICAL[0] ); ++p )
+	{
+		dir_glob* glob = dir_glob_compile( GLOB_PATHOLOGICAL[p] );
+		for( size_t len = 64; len <= 4096; len *= 4 )
+		{
+			// "a/a/a/..." for the dir-pattern, "aaaa..." for the others.
+			static char path[4097];
+			for( size_t i = 0; i < len; ++i )
+				path[i] = p == 0 && ( i & 1 ) ? '/' : 'a';
+			path[len] = '\0';
+
+			char name[64];
+			snprintf( name, sizeof( name ), "glob_pathological%zu len %zu", p, len );
+			bench_run( results, name, 1, cfg.glob_iterations, [&]() {
+				matches += dir_glob_match_compiled( glob, path ) == DIR_GLOB_MATCH;
+			});
+		}
+		dir_glob_free( glob );
+	}
+}
+
+static std::string bench_temp_root()
+{
+	char path[512];
+#if defined( _WIN32 )
+	char temp[MAX_PATH];
+	GetTempPath( sizeof( temp ), temp );
+	snprintf( path, sizeof( path ), "%s/dirutil_bench.%lu", temp, (unsigned long)GetCurrentProcessId() );
+#else
+	const char* temp = getenv( "TMPDIR" );
+	snprintf( path, sizeof( path ), "%s/dirutil_bench.%lu", temp ? temp : "/tmp", (unsigned long)getpid() );
+#endif
+	return path;
+}
+
+int main( int argc, const char** argv )
+{
+	bench_config cfg;
+	cfg.fanout          = 4;
+	cfg.depth           = 3;
+	cfg.files           = 16;
+	cfg.name_len        = 12;
+	cfg.dot_ratio       = 0.1;
+	cfg.iterations      = 10;
+	cfg.glob_iterations = 100;
+	cfg.root            = 0x0;
+	cfg.json            = false;
+
+	for( int i = 1; i < argc; ++i )
+	{
+		const char* arg = argv[i];
+		const char* val = i + 1 < argc ? argv[i + 1] : 0x0;
+		if( strcmp( arg, "--json" ) == 0 )
+		{
+			cfg.json = true;
+			continue;
+		}
+		if( val == 0x0 )
+		{
+			fprintf( stderr, "missing value for %s\n", arg );
+			return 1;
+		}
+		++i;
+		if(      strcmp( arg, "--fanout" )          == 0 ) cfg.fanout          = atoi( val );
+		else if( strcmp( arg, "--depth" )           == 0 ) cfg.depth           = atoi( val );
+		else if( strcmp( arg, "--files" )           == 0 ) cfg.files           = atoi( val );
+		else if( strcmp( arg, "--name-len" )        == 0 ) cfg.name_len        = atoi( val );
+		else if( strcmp( arg, "--dot-ratio" )       == 0 ) cfg.dot_ratio       = atof( val );
+		else if( strcmp( arg, "--iterations" )      == 0 ) cfg.iterations      = atoi( val );
+		else if( strcmp( arg, "--glob-iterations" ) == 0 ) cfg.glob_iterations = atoi( val );
+		else if( strcmp( arg, "--root" )            == 0 ) cfg.root            = val;
+		else
+		{
+			fprintf( stderr, "unknown option %s\n", arg );
+			return 1;
+		}
+	}
+
+	std::string root = cfg.root ? std::string( cfg.root ) : bench_temp_root();
+	if( dir_mktree( root.c_str() ) != DIR_ERROR_OK )
+	{
+		fprintf( stderr, "could not create %s\n", root.c_str() );
+		return 1;
+	}
+
+	std::vector<bench_result> results;
+	bench_tree_ops( cfg, root, results );
+	bench_glob( cfg, results );
+	bench_print( cfg, results );
+
+	if( cfg.root == 0x0 )
+		dir_rmtree( root.c_str() );
+	return 0;
+}
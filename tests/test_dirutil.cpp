@@ -29,10 +29,14 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <sys/stat.h>
 #if defined( _WIN32 )
 #  include <windows.h>
 #else
-#  include <sys/stat.h>
+#  include <fcntl.h>
+#  include <unistd.h>
 #endif
 
 static bool path_exists( const char* path )
@@ -56,6 +60,17 @@ static bool filedump( const char* path, const uint8_t* data, size_t data_size )
 	return success;
 }
 
+static bool file_equals( const char* path, const char* content )
+{
+	char buffer[256];
+	FILE* f = fopen( path, "rb" );
+	if( f == 0x0 )
+		return false;
+	size_t size = fread( buffer, 1, sizeof( buffer ), f );
+	fclose( f );
+	return size == strlen( content ) + 1 && memcmp( buffer, content, size ) == 0;
+}
+
 static bool streq( const char* s1, const char* s2 )
 {
 	return strcmp(s1, s2) == 0;
@@ -112,6 +127,50 @@ TEST create_remove_tree_slash()
 	return 0;
 }
 
+TEST create_tree_existing_prefix()
+{
+	ASSERT_EQ( DIR_ERROR_OK, dir_mktree( "local/apa/bepa/cepa" ) );
+	ASSERT_EQ( DIR_ERROR_OK, dir_mktree( "local/apa/bepa/cepa" ) );
+	ASSERT_EQ( DIR_ERROR_OK, dir_mktree( "local/apa/bepa/depa/" ) );
+	ASSERT_EQ( DIR_ERROR_OK, dir_mktree( "local/apa/epa/fepa/gepa" ) );
+	ASSERT( path_exists( "local/apa/bepa/depa" ) );
+	ASSERT( path_exists( "local/apa/epa/fepa/gepa" ) );
+
+	// a file in the way.
+	filedump( "local/apa/f.txt", (uint8_t*)"abc", 4 );
+	ASSERT_EQ( DIR_ERROR_FAILED, dir_mktree( "local/apa/f.txt/bepa/cepa" ) );
+
+	ASSERT_EQ( DIR_ERROR_OK, dir_rmtree( "local/apa" ) );
+	return 0;
+}
+
+TEST create_tree_many()
+{
+	const char* paths[] = {
+		"local/apa/bepa/cepa",
+		"local/apa/bepa/depa/",
+		"local/apa/bepa/cepa",
+		"local/apa/f.txt/epa",
+		"local/apa/bepa",
+		"local/apa/fepa/gepa/hepa",
+		"local/apa/fepa/gepa/iepa",
+	};
+	ASSERT_EQ( DIR_ERROR_OK, dir_mktree( "local/apa" ) );
+	filedump( "local/apa/f.txt", (uint8_t*)"abc", 4 );
+
+	// all paths are created even if one fail.
+	ASSERT_EQ( DIR_ERROR_FAILED, dir_mktree_many( paths, sizeof( paths ) / sizeof( paths[0] ) ) );
+	ASSERT( path_exists( "local/apa/bepa/cepa" ) );
+	ASSERT( path_exists( "local/apa/bepa/depa" ) );
+	ASSERT( path_exists( "local/apa/fepa/gepa/hepa" ) );
+	ASSERT( path_exists( "local/apa/fepa/gepa/iepa" ) );
+
+	ASSERT_EQ( DIR_ERROR_OK, dir_mktree_many( paths, 3 ) );
+	ASSERT_EQ( DIR_ERROR_OK, dir_mktree_many( paths, 0 ) );
+	ASSERT_EQ( DIR_ERROR_OK, dir_rmtree( "local/apa" ) );
+	return 0;
+}
+
 TEST item_correct()
 {
 	dir_error err;
@@ -286,6 +345,1240 @@ TEST create_remove_tree_with_files()
 	return 0;
 }
 
+static void create_wide_tree( const char* root, int dirs, int files_per_dir )
+{
+	char path[256];
+	for( int d = 0; d < dirs; ++d )
+	{
+		snprintf( path, sizeof( path ), "%s/d%d/sub", root, d );
+		dir_mktree( path );
+		for( int f = 0; f < files_per_dir; ++f )
+		{
+			snprintf( path, sizeof( path ), "%s/d%d/f%d.txt", root, d, f );
+			filedump( path, (uint8_t*)"abc", 4 );
+			snprintf( path, sizeof( path ), "%s/d%d/sub/f%d.txt", root, d, f );
+			filedump( path, (uint8_t*)"abc", 4 );
+		}
+	}
+}
+
+TEST walk_stats()
+{
+	ASSERT_EQ( DIR_ERROR_OK, dir_mktree( "local/apa/bepa/cepa" ) );
+	ASSERT_EQ( DIR_ERROR_OK, dir_mktree( "local/apa/.git" ) );
+	filedump( "local/apa/f1.txt",           (uint8_t*)"abc", 4 );
+	filedump( "local/apa/.hidden",          (uint8_t*)"abc", 4 );
+	filedump( "local/apa/bepa/cepa/f2.txt", (uint8_t*)"abc", 4 );
+	filedump( "local/apa/.git/f3.txt",      (uint8_t*)"abc", 4 );
+
+	dir_walk_stats stats;
+	int items = 0;
+	ASSERT_EQ( DIR_ERROR_OK, dir_walk_with_stats( "local/apa", DIR_WALK_IGNORE_DOT_ITEMS | DIR_WALK_WITH_STAT, &stats, [&items]( const dir_walk_item* ) {
+		++items;
+		return 0;
+	}));
+	ASSERT_EQ( 4, items );
+
+#if defined( DIRUTIL_NO_STATS )
+	ASSERT_EQ( 0u, stats.dirs_opened );
+	ASSERT_EQ( 0u, stats.entries_read );
+#else
+	ASSERT_EQ( 3u, stats.dirs_opened );
+	ASSERT_EQ( 6u, stats.entries_read );
+	ASSERT_EQ( 2u, stats.dot_items_skipped );
+	ASSERT_EQ( 4u, stats.stats_fetched );
+	ASSERT_EQ( 2u, stats.max_depth );
+	ASSERT( stats.stat_fallbacks <= stats.entries_read );
+	ASSERT( stats.open_ns > 0 && stats.read_ns > 0 && stats.stat_ns > 0 );
+#endif
+
+	// a walk without stats should still work.
+	ASSERT_EQ( DIR_ERROR_OK, dir_walk_with_stats( "local/apa", DIR_WALK_NO_FLAGS, 0x0, []( const dir_walk_item* ) { return 0; } ) );
+
+	ASSERT_EQ( DIR_ERROR_OK, dir_rmtree( "local/apa" ) );
+	return 0;
+}
+
+TEST walk_with_stat()
+{
+	ASSERT_EQ( DIR_ERROR_OK, dir_mktree( "local/apa/bepa" ) );
+	filedump( "local/apa/f1.txt",      (uint8_t*)"abc", 4 );
+	filedump( "local/apa/bepa/f2.txt", (uint8_t*)"abcdefgh", 9 );
+
+	struct stat st;
+	ASSERT_EQ( 0, stat( "local/apa/bepa/f2.txt", &st ) );
+
+	int checked = 0;
+	bool stat_missing = false;
+	dir_error err = dir_walk( "local/apa", DIR_WALK_WITH_STAT, [&](const dir_walk_item* item)
+	{
+		if( item->stat == 0x0 )
+		{
+			stat_missing = true;
+			return 0;
+		}
+
+		if( streq( item->name, "f1.txt" ) && item->stat->size == 4 && ( item->stat->mode & S_IFMT ) == S_IFREG )
+			++checked;
+		if( streq( item->name, "f2.txt" ) && item->stat->size == 9 && item->stat->mtime_ns / 1000000000ull == (uint64_t)st.st_mtime )
+		{
+		#if !defined( _WIN32 )
+			if( item->stat->inode == (uint64_t)st.st_ino )
+		#endif
+				++checked;
+		}
+		if( streq( item->name, "bepa" ) && ( item->stat->mode & S_IFMT ) == S_IFDIR )
+			++checked;
+		return 0;
+	});
+	ASSERT_EQ( DIR_ERROR_OK, err );
+	ASSERT_FALSE( stat_missing );
+	ASSERT_EQ( 3, checked );
+
+	// ... and no stat if not requested.
+	dir_walk( "local/apa", DIR_WALK_NO_FLAGS, [&](const dir_walk_item* item)
+	{
+		if( item->stat != 0x0 )
+			stat_missing = true;
+		return 0;
+	});
+	ASSERT_FALSE( stat_missing );
+
+	err = dir_rmtree( "local/apa" );
+	ASSERT_EQ( DIR_ERROR_OK, err );
+	return 0;
+}
+
+TEST walk_large_dir()
+{
+	// enough entries to need multiple reads of the directory.
+	ASSERT_EQ( DIR_ERROR_OK, dir_mktree( "local/apa" ) );
+	char path[256];
+	for( int i = 0; i < 3000; ++i )
+	{
+		snprintf( path, sizeof( path ), "local/apa/a_somewhat_long_file_name_%04d.txt", i );
+		ASSERT( filedump( path, (uint8_t*)"abc", 4 ) );
+	}
+
+	int found = 0;
+	int other = 0;
+	dir_error err = dir_walk( "local/apa", DIR_WALK_NO_FLAGS, [&](const dir_walk_item* item)
+	{
+		int num;
+		if( item->type == DIR_ITEM_FILE && sscanf( item->name, "a_somewhat_long_file_name_%04d.txt", &num ) == 1 )
+			++found;
+		else
+			++other;
+		return 0;
+	});
+	ASSERT_EQ( DIR_ERROR_OK, err );
+	ASSERT_EQ( 3000, found );
+	ASSERT_EQ( 0, other );
+
+	err = dir_rmtree( "local/apa" );
+	ASSERT_EQ( DIR_ERROR_OK, err );
+	return 0;
+}
+
+TEST walk_skip_and_abort()
+{
+	ASSERT_EQ( DIR_ERROR_OK, dir_mktree( "local/apa/node_modules/deep/deeper" ) );
+	ASSERT_EQ( DIR_ERROR_OK, dir_mktree( "local/apa/src" ) );
+	filedump( "local/apa/node_modules/deep/f1.txt",  (uint8_t*)"abc", 4 );
+	filedump( "local/apa/src/f2.txt",                (uint8_t*)"abc", 4 );
+	filedump( "local/apa/src/f3.txt",                (uint8_t*)"abc", 4 );
+
+	// skip node_modules, everything else is found.
+	std::atomic<int> in_skipped( 0 );
+	std::atomic<int> items( 0 );
+	auto skip = [&]( const dir_walk_item* item ) {
+		++items;
+		if( strncmp( item->relative, "node_modules/", 13 ) == 0 )
+			++in_skipped;
+		return streq( item->name, "node_modules" ) ? DIR_WALK_SKIP_SUBTREE : DIR_WALK_CONTINUE;
+	};
+	ASSERT_EQ( DIR_ERROR_OK, dir_walk( "local/apa", DIR_WALK_NO_FLAGS, skip ) );
+	ASSERT_EQ( 4, (int)items );
+	ASSERT_EQ( DIR_ERROR_OK, dir_walk_glob( "local/apa", "**/*", DIR_WALK_NO_FLAGS, skip ) );
+	ASSERT_EQ( 8, (int)items );
+	ASSERT_EQ( DIR_ERROR_OK, dir_walk_parallel( "local/apa", DIR_WALK_NO_FLAGS, 2, skip ) );
+	ASSERT_EQ( 12, (int)items );
+	ASSERT_EQ( DIR_ERROR_OK, dir_walk_async( "local/apa", DIR_WALK_NO_FLAGS, 0, skip ) );
+	ASSERT_EQ( 16, (int)items );
+	ASSERT_EQ( 0, (int)in_skipped );
+
+	int iterated = 0;
+	dir_iter* iter;
+	ASSERT_EQ( DIR_ERROR_OK, dir_iter_open( "local/apa", DIR_WALK_NO_FLAGS, &iter ) );
+	while( const dir_walk_item* item = dir_iter_next( iter ) )
+	{
+		ASSERT( strncmp( item->relative, "node_modules/", 13 ) != 0 );
+		if( streq( item->name, "node_modules" ) )
+			dir_iter_skip_subtree( iter );
+		++iterated;
+	}
+	dir_iter_close( iter );
+	ASSERT_EQ( 4, iterated );
+
+	// stop at the first file.
+	for( unsigned int flags : { (unsigned int)DIR_WALK_NO_FLAGS, (unsigned int)DIR_WALK_DEPTH_FIRST } )
+	{
+		items = 0;
+		auto abort = [&]( const dir_walk_item* item ) {
+			++items;
+			return item->type == DIR_ITEM_FILE ? DIR_WALK_ABORT : DIR_WALK_CONTINUE;
+		};
+		ASSERT_EQ( DIR_ERROR_ABORTED, dir_walk( "local/apa", flags, abort ) );
+		int walked = items;
+		ASSERT( walked < 7 );
+		ASSERT_EQ( DIR_ERROR_ABORTED, dir_walk_glob( "local/apa", "**/*.txt", flags, abort ) );
+		ASSERT_EQ( walked + 1, (int)items );
+		ASSERT_EQ( DIR_ERROR_ABORTED, dir_walk_parallel( "local/apa", flags, 1, abort ) );
+		ASSERT( (int)items < walked + 8 );
+		ASSERT_EQ( DIR_ERROR_ABORTED, dir_walk_async( "local/apa", flags, 0, abort ) );
+	}
+
+	ASSERT_EQ( DIR_ERROR_OK, dir_snapshot_write( "local/apa", DIR_WALK_NO_FLAGS, "local/apa.snapshot" ) );
+	filedump( "local/apa/src/f4.txt", (uint8_t*)"abc", 4 );
+	filedump( "local/apa/f5.txt",     (uint8_t*)"abc", 4 );
+	int changes = 0;
+	ASSERT_EQ( DIR_ERROR_ABORTED, dir_walk_changes( "local/apa", "local/apa.snapshot", [&]( dir_change_type, const dir_walk_item* ) {
+		++changes;
+		return DIR_WALK_ABORT;
+	}));
+	ASSERT_EQ( 1, changes );
+	remove( "local/apa.snapshot" );
+
+	ASSERT_EQ( DIR_ERROR_OK, dir_rmtree( "local/apa" ) );
+	return 0;
+}
+
+TEST walk_parallel()
+{
+	create_wide_tree( "local/apa", 16, 8 );
+	filedump( "local/apa/.hidden", (uint8_t*)"abc", 4 );
+
+	std::atomic<int> files( 0 );
+	std::atomic<int> dirs( 0 );
+	std::atomic<int> other( 0 );
+
+	dir_error err = dir_walk_parallel( "local/apa/", DIR_WALK_IGNORE_DOT_FILES, 4, [&](const dir_walk_item* item)
+	{
+		if( strncmp( item->path, "local/apa/", 10 ) != 0 || strncmp( item->relative, "d", 1 ) != 0 )
+			++other;
+		if( item->type == DIR_ITEM_FILE )
+			++files;
+		else
+			++dirs;
+		return 0;
+	});
+	ASSERT_EQ( DIR_ERROR_OK, err );
+	ASSERT_EQ( 16 * 8 * 2, (int)files );
+	ASSERT_EQ( 16 * 2, (int)dirs );
+	ASSERT_EQ( 0, (int)other );
+
+	err = dir_rmtree( "local/apa/" );
+	ASSERT_EQ( DIR_ERROR_OK, err );
+	return 0;
+}
+
+TEST walk_async()
+{
+	create_wide_tree( "local/apa", 16, 8 );
+	filedump( "local/apa/.hidden", (uint8_t*)"abc", 4 );
+	filedump( "local/apa/d3/sub/big.txt", (uint8_t*)"abcdefgh", 8 );
+
+	// a small queue, so that ops need to wait for a free slot.
+	std::atomic<int> files( 0 );
+	std::atomic<int> dirs( 0 );
+	std::atomic<int> other( 0 );
+	std::atomic<int> missing_stat( 0 );
+	dir_error err = dir_walk_async( "local/apa/", DIR_WALK_IGNORE_DOT_FILES | DIR_WALK_WITH_STAT, 4, [&](const dir_walk_item* item)
+	{
+		if( strncmp( item->path, "local/apa/", 10 ) != 0 || strncmp( item->relative, "d", 1 ) != 0 || !strend( item->name, item->path ) )
+			++other;
+		if( item->stat == 0x0 || ( item->type == DIR_ITEM_DIR ) != ( ( item->stat->mode & S_IFMT ) == S_IFDIR ) )
+			++missing_stat;
+		else if( streq( item->relative, "d3/sub/big.txt" ) && item->stat->size != 8 )
+			++other;
+		if( item->type == DIR_ITEM_FILE )
+			++files;
+		else
+			++dirs;
+		return 0;
+	});
+	ASSERT_EQ( DIR_ERROR_OK, err );
+	ASSERT_EQ( 16 * 8 * 2 + 1, (int)files );
+	ASSERT_EQ( 16 * 2, (int)dirs );
+	ASSERT_EQ( 0, (int)other );
+	ASSERT_EQ( 0, (int)missing_stat );
+
+	// without stat and depth first, that always use the fallback.
+	for( unsigned int flags : { (unsigned int)DIR_WALK_NO_FLAGS, (unsigned int)DIR_WALK_DEPTH_FIRST } )
+	{
+		files = 0;
+		dirs  = 0;
+		err = dir_walk_async( "local/apa", flags, 0, [&](const dir_walk_item* item)
+		{
+			if( item->stat != 0x0 )
+				++other;
+			if( item->type == DIR_ITEM_FILE )
+				++files;
+			else
+				++dirs;
+			return 0;
+		});
+		ASSERT_EQ( DIR_ERROR_OK, err );
+		ASSERT_EQ( 16 * 8 * 2 + 2, (int)files );
+		ASSERT_EQ( 16 * 2, (int)dirs );
+		ASSERT_EQ( 0, (int)other );
+	}
+
+	ASSERT_EQ( DIR_ERROR_PATH_DO_NOT_EXIST, dir_walk_async( "local/bepa", DIR_WALK_NO_FLAGS, 0, [](const dir_walk_item*) { return 0; } ) );
+
+	err = dir_rmtree( "local/apa" );
+	ASSERT_EQ( DIR_ERROR_OK, err );
+	return 0;
+}
+
+TEST walk_parallel_depth_first()
+{
+	create_wide_tree( "local/apa", 8, 4 );
+
+	// with DIR_WALK_DEPTH_FIRST all items in a dir should have been reported before the dir itself.
+	std::mutex lock;
+	char reported_dirs[64][64];
+	int num_reported_dirs = 0;
+	int items_after_dir = 0;
+
+	dir_error err = dir_walk_parallel( "local/apa", DIR_WALK_DEPTH_FIRST, 4, [&](const dir_walk_item* item)
+	{
+		std::lock_guard<std::mutex> guard( lock );
+		for( int i = 0; i < num_reported_dirs; ++i )
+		{
+			size_t len = strlen( reported_dirs[i] );
+			if( strncmp( item->relative, reported_dirs[i], len ) == 0 && item->relative[len] == '/' )
+				++items_after_dir;
+		}
+		if( item->type == DIR_ITEM_DIR && num_reported_dirs < 64 )
+			strcpy( reported_dirs[num_reported_dirs++], item->relative );
+		return 0;
+	});
+	ASSERT_EQ( DIR_ERROR_OK, err );
+	ASSERT_EQ( 16, num_reported_dirs );
+	ASSERT_EQ( 0, items_after_dir );
+
+	err = dir_rmtree( "local/apa" );
+	ASSERT_EQ( DIR_ERROR_OK, err );
+	return 0;
+}
+
+TEST rmtree_parallel()
+{
+	// more files than fit in one batch in some dirs.
+	create_wide_tree( "local/apa", 8, 300 );
+	ASSERT_EQ( DIR_ERROR_OK, dir_mktree( "local/apa/d0/e/f/g" ) );
+	filedump( "local/apa/d0/e/f/g/h.txt", (uint8_t*)"abc", 4 );
+#if !defined( _WIN32 )
+	// a symlink to a dir outside the tree should be removed, not followed.
+	ASSERT_EQ( DIR_ERROR_OK, dir_mktree( "local/bepa" ) );
+	filedump( "local/bepa/keep.txt", (uint8_t*)"abc", 4 );
+	ASSERT_EQ( 0, symlink( "../../bepa", "local/apa/d1/link" ) );
+#endif
+
+	ASSERT_EQ( DIR_ERROR_OK, dir_rmtree_parallel( "local/apa/", 4 ) );
+	ASSERT_FALSE( path_exists( "local/apa" ) );
+#if !defined( _WIN32 )
+	ASSERT( path_exists( "local/bepa/keep.txt" ) );
+	ASSERT_EQ( DIR_ERROR_OK, dir_rmtree_parallel( "local/bepa", 1 ) );
+#endif
+
+	ASSERT_EQ( DIR_ERROR_PATH_DO_NOT_EXIST, dir_rmtree_parallel( "local/apa", 4 ) );
+	return 0;
+}
+
+TEST rmtree_async()
+{
+	create_wide_tree( "local/apa", 4, 50 );
+	dir_rmtree_job* job = 0x0;
+	ASSERT_EQ( DIR_ERROR_OK, dir_rmtree_async( "local/apa/", 2, &job ) );
+	ASSERT( job != 0x0 );
+	ASSERT_FALSE( path_exists( "local/apa" ) );
+
+	// path can be reused at once.
+	ASSERT_EQ( DIR_ERROR_OK, dir_mktree( "local/apa/bepa" ) );
+	ASSERT_EQ( DIR_ERROR_OK, dir_rmtree_wait( job ) );
+	ASSERT( path_exists( "local/apa/bepa" ) );
+
+	int trash = 0;
+	dir_walk( "local", DIR_WALK_NO_FLAGS, [&trash]( const dir_walk_item* item ) {
+		if( strncmp( item->name, ".dirutil-trash.", 15 ) == 0 )
+			++trash;
+		return 0;
+	});
+	ASSERT_EQ( 0, trash );
+
+	ASSERT_EQ( DIR_ERROR_PATH_DO_NOT_EXIST, dir_rmtree_async( "local/cepa", 1, &job ) );
+	ASSERT( job == 0x0 );
+
+	// files are not moved to the trash.
+	filedump( "local/apa/f.txt", (uint8_t*)"abc", 4 );
+	ASSERT_EQ( DIR_ERROR_PATH_IS_FILE, dir_rmtree_async( "local/apa/f.txt", 1, &job ) );
+	ASSERT( job == 0x0 );
+	ASSERT( path_exists( "local/apa/f.txt" ) );
+	ASSERT_EQ( DIR_ERROR_OK, dir_rmtree( "local/apa" ) );
+	return 0;
+}
+
+TEST rmtree_reap()
+{
+	// trash left by a process that is not running and by this process.
+	char own_trash[64];
+#if defined( _WIN32 )
+	snprintf( own_trash, sizeof( own_trash ), "local/.dirutil-trash.%lu.0", (unsigned long)GetCurrentProcessId() );
+#else
+	snprintf( own_trash, sizeof( own_trash ), "local/.dirutil-trash.%lu.0", (unsigned long)getpid() );
+#endif
+	ASSERT_EQ( DIR_ERROR_OK, dir_mktree( "local/.dirutil-trash.99999999.3/apa" ) );
+	filedump( "local/.dirutil-trash.99999999.3/apa/f.txt", (uint8_t*)"abc", 4 );
+	ASSERT_EQ( DIR_ERROR_OK, dir_mktree( own_trash ) );
+	ASSERT_EQ( DIR_ERROR_OK, dir_mktree( "local/.dirutil-trash.apa" ) );
+
+	ASSERT_EQ( DIR_ERROR_OK, dir_rmtree_reap( "local/" ) );
+	ASSERT_FALSE( path_exists( "local/.dirutil-trash.99999999.3" ) );
+	ASSERT( path_exists( own_trash ) );
+	ASSERT( path_exists( "local/.dirutil-trash.apa" ) );
+
+	// not waited for, the background thread cleans up after itself.
+	ASSERT_EQ( DIR_ERROR_OK, dir_mktree( "local/bepa/cepa" ) );
+	ASSERT_EQ( DIR_ERROR_OK, dir_rmtree_async( "local/bepa", 1, 0x0 ) );
+	ASSERT_FALSE( path_exists( "local/bepa" ) );
+
+	ASSERT_EQ( DIR_ERROR_PATH_DO_NOT_EXIST, dir_rmtree_reap( "local/depa" ) );
+	ASSERT_EQ( DIR_ERROR_OK, dir_rmtree( own_trash ) );
+	ASSERT_EQ( DIR_ERROR_OK, dir_rmtree( "local/.dirutil-trash.apa" ) );
+	return 0;
+}
+
+TEST copytree()
+{
+	ASSERT_EQ( DIR_ERROR_OK, dir_mktree( "local/apa/bepa/cepa" ) );
+	ASSERT_EQ( DIR_ERROR_OK, dir_mktree( "local/apa/empty" ) );
+	ASSERT_EQ( DIR_ERROR_OK, dir_mktree( "local/apa/.git" ) );
+	filedump( "local/apa/f1.txt",           (uint8_t*)"f1", 3 );
+	filedump( "local/apa/bepa/f2.txt",      (uint8_t*)"f2", 3 );
+	filedump( "local/apa/bepa/cepa/f3.bin", (uint8_t*)"f3", 3 );
+	filedump( "local/apa/.git/f4.txt",      (uint8_t*)"f4", 3 );
+	filedump( "local/apa/empty.txt",        (uint8_t*)"", 0 );
+#if !defined( _WIN32 )
+	ASSERT_EQ( 0, chmod( "local/apa/f1.txt", 0750 ) );
+	ASSERT_EQ( 0, symlink( "bepa",    "local/apa/dir_link" ) );
+	ASSERT_EQ( 0, symlink( "f1.txt",  "local/apa/file_link" ) );
+	ASSERT_EQ( 0, symlink( "nowhere", "local/apa/dangling_link" ) );
+#endif
+
+	// files already in dst are overwritten.
+	ASSERT_EQ( DIR_ERROR_OK, dir_mktree( "local/copy/bepa" ) );
+	filedump( "local/copy/bepa/f2.txt", (uint8_t*)"old content", 12 );
+
+	ASSERT_EQ( DIR_ERROR_OK, dir_copytree( "local/apa/", "local/copy", DIR_WALK_IGNORE_DOT_DIRS ) );
+	ASSERT( file_equals( "local/copy/f1.txt", "f1" ) );
+	ASSERT( file_equals( "local/copy/bepa/f2.txt", "f2" ) );
+	ASSERT( file_equals( "local/copy/bepa/cepa/f3.bin", "f3" ) );
+	ASSERT( path_exists( "local/copy/empty" ) );
+	ASSERT( path_exists( "local/copy/empty.txt" ) );
+	ASSERT_FALSE( path_exists( "local/copy/.git" ) );
+#if !defined( _WIN32 )
+	struct stat st;
+	ASSERT_EQ( 0, stat( "local/copy/f1.txt", &st ) );
+	ASSERT_EQ( 0750, (int)( st.st_mode & 0777 ) );
+
+	// symlinks are copied as symlinks, also when they are already in dst.
+	ASSERT_EQ( DIR_ERROR_OK, dir_copytree( "local/apa/", "local/copy", DIR_WALK_IGNORE_DOT_DIRS ) );
+	const char* links[]   = { "local/copy/dir_link", "local/copy/file_link", "local/copy/dangling_link" };
+	const char* targets[] = { "bepa", "f1.txt", "nowhere" };
+	for( int i = 0; i < 3; ++i )
+	{
+		char target[64];
+		ssize_t target_len = readlink( links[i], target, sizeof( target ) - 1 );
+		ASSERT( target_len > 0 );
+		target[target_len] = '\0';
+		ASSERT_STR_EQ( targets[i], target );
+	}
+#endif
+
+	// only matching files, and the dirs they are in.
+	ASSERT_EQ( DIR_ERROR_OK, dir_copytree_glob( "local/apa", "local/copy2/sub", "**/*.bin", DIR_WALK_NO_FLAGS ) );
+	ASSERT( file_equals( "local/copy2/sub/bepa/cepa/f3.bin", "f3" ) );
+	ASSERT_FALSE( path_exists( "local/copy2/sub/f1.txt" ) );
+	ASSERT_FALSE( path_exists( "local/copy2/sub/empty" ) );
+
+	ASSERT_EQ( DIR_ERROR_PATH_DO_NOT_EXIST, dir_copytree( "local/depa", "local/copy3", DIR_WALK_NO_FLAGS ) );
+	ASSERT_EQ( DIR_ERROR_PATH_IS_FILE, dir_copytree( "local/apa/f1.txt", "local/copy3", DIR_WALK_NO_FLAGS ) );
+	ASSERT_FALSE( path_exists( "local/copy3" ) );
+	ASSERT_EQ( DIR_ERROR_INVALID_PATTERN, dir_copytree_glob( "local/apa", "local/copy3", "a**", DIR_WALK_NO_FLAGS ) );
+	ASSERT_FALSE( path_exists( "local/copy3" ) );
+
+	ASSERT_EQ( DIR_ERROR_OK, dir_rmtree( "local/apa" ) );
+	ASSERT_EQ( DIR_ERROR_OK, dir_rmtree( "local/copy" ) );
+	ASSERT_EQ( DIR_ERROR_OK, dir_rmtree( "local/copy2" ) );
+	return 0;
+}
+
+TEST walk_parallel_non_existing()
+{
+	ASSERT_EQ( DIR_ERROR_PATH_DO_NOT_EXIST, dir_walk_parallel( "local/apa", DIR_WALK_NO_FLAGS, 4, [](const dir_walk_item*) { return 0; } ) );
+	return 0;
+}
+
+struct change_list
+{
+	int  count;
+	char items[32][64];
+};
+
+static void change_list_add( change_list* l, char prefix, const char* relative )
+{
+	if( l->count < 32 )
+		snprintf( l->items[l->count++], 64, "%c %s", prefix, relative );
+}
+
+static bool change_list_has( const change_list* l, const char* item )
+{
+	for( int i = 0; i < l->count; ++i )
+		if( streq( l->items[i], item ) )
+			return true;
+	return false;
+}
+
+static change_list walk_changes( const char* root, const char* snapshot )
+{
+	change_list l;
+	l.count = 0;
+	dir_walk_changes( root, snapshot, [&l](dir_change_type change, const dir_walk_item* item) {
+		change_list_add( &l, change == DIR_CHANGE_ADDED ? '+' : change == DIR_CHANGE_REMOVED ? '-' : 'M', item->relative );
+		return 0;
+	});
+	return l;
+}
+
+TEST iter_same_as_walk()
+{
+	create_wide_tree( "local/apa", 3, 3 );
+	ASSERT_EQ( DIR_ERROR_OK, dir_mktree( "local/apa/.git/objects" ) );
+	filedump( "local/apa/.git/objects/o1", (uint8_t*)"abc", 4 );
+	filedump( "local/apa/.f1.txt", (uint8_t*)"abc", 4 );
+
+	unsigned int flag_sets[] = { DIR_WALK_NO_FLAGS, DIR_WALK_DEPTH_FIRST, DIR_WALK_IGNORE_DOT_DIRS | DIR_WALK_WITH_STAT, DIR_WALK_IGNORE_DOT_ITEMS | DIR_WALK_DEPTH_FIRST };
+	for( unsigned int flags : flag_sets )
+	{
+		change_list walked;
+		walked.count = 0;
+		dir_walk( "local/apa", flags, [&walked]( const dir_walk_item* item ) {
+			change_list_add( &walked, item->type == DIR_ITEM_DIR ? 'd' : 'f', item->relative );
+			return 0;
+		});
+
+		dir_iter* iter;
+		ASSERT_EQ( DIR_ERROR_OK, dir_iter_open( "local/apa/", flags, &iter ) );
+		change_list iterated;
+		iterated.count = 0;
+		while( const dir_walk_item* item = dir_iter_next( iter ) )
+		{
+			ASSERT( strncmp( item->path, "local/apa/", 10 ) == 0 && strend( item->name, item->path ) );
+			ASSERT_EQ( ( flags & DIR_WALK_WITH_STAT ) > 0, item->stat != 0x0 );
+			change_list_add( &iterated, item->type == DIR_ITEM_DIR ? 'd' : 'f', item->relative );
+		}
+		ASSERT( dir_iter_next( iter ) == 0x0 );
+		ASSERT_EQ( DIR_ERROR_OK, dir_iter_error( iter ) );
+		dir_iter_close( iter );
+
+		ASSERT( walked.count > 0 );
+		ASSERT_EQ( walked.count, iterated.count );
+		for( int i = 0; i < walked.count; ++i )
+			ASSERT_STR_EQ( walked.items[i], iterated.items[i] );
+	}
+
+	dir_iter* iter;
+	ASSERT_EQ( DIR_ERROR_PATH_DO_NOT_EXIST, dir_iter_open( "local/bepa", DIR_WALK_NO_FLAGS, &iter ) );
+	ASSERT( iter == 0x0 );
+
+	ASSERT_EQ( DIR_ERROR_OK, dir_rmtree( "local/apa" ) );
+	return 0;
+}
+
+TEST iter_range()
+{
+	create_wide_tree( "local/apa", 4, 4 );
+
+	int items = 0;
+	dir_walk_range range( "local/apa", DIR_WALK_NO_FLAGS );
+	for( const dir_walk_item& item : range )
+	{
+		ASSERT( item.type == DIR_ITEM_FILE || item.type == DIR_ITEM_DIR );
+		++items;
+	}
+	ASSERT_EQ( 4 + 4 + 4 * 4 * 2, items );
+	ASSERT_EQ( DIR_ERROR_OK, range.error() );
+
+	// stop after the first few files.
+	int files = 0;
+	for( const dir_walk_item& item : dir_walk_range( "local/apa", DIR_WALK_NO_FLAGS ) )
+	{
+		if( item.type == DIR_ITEM_FILE && ++files == 3 )
+			break;
+	}
+	ASSERT_EQ( 3, files );
+
+	dir_walk_range missing( "local/bepa", DIR_WALK_NO_FLAGS );
+	ASSERT( missing.begin() == missing.end() );
+	ASSERT_EQ( DIR_ERROR_PATH_DO_NOT_EXIST, missing.error() );
+
+	ASSERT_EQ( DIR_ERROR_OK, dir_rmtree( "local/apa" ) );
+	return 0;
+}
+
+TEST walk_sorted()
+{
+	ASSERT_EQ( DIR_ERROR_OK, dir_mktree( "local/apa/m/sub" ) );
+	const char* files[] = { "local/apa/k.txt", "local/apa/c.txt", "local/apa/x.txt", "local/apa/m/z.txt", "local/apa/m/b.txt", "local/apa/a.txt", "local/apa/m/sub/q.txt" };
+	for( size_t i = 0; i < sizeof( files ) / sizeof( files[0] ); ++i )
+		filedump( files[i], (uint8_t*)"abc", 4 );
+
+	const char* expect[]       = { "a.txt", "c.txt", "k.txt", "m", "m/b.txt", "m/sub", "m/sub/q.txt", "m/z.txt", "x.txt" };
+	const char* expect_depth[] = { "a.txt", "c.txt", "k.txt", "m/b.txt", "m/sub/q.txt", "m/sub", "m/z.txt", "m", "x.txt" };
+	const char* expect_glob[]  = { "a.txt", "c.txt", "k.txt", "m/b.txt", "m/sub/q.txt", "m/z.txt", "x.txt" };
+
+	change_list walked;
+	walked.count = 0;
+	ASSERT_EQ( DIR_ERROR_OK, dir_walk( "local/apa", DIR_WALK_SORTED | DIR_WALK_WITH_STAT, [&walked]( const dir_walk_item* item ) {
+		if( item->stat != 0x0 )
+			change_list_add( &walked, ' ', item->relative );
+		return 0;
+	}));
+	ASSERT_EQ( 9, walked.count );
+	for( int i = 0; i < walked.count; ++i )
+		ASSERT_STR_EQ( expect[i], walked.items[i] + 2 );
+
+	walked.count = 0;
+	ASSERT_EQ( DIR_ERROR_OK, dir_walk( "local/apa", DIR_WALK_SORTED | DIR_WALK_DEPTH_FIRST, [&walked]( const dir_walk_item* item ) {
+		change_list_add( &walked, ' ', item->relative );
+		return 0;
+	}));
+	ASSERT_EQ( 9, walked.count );
+	for( int i = 0; i < walked.count; ++i )
+		ASSERT_STR_EQ( expect_depth[i], walked.items[i] + 2 );
+
+	int i = 0;
+	for( const dir_walk_item& item : dir_walk_range( "local/apa", DIR_WALK_SORTED ) )
+	{
+		ASSERT( i < 9 );
+		ASSERT_STR_EQ( expect[i++], item.relative );
+	}
+	ASSERT_EQ( 9, i );
+
+	walked.count = 0;
+	ASSERT_EQ( DIR_ERROR_OK, dir_walk_glob( "local/apa", "**/*.txt", DIR_WALK_SORTED, [&walked]( const dir_walk_item* item ) {
+		change_list_add( &walked, ' ', item->relative );
+		return 0;
+	}));
+	ASSERT_EQ( 7, walked.count );
+	for( int j = 0; j < walked.count; ++j )
+		ASSERT_STR_EQ( expect_glob[j], walked.items[j] + 2 );
+
+	ASSERT_EQ( DIR_ERROR_OK, dir_rmtree( "local/apa" ) );
+	return 0;
+}
+
+TEST walk_sorted_batch()
+{
+	// enough entries in one dir to have the stats resolved in more than one batch or on more than one thread.
+	ASSERT_EQ( DIR_ERROR_OK, dir_mktree( "local/apa/sub" ) );
+	ASSERT_EQ( DIR_ERROR_OK, dir_mktree( "local/apa/.git" ) );
+	filedump( "local/apa/.hidden", (uint8_t*)"abc", 4 );
+	static const uint8_t data[32] = {};
+	char path[64];
+	for( int i = 0; i < 300; ++i )
+	{
+		snprintf( path, sizeof( path ), "local/apa/f%03d", i );
+		filedump( path, data, (size_t)( i % 31 + 1 ) );
+	}
+
+	dir_walk_stats stats;
+	int files = 0;
+	int dirs = 0;
+	char last[64] = "";
+	bool bad = false;
+	ASSERT_EQ( DIR_ERROR_OK, dir_walk_with_stats( "local/apa", DIR_WALK_SORTED | DIR_WALK_WITH_STAT | DIR_WALK_IGNORE_DOT_FILES, &stats, [&]( const dir_walk_item* item ) {
+		if( item->stat == 0x0 || strcmp( last, item->relative ) >= 0 )
+			bad = true;
+		snprintf( last, sizeof( last ), "%s", item->relative );
+		if( item->type == DIR_ITEM_DIR )
+			++dirs;
+		else if( item->stat != 0x0 && item->stat->size != (uint64_t)( strtol( item->name + 1, 0x0, 10 ) % 31 + 1 ) )
+			bad = true;
+		else
+			++files;
+		return 0;
+	}));
+	ASSERT( !bad );
+	ASSERT_EQ( 300, files );
+	ASSERT_EQ( 2, dirs );
+#if !defined( DIRUTIL_NO_STATS )
+	ASSERT_EQ( 1u, stats.dot_items_skipped );
+	ASSERT_EQ( 302u, stats.stats_fetched );
+#endif
+
+	ASSERT_EQ( DIR_ERROR_OK, dir_rmtree( "local/apa" ) );
+	return 0;
+}
+
+TEST walk_long_path()
+{
+#if !defined( _WIN32 )
+	// deeper than the buffers the walks start with, created relative the parent as the full path is too long
+	// for mkdir().
+	static const int DEPTH = 25;
+	char name[201];
+	memset( name, 'd', sizeof( name ) - 1 );
+	name[sizeof( name ) - 1] = '\0';
+
+	ASSERT_EQ( DIR_ERROR_OK, dir_mktree( "local/apa" ) );
+	int fds[DEPTH + 1];
+	fds[0] = open( "local/apa", O_RDONLY | O_DIRECTORY );
+	ASSERT( fds[0] >= 0 );
+	for( int i = 0; i < DEPTH; ++i )
+	{
+		ASSERT_EQ( 0, mkdirat( fds[i], name, 0755 ) );
+		fds[i + 1] = openat( fds[i], name, O_RDONLY | O_DIRECTORY );
+		ASSERT( fds[i + 1] >= 0 );
+	}
+	close( openat( fds[DEPTH], "leaf.txt", O_CREAT | O_WRONLY, 0644 ) );
+
+	// dirs are reported after their sub-tree with DIR_WALK_DEPTH_FIRST, when the path-buffer has grown.
+	size_t leaf_len = strlen( "local/apa" ) + DEPTH * sizeof( name ) + strlen( "/leaf.txt" );
+	int  dirs  = 0;
+	int  files = 0;
+	bool bad   = false;
+	ASSERT_EQ( DIR_ERROR_OK, dir_walk( "local/apa", DIR_WALK_DEPTH_FIRST, [&]( const dir_walk_item* item ) {
+		if( item->type == DIR_ITEM_DIR )
+		{
+			bad |= strcmp( item->name, name ) != 0 || strlen( item->path ) != strlen( "local/apa" ) + ( DEPTH - dirs ) * sizeof( name );
+			++dirs;
+		}
+		else
+		{
+			bad |= strcmp( item->name, "leaf.txt" ) != 0 || strlen( item->path ) != leaf_len;
+			++files;
+		}
+		return 0;
+	}));
+	ASSERT( !bad );
+	ASSERT_EQ( DEPTH, dirs );
+	ASSERT_EQ( 1, files );
+
+	int items = 0;
+	for( const dir_walk_item& item : dir_walk_range( "local/apa", DIR_WALK_NO_FLAGS ) )
+	{
+		if( item.type == DIR_ITEM_FILE )
+			ASSERT_EQ( leaf_len, strlen( item.path ) );
+		++items;
+	}
+	ASSERT_EQ( DEPTH + 1, items );
+
+	std::atomic<int> parallel_items( 0 );
+	ASSERT_EQ( DIR_ERROR_OK, dir_walk_parallel( "local/apa", DIR_WALK_NO_FLAGS, 4, [&parallel_items]( const dir_walk_item* ) {
+		++parallel_items;
+		return 0;
+	}));
+	ASSERT_EQ( DEPTH + 1, (int)parallel_items );
+
+	files = 0;
+	ASSERT_EQ( DIR_ERROR_OK, dir_walk_glob( "local/apa", "**/leaf.txt", DIR_WALK_NO_FLAGS, [&files]( const dir_walk_item* ) {
+		++files;
+		return 0;
+	}));
+	ASSERT_EQ( 1, files );
+
+	std::atomic<int> async_items( 0 );
+	ASSERT_EQ( DIR_ERROR_OK, dir_walk_async( "local/apa", DIR_WALK_WITH_STAT, 0, [&async_items]( const dir_walk_item* ) {
+		++async_items;
+		return 0;
+	}));
+	ASSERT_EQ( DEPTH + 1, (int)async_items );
+
+	dir_tree* tree;
+	ASSERT_EQ( DIR_ERROR_OK, dir_tree_build( "local/apa", DIR_WALK_WITH_STAT, &tree ) );
+	ASSERT_EQ( (uint32_t)DEPTH + 2, dir_tree_node_count( tree ) );
+
+	// copies are created by full path, the part of the tree the OS can resolve is created before failing.
+	ASSERT_EQ( DIR_ERROR_PATH_TO_DEEP, dir_copytree( "local/apa", "local/copy", DIR_WALK_NO_FLAGS ) );
+	ASSERT_EQ( DIR_ERROR_OK, dir_rmtree( "local/copy" ) );
+
+	// the leaf is found as modified through the full path.
+	ASSERT_EQ( DIR_ERROR_OK, dir_snapshot_write( "local/apa", DIR_WALK_NO_FLAGS, "local/apa.snapshot" ) );
+	int leaf_fd = openat( fds[DEPTH], "leaf.txt", O_WRONLY );
+	ASSERT( leaf_fd >= 0 );
+	ASSERT_EQ( 3, (int)write( leaf_fd, "abc", 3 ) );
+	close( leaf_fd );
+	int modified = 0;
+	ASSERT_EQ( DIR_ERROR_OK, dir_walk_changes( "local/apa", "local/apa.snapshot", [&]( dir_change_type change, const dir_walk_item* item ) {
+		bad |= change != DIR_CHANGE_MODIFIED || strlen( item->path ) != leaf_len;
+		++modified;
+		return 0;
+	}));
+	ASSERT_EQ( DIR_ERROR_OK, dir_tree_changes( tree, "local/apa", [&]( dir_change_type change, const dir_walk_item* item ) {
+		bad |= change != DIR_CHANGE_MODIFIED || strlen( item->path ) != leaf_len;
+		++modified;
+		return 0;
+	}));
+	ASSERT( !bad );
+	ASSERT_EQ( 2, modified );
+	dir_tree_free( tree );
+	ASSERT_EQ( 0, remove( "local/apa.snapshot" ) );
+
+	ASSERT_EQ( 0, unlinkat( fds[DEPTH], "leaf.txt", 0 ) );
+	for( int i = DEPTH - 1; i >= 0; --i )
+	{
+		close( fds[i + 1] );
+		ASSERT_EQ( 0, unlinkat( fds[i], name, AT_REMOVEDIR ) );
+	}
+	close( fds[0] );
+	ASSERT_EQ( DIR_ERROR_OK, dir_rmtree( "local/apa" ) );
+#endif
+
+	// roots longer than the default DIRUTIL_MAX_PATH_LENGTH.
+	static char long_root[128 * 1024];
+	memset( long_root, 'a', sizeof( long_root ) - 1 );
+	long_root[sizeof( long_root ) - 1] = '\0';
+	ASSERT_EQ( DIR_ERROR_PATH_TO_DEEP, dir_walk( long_root, DIR_WALK_NO_FLAGS, []( const dir_walk_item* ) { return 0; } ) );
+	ASSERT_EQ( DIR_ERROR_PATH_TO_DEEP, dir_mktree( long_root ) );
+	return 0;
+}
+
+TEST snapshot_changes()
+{
+	ASSERT_EQ( DIR_ERROR_OK, dir_mktree( "local/apa/bepa/cepa" ) );
+	ASSERT_EQ( DIR_ERROR_OK, dir_mktree( "local/apa/depa" ) );
+	filedump( "local/apa/f1.txt",           (uint8_t*)"abc", 4 );
+	filedump( "local/apa/bepa/f2.txt",      (uint8_t*)"abc", 4 );
+	filedump( "local/apa/bepa/cepa/f3.txt", (uint8_t*)"abc", 4 );
+	filedump( "local/apa/depa/f4.txt",      (uint8_t*)"abc", 4 );
+	filedump( "local/apa/.f5.txt",          (uint8_t*)"abc", 4 );
+#if !defined( _WIN32 )
+	// a symlink to a dir is stored as a file, also when checked without reading the dir it is in.
+	ASSERT_EQ( 0, symlink( "bepa/cepa", "local/apa/lnk" ) );
+#endif
+
+	ASSERT_EQ( DIR_ERROR_OK, dir_snapshot_write( "local/apa", DIR_WALK_IGNORE_DOT_FILES, "local/apa.snapshot" ) );
+
+	// nothing changed.
+	change_list l = walk_changes( "local/apa", "local/apa.snapshot" );
+	ASSERT_EQ( 0, l.count );
+
+	filedump( "local/apa/bepa/cepa/f3.txt", (uint8_t*)"abcdef", 7 ); // modified in unchanged dir
+	filedump( "local/apa/bepa/f6.txt",      (uint8_t*)"abc", 4 );    // added
+	filedump( "local/apa/.f7.txt",          (uint8_t*)"abc", 4 );    // added, but ignored
+	remove( "local/apa/f1.txt" );                                    // removed
+	ASSERT_EQ( DIR_ERROR_OK, dir_rmtree( "local/apa/depa" ) );       // removed with content
+	ASSERT_EQ( DIR_ERROR_OK, dir_mktree( "local/apa/epa" ) );        // added with content
+	filedump( "local/apa/epa/f8.txt",       (uint8_t*)"abc", 4 );
+
+	l = walk_changes( "local/apa/", "local/apa.snapshot" );
+	ASSERT( change_list_has( &l, "M bepa/cepa/f3.txt" ) );
+	ASSERT( change_list_has( &l, "+ bepa/f6.txt" ) );
+	ASSERT( change_list_has( &l, "- f1.txt" ) );
+	ASSERT( change_list_has( &l, "- depa" ) );
+	ASSERT( change_list_has( &l, "- depa/f4.txt" ) );
+	ASSERT( change_list_has( &l, "+ epa" ) );
+	ASSERT( change_list_has( &l, "+ epa/f8.txt" ) );
+	ASSERT_EQ( 7, l.count );
+
+	ASSERT_EQ( DIR_ERROR_OK, dir_rmtree( "local/apa" ) );
+	remove( "local/apa.snapshot" );
+	return 0;
+}
+
+TEST snapshot_invalid()
+{
+	ASSERT_EQ( DIR_ERROR_OK, dir_mktree( "local/apa" ) );
+	filedump( "local/apa.snapshot", (uint8_t*)"not a snapshot", 15 );
+
+	ASSERT_EQ( DIR_ERROR_FAILED, dir_walk_changes( "local/apa", "local/apa.snapshot", [](dir_change_type, const dir_walk_item*) { return 0; } ) );
+	ASSERT_EQ( DIR_ERROR_FAILED, dir_walk_changes( "local/apa", "local/does_not_exist.snapshot", [](dir_change_type, const dir_walk_item*) { return 0; } ) );
+
+	// offset of the parent-array, after the counts and sizes in the header, set to wrap when adding its size of
+	// 4 bytes per node.
+	filedump( "local/apa/f1.txt", (uint8_t*)"abc", 4 );
+	filedump( "local/apa/f2.txt", (uint8_t*)"abc", 4 );
+	filedump( "local/apa/f3.txt", (uint8_t*)"abc", 4 );
+	filedump( "local/apa/f4.txt", (uint8_t*)"abc", 4 );
+	ASSERT_EQ( DIR_ERROR_OK, dir_snapshot_write( "local/apa", DIR_WALK_NO_FLAGS, "local/apa.snapshot" ) );
+	uint8_t snapshot[1024];
+	FILE* f = fopen( "local/apa.snapshot", "rb" );
+	ASSERT( f != 0x0 );
+	size_t snapshot_size = fread( snapshot, 1, sizeof( snapshot ), f );
+	fclose( f );
+	ASSERT( snapshot_size > 40 && snapshot_size < sizeof( snapshot ) );
+	uint64_t bad_offset = 0xFFFFFFFFFFFFFFF0ull;
+	memcpy( snapshot + 32, &bad_offset, sizeof( bad_offset ) );
+	filedump( "local/apa.snapshot", snapshot, snapshot_size );
+	ASSERT_EQ( DIR_ERROR_FAILED, dir_walk_changes( "local/apa", "local/apa.snapshot", [](dir_change_type, const dir_walk_item*) { return 0; } ) );
+
+	ASSERT_EQ( DIR_ERROR_OK, dir_rmtree( "local/apa" ) );
+	remove( "local/apa.snapshot" );
+	return 0;
+}
+
+TEST tree_build()
+{
+	create_wide_tree( "local/apa", 3, 3 );
+	ASSERT_EQ( DIR_ERROR_OK, dir_mktree( "local/apa/.git" ) );
+	filedump( "local/apa/.git/o1", (uint8_t*)"abc", 4 );
+
+	unsigned int flag_sets[] = { DIR_WALK_NO_FLAGS, DIR_WALK_IGNORE_DOT_DIRS | DIR_WALK_WITH_STAT };
+	for( unsigned int flags : flag_sets )
+	{
+		dir_tree* tree;
+		ASSERT_EQ( DIR_ERROR_OK, dir_tree_build( "local/apa/", flags, &tree ) );
+
+		// every walked item should be in the tree, with the same path, and nothing else.
+		uint32_t walked = 1;
+		char path[256];
+		dir_walk( "local/apa", flags, [&]( const dir_walk_item* item ) -> int {
+			uint32_t node = dir_tree_find( tree, item->relative );
+			if( node == DIR_TREE_NO_NODE ||
+				dir_tree_type( tree, node ) != item->type ||
+				!streq( dir_tree_name( tree, node ), item->name ) ||
+				dir_tree_path( tree, node, path, sizeof( path ) ) != strlen( item->relative ) ||
+				!streq( path, item->relative ) ||
+				( item->stat != 0x0 && item->type == DIR_ITEM_FILE && dir_tree_size( tree, node ) != 4 ) )
+				return DIR_WALK_ABORT;
+			++walked;
+			return DIR_WALK_CONTINUE;
+		});
+		ASSERT_EQ( walked, dir_tree_node_count( tree ) );
+		ASSERT_EQ( ( flags & DIR_WALK_IGNORE_DOT_DIRS ) ? 25u : 27u, dir_tree_node_count( tree ) );
+
+		// children are consecutive and sorted.
+		for( uint32_t node = 0; node < dir_tree_node_count( tree ); ++node )
+		{
+			uint32_t first;
+			uint32_t count = dir_tree_children( tree, node, &first );
+			for( uint32_t c = first; c < first + count; ++c )
+			{
+				ASSERT_EQ( node, dir_tree_parent( tree, c ) );
+				if( c > first )
+					ASSERT( strcmp( dir_tree_name( tree, c - 1 ), dir_tree_name( tree, c ) ) < 0 );
+			}
+		}
+
+		uint32_t d1 = dir_tree_find_child( tree, 0, "d1" );
+		ASSERT( d1 != DIR_TREE_NO_NODE );
+		ASSERT_EQ( d1, dir_tree_find( tree, "/d1/" ) );
+		ASSERT_EQ( dir_tree_find_child( tree, d1, "sub" ), dir_tree_find( tree, "d1/sub" ) );
+		ASSERT_EQ( DIR_TREE_NO_NODE, dir_tree_find( tree, "d1/nope" ) );
+		ASSERT_EQ( DIR_TREE_NO_NODE, dir_tree_find( tree, "d1/f0.txt/nope" ) );
+		ASSERT_EQ( DIR_TREE_NO_NODE, dir_tree_parent( tree, 0 ) );
+		ASSERT_STR_EQ( "", dir_tree_name( tree, 0 ) );
+		ASSERT_EQ( 0u, dir_tree_find( tree, "" ) );
+
+		uint32_t f = dir_tree_find( tree, "d2/sub/f1.txt" );
+		ASSERT_EQ( 13u, dir_tree_path( tree, f, path, 13 ) ); // too small.
+		ASSERT_EQ( ( flags & DIR_WALK_WITH_STAT ) ? 4u : 0u, dir_tree_size( tree, f ) );
+		ASSERT_EQ( ( flags & DIR_WALK_WITH_STAT ) > 0, dir_tree_mtime( tree, f ) > 0 );
+
+		dir_tree_free( tree );
+	}
+
+	dir_tree* tree;
+	ASSERT_EQ( DIR_ERROR_PATH_DO_NOT_EXIST, dir_tree_build( "local/bepa", DIR_WALK_NO_FLAGS, &tree ) );
+	ASSERT( tree == 0x0 );
+
+	ASSERT_EQ( DIR_ERROR_OK, dir_rmtree( "local/apa" ) );
+	return 0;
+}
+
+TEST tree_file()
+{
+	create_wide_tree( "local/apa", 3, 3 );
+	filedump( "local/apa/.hidden.txt", (uint8_t*)"abc", 4 );
+
+	dir_tree* built;
+	ASSERT_EQ( DIR_ERROR_OK, dir_tree_build( "local/apa", DIR_WALK_WITH_STAT, &built ) );
+	ASSERT_EQ( DIR_ERROR_OK, dir_tree_write( built, "local/apa.tree" ) );
+
+	dir_tree* tree;
+	ASSERT_EQ( DIR_ERROR_OK, dir_tree_open( "local/apa.tree", &tree ) );
+	ASSERT_EQ( dir_tree_node_count( built ), dir_tree_node_count( tree ) );
+	char p1[256];
+	char p2[256];
+	for( uint32_t node = 0; node < dir_tree_node_count( tree ); ++node )
+	{
+		dir_tree_path( built, node, p1, sizeof( p1 ) );
+		dir_tree_path( tree, node, p2, sizeof( p2 ) );
+		ASSERT_STR_EQ( p1, p2 );
+		ASSERT_EQ( node, dir_tree_find( tree, p2 ) );
+		ASSERT_EQ( dir_tree_mtime( built, node ), dir_tree_mtime( tree, node ) );
+	}
+	dir_tree_free( built );
+
+	// matching in the tree should give the same items as matching on disk.
+	const char* patterns[] = { "**/*.txt", "d1/*", "*/sub/f{0,2}.txt", "nope/**/*.txt" };
+	const unsigned int flags[] = { DIR_WALK_NO_FLAGS, DIR_WALK_IGNORE_DOT_FILES | DIR_WALK_DEPTH_FIRST };
+	for( size_t p = 0; p < sizeof( patterns ) / sizeof( patterns[0] ); ++p )
+	{
+		for( size_t f = 0; f < sizeof( flags ) / sizeof( flags[0] ); ++f )
+		{
+			change_list expect;
+			expect.count = 0;
+			dir_walk_glob( "local/apa", patterns[p], flags[f], [&](const dir_walk_item* item) {
+				change_list_add( &expect, item->type == DIR_ITEM_DIR ? 'D' : 'F', item->relative );
+				return 0;
+			});
+
+			change_list found;
+			found.count = 0;
+			ASSERT_EQ( DIR_ERROR_OK, dir_tree_walk_glob( tree, patterns[p], flags[f], [&](const dir_walk_item* item) {
+				change_list_add( &found, item->type == DIR_ITEM_DIR ? 'D' : 'F', item->relative );
+				if( item->type == DIR_ITEM_FILE && item->stat->size != 4 )
+					return DIR_WALK_ABORT;
+				return DIR_WALK_CONTINUE;
+			}));
+
+			ASSERT_EQ( expect.count, found.count );
+			for( int i = 0; i < expect.count; ++i )
+				ASSERT( change_list_has( &found, expect.items[i] ) );
+		}
+	}
+	ASSERT_EQ( DIR_ERROR_INVALID_PATTERN, dir_tree_walk_glob( tree, "[a", DIR_WALK_NO_FLAGS, [](const dir_walk_item*) { return 0; } ) );
+
+	// the stored tree is valid until something changes.
+	change_list changes = walk_changes( "local/apa", "local/apa.tree" );
+	ASSERT_EQ( 0, changes.count );
+	filedump( "local/apa/d0/new.txt", (uint8_t*)"abc", 4 );
+	changes.count = 0;
+	ASSERT_EQ( DIR_ERROR_OK, dir_tree_changes( tree, "local/apa", [&](dir_change_type change, const dir_walk_item* item) {
+		change_list_add( &changes, change == DIR_CHANGE_ADDED ? '+' : '?', item->relative );
+		return 0;
+	}));
+	ASSERT_EQ( 1, changes.count );
+	ASSERT_STR_EQ( "+ d0/new.txt", changes.items[0] );
+
+	// files has no children to find.
+	uint32_t file = 0;
+	while( dir_tree_type( tree, file ) != DIR_ITEM_FILE )
+		++file;
+	char file_child[256];
+	dir_tree_path( tree, file, file_child, sizeof( file_child ) );
+	strcat( file_child, "/x" );
+	ASSERT_EQ( DIR_TREE_NO_NODE, dir_tree_find( tree, file_child ) );
+	ASSERT_EQ( DIR_TREE_NO_NODE, dir_tree_find_child( tree, file, "x" ) );
+	dir_tree_free( tree );
+
+	// corrupt files are rejected when opened, the child-count of a file and an unknown type.
+	static uint8_t tree_data[64 * 1024];
+	FILE* f = fopen( "local/apa.tree", "rb" );
+	ASSERT( f != 0x0 );
+	size_t tree_size = fread( tree_data, 1, sizeof( tree_data ), f );
+	fclose( f );
+	ASSERT( tree_size > 0 && tree_size < sizeof( tree_data ) );
+
+	uint64_t child_count_offset;
+	uint64_t type_offset;
+	memcpy( &child_count_offset, tree_data + 48, sizeof( child_count_offset ) );
+	memcpy( &type_offset,        tree_data + 64, sizeof( type_offset ) );
+	uint32_t bad_count = 0x40000000;
+	memcpy( tree_data + child_count_offset + file * sizeof( uint32_t ), &bad_count, sizeof( bad_count ) );
+	filedump( "local/apa.tree", tree_data, tree_size );
+	ASSERT_EQ( DIR_ERROR_FAILED, dir_tree_open( "local/apa.tree", &tree ) );
+
+	uint32_t count = 0;
+	memcpy( tree_data + child_count_offset + file * sizeof( uint32_t ), &count, sizeof( count ) );
+	tree_data[type_offset + file] = 7;
+	filedump( "local/apa.tree", tree_data, tree_size );
+	ASSERT_EQ( DIR_ERROR_FAILED, dir_tree_open( "local/apa.tree", &tree ) );
+
+	filedump( "local/apa.tree", (uint8_t*)"not a tree", 11 );
+	ASSERT_EQ( DIR_ERROR_FAILED, dir_tree_open( "local/apa.tree", &tree ) );
+	ASSERT( tree == 0x0 );
+
+	ASSERT_EQ( DIR_ERROR_OK, dir_rmtree( "local/apa" ) );
+	remove( "local/apa.tree" );
+	return 0;
+}
+
+TEST walk_glob()
+{
+	ASSERT_EQ( DIR_ERROR_OK, dir_mktree( "local/apa/src/engine/sub" ) );
+	ASSERT_EQ( DIR_ERROR_OK, dir_mktree( "local/apa/src/tools" ) );
+	ASSERT_EQ( DIR_ERROR_OK, dir_mktree( "local/apa/data/.git" ) );
+	filedump( "local/apa/src/engine/a.cpp",     (uint8_t*)"abc", 4 );
+	filedump( "local/apa/src/engine/b.h",       (uint8_t*)"abc", 4 );
+	filedump( "local/apa/src/engine/sub/c.cpp", (uint8_t*)"abc", 4 );
+	filedump( "local/apa/src/tools/d.cpp",      (uint8_t*)"abc", 4 );
+	filedump( "local/apa/data/e.cpp",           (uint8_t*)"abc", 4 );
+	filedump( "local/apa/data/.git/f.cpp",      (uint8_t*)"abc", 4 );
+	filedump( "local/apa/g.txt",                (uint8_t*)"abc", 4 );
+
+	// the pruned walk should report the same items as a full walk filtered by the pattern.
+	const char* patterns[] = { "src/engine/**/*.cpp", "**/*.cpp", "src/*", "*/*/*.cpp", "src/engine", "g.txt", "src/{engine,tools}/*.{cpp,h}", "**/sub/*", "nope/**/*.cpp" };
+	const unsigned int flags[] = { DIR_WALK_NO_FLAGS, DIR_WALK_IGNORE_DOT_DIRS | DIR_WALK_DEPTH_FIRST };
+	for( size_t p = 0; p < sizeof( patterns ) / sizeof( patterns[0] ); ++p )
+	{
+		for( size_t f = 0; f < sizeof( flags ) / sizeof( flags[0] ); ++f )
+		{
+			dir_glob* glob = dir_glob_compile( patterns[p] );
+			change_list expect;
+			expect.count = 0;
+			dir_walk( "local/apa", flags[f], [&](const dir_walk_item* item) {
+				if( dir_glob_match_compiled( glob, item->relative ) == DIR_GLOB_MATCH )
+					change_list_add( &expect, item->type == DIR_ITEM_DIR ? 'D' : 'F', item->relative );
+				return 0;
+			});
+			dir_glob_free( glob );
+
+			change_list found;
+			found.count = 0;
+			ASSERT_EQ( DIR_ERROR_OK, dir_walk_glob( "local/apa/", patterns[p], flags[f], [&](const dir_walk_item* item) {
+				change_list_add( &found, item->type == DIR_ITEM_DIR ? 'D' : 'F', item->relative );
+				return 0;
+			}));
+
+			ASSERT_EQm( patterns[p], expect.count, found.count );
+			for( int i = 0; i < expect.count; ++i )
+				ASSERTm( expect.items[i], change_list_has( &found, expect.items[i] ) );
+		}
+	}
+
+	ASSERT_EQ( DIR_ERROR_INVALID_PATTERN, dir_walk_glob( "local/apa", "a[bc", DIR_WALK_NO_FLAGS, [](const dir_walk_item*) { return 0; } ) );
+	ASSERT_EQ( DIR_ERROR_PATH_DO_NOT_EXIST, dir_walk_glob( "local/bepa", "src/*", DIR_WALK_NO_FLAGS, [](const dir_walk_item*) { return 0; } ) );
+
+	ASSERT_EQ( DIR_ERROR_OK, dir_rmtree( "local/apa" ) );
+	return 0;
+}
+
+static change_list watch_poll( dir_watch* watch, dir_error* res )
+{
+	change_list l;
+	l.count = 0;
+	*res = dir_watch_poll( watch, 1000, 50, [&l](const dir_watch_event* events, size_t num_events) {
+		for( size_t i = 0; i < num_events; ++i )
+			change_list_add( &l, events[i].change == DIR_CHANGE_ADDED ? '+' : events[i].change == DIR_CHANGE_REMOVED ? '-' : 'M', events[i].item.relative );
+	});
+	return l;
+}
+
+TEST watch_changes()
+{
+#if defined( __linux__ )
+	ASSERT_EQ( DIR_ERROR_OK, dir_mktree( "local/apa/bepa" ) );
+	filedump( "local/apa/f1.txt",      (uint8_t*)"abc", 4 );
+	filedump( "local/apa/bepa/f2.txt", (uint8_t*)"abc", 4 );
+
+	dir_watch* watch;
+	ASSERT_EQ( DIR_ERROR_INVALID_PATTERN, dir_watch_open( "local/apa", "[a-", DIR_WALK_NO_FLAGS, &watch ) );
+	ASSERT_EQ( DIR_ERROR_PATH_DO_NOT_EXIST, dir_watch_open( "local/bepa", 0x0, DIR_WALK_NO_FLAGS, &watch ) );
+	ASSERT_EQ( DIR_ERROR_OK, dir_watch_open( "local/apa/", 0x0, DIR_WALK_IGNORE_DOT_FILES | DIR_WALK_WITH_STAT, &watch ) );
+	ASSERT( dir_watch_fd( watch ) >= 0 );
+
+	// nothing changed.
+	dir_error res;
+	change_list l = watch_poll( watch, &res );
+	ASSERT_EQ( DIR_ERROR_OK, res );
+	ASSERT_EQ( 0, l.count );
+
+	filedump( "local/apa/f1.txt",      (uint8_t*)"abcdef", 7 ); // modified
+	filedump( "local/apa/f3.txt",      (uint8_t*)"abc", 4 );    // added and modified, reported as added
+	filedump( "local/apa/f3.txt",      (uint8_t*)"abcdef", 7 );
+	filedump( "local/apa/f4.txt",      (uint8_t*)"abc", 4 );    // added and removed, not reported
+	remove( "local/apa/f4.txt" );
+	filedump( "local/apa/.f5.txt",     (uint8_t*)"abc", 4 );    // added, but ignored
+	remove( "local/apa/bepa/f2.txt" );                          // removed
+	ASSERT_EQ( DIR_ERROR_OK, dir_mktree( "local/apa/cepa/depa" ) );
+	filedump( "local/apa/cepa/depa/f6.txt", (uint8_t*)"abc", 4 );
+
+	l = watch_poll( watch, &res );
+	ASSERT_EQ( DIR_ERROR_OK, res );
+	ASSERT( change_list_has( &l, "M f1.txt" ) );
+	ASSERT( change_list_has( &l, "+ f3.txt" ) );
+	ASSERT( change_list_has( &l, "- bepa/f2.txt" ) );
+	ASSERT( change_list_has( &l, "+ cepa" ) );
+	ASSERT( change_list_has( &l, "+ cepa/depa" ) );
+	ASSERT( change_list_has( &l, "+ cepa/depa/f6.txt" ) );
+	ASSERT_EQ( 6, l.count );
+
+	// the new dirs are watched as well.
+	filedump( "local/apa/cepa/depa/f7.txt", (uint8_t*)"abc", 4 );
+	l = watch_poll( watch, &res );
+	ASSERT( change_list_has( &l, "+ cepa/depa/f7.txt" ) );
+	ASSERT_EQ( 1, l.count );
+
+	// a rescan finds nothing new if all events were handled.
+	int batches = 0;
+	ASSERT_EQ( DIR_ERROR_OK, dir_watch_rescan( watch, [](const dir_watch_event*, size_t, void* userdata) { ++*(int*)userdata; }, &batches ) );
+	ASSERT_EQ( 0, batches );
+
+	ASSERT_EQ( DIR_ERROR_OK, dir_rmtree( "local/apa/cepa" ) );
+	l = watch_poll( watch, &res );
+	ASSERT( change_list_has( &l, "- cepa" ) );
+	ASSERT( change_list_has( &l, "- cepa/depa" ) );
+	ASSERT( change_list_has( &l, "- cepa/depa/f6.txt" ) );
+	ASSERT( change_list_has( &l, "- cepa/depa/f7.txt" ) );
+	ASSERT_EQ( 4, l.count );
+
+	// removing the root report everything as removed.
+	ASSERT_EQ( DIR_ERROR_OK, dir_rmtree( "local/apa" ) );
+	l = watch_poll( watch, &res );
+	ASSERT_EQ( DIR_ERROR_PATH_DO_NOT_EXIST, res );
+	ASSERT( change_list_has( &l, "- f1.txt" ) );
+	ASSERT( change_list_has( &l, "- f3.txt" ) );
+	ASSERT( change_list_has( &l, "- bepa" ) );
+	ASSERT_EQ( 3, l.count );
+	dir_watch_close( watch );
+#endif
+	return 0;
+}
+
+TEST watch_glob()
+{
+#if defined( __linux__ )
+	ASSERT_EQ( DIR_ERROR_OK, dir_mktree( "local/apa/bepa" ) );
+
+	dir_watch* watch;
+	ASSERT_EQ( DIR_ERROR_OK, dir_watch_open( "local/apa", "**/*.txt", DIR_WALK_NO_FLAGS, &watch ) );
+
+	filedump( "local/apa/f1.txt",      (uint8_t*)"abc", 4 );
+	filedump( "local/apa/f2.bin",      (uint8_t*)"abc", 4 );
+	filedump( "local/apa/bepa/f3.txt", (uint8_t*)"abc", 4 );
+
+	dir_error res;
+	change_list l = watch_poll( watch, &res );
+	ASSERT_EQ( DIR_ERROR_OK, res );
+	ASSERT( change_list_has( &l, "+ f1.txt" ) );
+	ASSERT( change_list_has( &l, "+ bepa/f3.txt" ) );
+	ASSERT_EQ( 2, l.count );
+
+	// a rescan reports queued changes as well as what it finds.
+	remove( "local/apa/f1.txt" );
+	filedump( "local/apa/bepa/f3.txt", (uint8_t*)"abcdef", 7 );
+	filedump( "local/apa/f4.txt",      (uint8_t*)"abc", 4 );
+	l.count = 0;
+	ASSERT_EQ( DIR_ERROR_OK, dir_watch_rescan( watch, [](const dir_watch_event* events, size_t num_events, void* userdata) {
+		for( size_t i = 0; i < num_events; ++i )
+			change_list_add( (change_list*)userdata, events[i].change == DIR_CHANGE_ADDED ? '+' : events[i].change == DIR_CHANGE_REMOVED ? '-' : 'M', events[i].item.relative );
+	}, &l ) );
+	ASSERT( change_list_has( &l, "- f1.txt" ) );
+	ASSERT( change_list_has( &l, "+ f4.txt" ) );
+	ASSERT( change_list_has( &l, "M bepa/f3.txt" ) );
+	ASSERT_EQ( 3, l.count );
+
+	dir_watch_close( watch );
+	ASSERT_EQ( DIR_ERROR_OK, dir_rmtree( "local/apa" ) );
+#endif
+	return 0;
+}
+
 TEST dir_glob_match_simple()
 {
 	// TODO: split in multiple tests
@@ -433,15 +1726,240 @@ TEST dir_glob_match_invalid_pattern()
 	return 0;
 }
 
+struct glob_case
+{
+	const char*     pattern;
+	const char*     path;
+	dir_glob_result expect;
+};
+
+static const glob_case GLOB_CASES[] = {
+	{ "apa.txt",           "apa.txt",           DIR_GLOB_MATCH },
+	{ "bpa.txt",           "apa.txt",           DIR_GLOB_NO_MATCH },
+	{ "*.txt",             "apa.txt",           DIR_GLOB_MATCH },
+	{ "*.txt",             "apa.who",           DIR_GLOB_NO_MATCH },
+	{ "a*a.txt",           "apa.txt",           DIR_GLOB_MATCH },
+	{ "a*a.txt",           "bpa.txt",           DIR_GLOB_NO_MATCH },
+	{ "a*.txt",            "apb.txtb",          DIR_GLOB_NO_MATCH },
+	{ "*.h",               "src/bloo.cpp",      DIR_GLOB_NO_MATCH },
+	{ "p1/*.txt",          "p1/apa.txt",        DIR_GLOB_MATCH },
+	{ "p1/*.txt",          "p1",                DIR_GLOB_NO_MATCH },
+	{ "p*",                "p1",                DIR_GLOB_MATCH },
+	{ "p*",                "p1/",               DIR_GLOB_NO_MATCH },
+	{ "p*",                "p1/apa.txt",        DIR_GLOB_NO_MATCH },
+	{ "p*/",               "p1/",               DIR_GLOB_MATCH },
+	{ "a/*/b/*",           "a/c/b/apa.txt",     DIR_GLOB_MATCH },
+	{ "a/*/b/*",           "a/c/b/b/apa.txt",   DIR_GLOB_NO_MATCH },
+	{ "a?a/",              "apa/",              DIR_GLOB_MATCH },
+	{ "a?a/",              "apa",               DIR_GLOB_NO_MATCH },
+	{ "ap?a",              "ap/a",              DIR_GLOB_NO_MATCH },
+	{ "**/*.cpp",          "./src/apa.cpp",     DIR_GLOB_MATCH },
+	{ "**/apa.txt",        "apa.txt",           DIR_GLOB_MATCH },
+	{ "**/apa.txt",        "a/b/c/apa.txt",     DIR_GLOB_MATCH },
+	{ "**/apa.txt",        "a/apa.taxt",        DIR_GLOB_NO_MATCH },
+	{ "a/**/apa.txt",      "b/a/apa.txt",       DIR_GLOB_NO_MATCH },
+	{ "a/**/b/**/apa.txt", "a/b/apa.txt",       DIR_GLOB_MATCH },
+	{ "a/**/b/**/apa.txt", "a/c/d/b/a/apa.txt", DIR_GLOB_MATCH },
+	{ "a[pb]a.txt",        "aba.txt",           DIR_GLOB_MATCH },
+	{ "a[pb]a.txt",        "apba.txt",          DIR_GLOB_NO_MATCH },
+	{ "a[a-d]a.txt",       "aBa.txt",           DIR_GLOB_NO_MATCH },
+	{ "a[0-9]a.txt",       "a9a.txt",           DIR_GLOB_MATCH },
+	{ "a[!a-d]a.txt",      "ada.txt",           DIR_GLOB_NO_MATCH },
+	{ "a[!a-d]a.txt",      "afa.txt",           DIR_GLOB_MATCH },
+	{ "a[!a-d]a",          "a/a",               DIR_GLOB_NO_MATCH },
+	{ "a{.f1,.f2}",        "a.f2",              DIR_GLOB_MATCH },
+	{ "a{.f1,.f2}",        "a.f3",              DIR_GLOB_NO_MATCH },
+	{ "a{a1,a2}.txt",      "ba1.txt",           DIR_GLOB_NO_MATCH },
+	{ "{a,ab}c",           "abc",               DIR_GLOB_MATCH },
+	{ "*a.txt",            "aba.txt",           DIR_GLOB_MATCH },
+	{ "*/*.txt",           "a/b.txt",           DIR_GLOB_MATCH },
+	{ "**/a/**/b/**/c/*.x", "q/a/w/b/e/c/f.x",  DIR_GLOB_MATCH },
+	{ "**/a/**/b/**/c/*.x", "a/b/c",            DIR_GLOB_NO_MATCH },
+	{ "**/x/**/y",         "x/y",               DIR_GLOB_MATCH },
+	{ "**/x/**/y",         "y/x",               DIR_GLOB_NO_MATCH },
+	{ "*a*b*c",            "xaybzc",            DIR_GLOB_MATCH },
+	{ "*a*b*c",            "xaybz",             DIR_GLOB_NO_MATCH },
+	{ "{a,aa}{b,ab}*c",    "aabxc",             DIR_GLOB_MATCH },
+	{ "{a,aa}{b,ab}*c",    "aaxc",              DIR_GLOB_NO_MATCH },
+};
+
+TEST dir_glob_compiled()
+{
+	for( size_t i = 0; i < sizeof( GLOB_CASES ) / sizeof( GLOB_CASES[0] ); ++i )
+	{
+		const glob_case* c = &GLOB_CASES[i];
+		dir_glob* glob = dir_glob_compile( c->pattern );
+		ASSERTm( c->pattern, glob != 0x0 );
+		dir_glob_result res = dir_glob_match_compiled( glob, c->path );
+		dir_glob_free( glob );
+		ASSERT_EQm( c->path, c->expect, res );
+	}
+	return 0;
+}
+
+TEST dir_glob_compiled_invalid()
+{
+	ASSERT_EQ( (dir_glob*)0x0, dir_glob_compile( "a[bc" ) );
+	ASSERT_EQ( (dir_glob*)0x0, dir_glob_compile( "a{bc" ) );
+	ASSERT_EQ( (dir_glob*)0x0, dir_glob_compile( "a/**" ) );
+	ASSERT_EQ( (dir_glob*)0x0, dir_glob_compile( "a**/b" ) );
+	ASSERT_EQ( (dir_glob*)0x0, dir_glob_compile( "a{b/c,d}" ) );
+	return 0;
+}
+
+TEST dir_glob_long_segments()
+{
+	// segments of all lengths at all alignments, to hit all paths in the scans for the end of a segment.
+	static char buffer[256];
+	for( size_t offset = 0; offset < 32; ++offset )
+	{
+		for( size_t len = 0; len < 160; ++len )
+		{
+			char* path = buffer + offset;
+			memset( path, 'a', len );
+			memcpy( path + len, "/b.txt", 7 );
+			ASSERT_EQ( DIR_GLOB_MATCH,    dir_glob_match( "*/b.txt", path ) );
+			ASSERT_EQ( DIR_GLOB_MATCH,    dir_glob_match( "**/*.txt", path ) );
+			ASSERT_EQ( DIR_GLOB_NO_MATCH, dir_glob_match( "*/*/b.txt", path ) );
+			ASSERT_EQ( len > 0 ? DIR_GLOB_MATCH : DIR_GLOB_NO_MATCH, dir_glob_match( "*a/{b,c}.txt", path ) );
+		}
+	}
+	return 0;
+}
+
+TEST dir_glob_pathological()
+{
+	// patterns that backtracking matchers need exponential time for, should all finish in
+	// O( pattern * path ) without matching. They end in a wildcard so that the paths are not rejected on a
+	// literal suffix before the matching even starts.
+	static char many_dirs[1024];
+	static char many_chars[4096];
+	static char many_groups[256];
+	static char many_as[128];
+	many_dirs[0] = '\0';
+	for( int i = 0; i < 200; ++i )
+		strcat( many_dirs, "a/" );
+	strcat( many_dirs, "c.y" );
+	memset( many_chars, 'a', sizeof( many_chars ) - 1 );
+	many_chars[sizeof( many_chars ) - 1] = '\0';
+	many_groups[0] = '\0';
+	for( int i = 0; i < 24; ++i )
+		strcat( many_groups, "{a,aa}" );
+	strcat( many_groups, "b*" );
+	memset( many_as, 'a', sizeof( many_as ) - 1 );
+	many_as[sizeof( many_as ) - 1] = '\0';
+
+	ASSERT_EQ( DIR_GLOB_NO_MATCH, dir_glob_match( "**/a/**/a/**/a/**/a/**/a/**/a/**/b/*", many_dirs ) );
+	ASSERT_EQ( DIR_GLOB_NO_MATCH, dir_glob_match( "*a*a*a*a*a*a*a*a*a*a*b*", many_chars ) );
+	ASSERT_EQ( DIR_GLOB_NO_MATCH, dir_glob_match( many_groups, many_as ) );
+	ASSERT_EQ( DIR_GLOB_MATCH,    dir_glob_match( "**/a/**/a/**/a/**/a/**/a/**/a/**/*.y", many_dirs ) );
+	return 0;
+}
+
+TEST dir_globset_vs_compiled()
+{
+	// patterns covering all the ways a set can look up patterns, compared to matching them one by one.
+	static const char* PATTERNS[] = {
+		"apa.txt", "src/apa.cpp", "src//a", "**/apa.txt", "**/{a,b}.h", "**/*.cpp", "**/*.{h,inl}", "*.txt",
+		"*.{c,h}", "src/**/*.cpp", "a*a.txt", "**/*.tar.gz", "**/*{.h,.hpp}", "**/{a.h,*.h}", "p*", "p*/",
+		"a/*/b/*", "**/*.t?t", "a[0-9]a.txt", "*", "{*.c,b}", ".git*", "**/.gitignore", "a/**/b/**/apa.txt",
+	};
+	static const char* PATHS[] = {
+		"apa.txt", "a/b/c/apa.txt", "src/apa.cpp", "src/a/b/apa.cpp", "apa.cpp", "src//a", "a.h", "x/b.h",
+		"x/c.h", "x/c.hpp", "x/c.inl", "x.c", "x/y.c", "a.tar.gz", "a/b.tar.gz", "p1", "p1/", "a/c/b/apa.txt",
+		"a9a.txt", "a/b/a9a.txt", "*.c", "b", ".gitignore", "a/.gitignore", "a/b/apa.txt", "", "a/", "noext",
+		"dir.txt/", "a/c/d/b/a/apa.txt", "a.txt.txt", "src/x.tar.gz",
+	};
+	const size_t num_patterns = sizeof( PATTERNS ) / sizeof( PATTERNS[0] );
+
+	dir_globset* set = dir_globset_compile( PATTERNS, num_patterns, 0x0 );
+	ASSERT( set != 0x0 );
+
+	dir_glob* globs[num_patterns];
+	for( size_t i = 0; i < num_patterns; ++i )
+	{
+		globs[i] = dir_glob_compile( PATTERNS[i] );
+		ASSERTm( PATTERNS[i], globs[i] != 0x0 );
+	}
+
+	for( size_t p = 0; p < sizeof( PATHS ) / sizeof( PATHS[0] ); ++p )
+	{
+		uint32_t expect[num_patterns];
+		size_t num_expect = 0;
+		for( size_t i = 0; i < num_patterns; ++i )
+			if( dir_glob_match_compiled( globs[i], PATHS[p] ) == DIR_GLOB_MATCH )
+				expect[num_expect++] = (uint32_t)i;
+
+		uint32_t matches[num_patterns];
+		ASSERT_EQm( PATHS[p], num_expect, dir_globset_match( set, PATHS[p], matches, num_patterns ) );
+		for( size_t i = 0; i < num_expect; ++i )
+			ASSERT_EQm( PATHS[p], expect[i], matches[i] );
+	}
+
+	for( size_t i = 0; i < num_patterns; ++i )
+		dir_glob_free( globs[i] );
+	dir_globset_free( set );
+	return 0;
+}
+
+TEST dir_globset_max_matches()
+{
+	const char* patterns[] = { "*", "**/*.txt", "a.txt", "**/a.txt", "*.txt", "a.*" };
+	dir_globset* set = dir_globset_compile( patterns, 6, 0x0 );
+	ASSERT( set != 0x0 );
+
+	// only the lowest indices are returned, the count is still the complete number of matches.
+	uint32_t matches[3];
+	ASSERT_EQ( 6u, dir_globset_match( set, "a.txt", matches, 3 ) );
+	ASSERT_EQ( 0u, matches[0] );
+	ASSERT_EQ( 1u, matches[1] );
+	ASSERT_EQ( 2u, matches[2] );
+	ASSERT_EQ( 2u, dir_globset_match( set, "b/a.txt", 0x0, 0 ) );
+	ASSERT_EQ( 0u, dir_globset_match( set, "b/a.doc", matches, 3 ) );
+	dir_globset_free( set );
+
+	const char* invalid[] = { "*.txt", "a[bc", "b" };
+	size_t invalid_pattern = 0;
+	ASSERT_EQ( (dir_globset*)0x0, dir_globset_compile( invalid, 3, &invalid_pattern ) );
+	ASSERT_EQ( 1u, invalid_pattern );
+	return 0;
+}
+
 GREATEST_SUITE( dirutil )
 {
 	RUN_TEST( create_remove_tree );
 	RUN_TEST( create_remove_tree_slash );
+	RUN_TEST( create_tree_existing_prefix );
+	RUN_TEST( create_tree_many );
 	RUN_TEST( create_remove_tree_with_files );
 	RUN_TEST( item_correct );
 	RUN_TEST( ignore_dot_files );
 	RUN_TEST( ignore_dot_dirs );
 	RUN_TEST( ignore_dot_items );
+	RUN_TEST( walk_with_stat );
+	RUN_TEST( walk_stats );
+	RUN_TEST( walk_large_dir );
+	RUN_TEST( iter_same_as_walk );
+	RUN_TEST( iter_range );
+	RUN_TEST( walk_skip_and_abort );
+	RUN_TEST( walk_sorted );
+	RUN_TEST( walk_sorted_batch );
+	RUN_TEST( walk_long_path );
+	RUN_TEST( walk_parallel );
+	RUN_TEST( walk_parallel_depth_first );
+	RUN_TEST( walk_async );
+	RUN_TEST( walk_parallel_non_existing );
+	RUN_TEST( rmtree_parallel );
+	RUN_TEST( rmtree_async );
+	RUN_TEST( rmtree_reap );
+	RUN_TEST( copytree );
+	RUN_TEST( snapshot_changes );
+	RUN_TEST( snapshot_invalid );
+	RUN_TEST( tree_build );
+	RUN_TEST( tree_file );
+	RUN_TEST( walk_glob );
+	RUN_TEST( watch_changes );
+	RUN_TEST( watch_glob );
 }
 
 GREATEST_SUITE( glob )
@@ -456,6 +1974,12 @@ GREATEST_SUITE( glob )
 	RUN_TEST( dir_glob_match_ecaped_chars );
 	RUN_TEST( dir_glob_match_brackets );
 	RUN_TEST( dir_glob_match_invalid_pattern );
+	RUN_TEST( dir_glob_compiled );
+	RUN_TEST( dir_glob_compiled_invalid );
+	RUN_TEST( dir_glob_long_segments );
+	RUN_TEST( dir_glob_pathological );
+	RUN_TEST( dir_globset_vs_compiled );
+	RUN_TEST( dir_globset_max_matches );
 }
 
 GREATEST_MAIN_DEFS();